@@ -0,0 +1,133 @@
+//
+//  Arena Allocator
+//    Bump allocator which hands out memory from a list of large blocks and releases everything at once.
+//    Intended for per-frame temporaries; after the first frame, reset() makes subsequent frames
+//    allocate without calling into malloc at all.
+//
+//   USAGE:
+//     util::arena<> frame_arena(64 << 20);
+//     for (;;) {
+//       std::vector<int, util::arena_allocator<int>> indices(frame_arena);
+//       util::pod_vector<float, util::arena_allocator<float>> scratch(4096, frame_arena);
+//       marray<float, 2, util::arena_allocator<float>> image(util::arena_allocator<float>(frame_arena));
+//       ...
+//       frame_arena.reset(); // Rewinds all blocks, containers using the arena must be dead by now
+//     }
+//
+//  NOTES:
+//  - deallocate() is a no-op, memory is reclaimed by reset() or release()
+//  - Blocks are allocated through the upstream allocator, ie util::arena<util::huge_page_allocator<uint8_t>>
+//    makes every block huge page backed
+//  - Not thread safe, use one arena per thread
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+namespace util {
+
+
+template <typename UpstreamAllocator = std::allocator<uint8_t> >
+class arena {
+public:
+  typedef arena<UpstreamAllocator> my_type;
+  typedef UpstreamAllocator upstream_allocator_type;
+
+  arena(size_t block_size = size_t(1) << 20, const upstream_allocator_type& upstream = upstream_allocator_type())
+  : upstream_(upstream), block_size_(block_size), current_(0), offset_(0) {}
+  ~arena() { release(); }
+
+  void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+    DASSERT(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    for (; current_ < blocks_.size(); ++current_, offset_ = 0) {
+      const auto& current_block = blocks_[current_];
+      const auto address = reinterpret_cast<uintptr_t>(current_block.data) + offset_;
+      const size_t padding = (alignment - address % alignment) % alignment;
+      if (offset_ + padding + bytes <= current_block.size) {
+        offset_ += padding + bytes;
+        return current_block.data + offset_ - bytes;
+      }
+    }
+    // No block left which fits the request, append a new one
+    block new_block;
+    new_block.size = std::max(block_size_, bytes + alignment);
+    new_block.data = upstream_.allocate(new_block.size);
+    blocks_.push_back(new_block);
+    current_ = blocks_.size() - 1;
+    offset_ = 0;
+    return allocate(bytes, alignment);
+  }
+
+  // Rewinds the arena while keeping all blocks for reuse
+  void reset() {
+    current_ = 0;
+    offset_ = 0;
+  }
+  // Returns all blocks to the upstream allocator
+  void release() {
+    for (auto it = blocks_.begin(); it != blocks_.end(); ++it)
+      upstream_.deallocate(it->data, it->size);
+    blocks_.clear();
+    reset();
+  }
+
+  size_t capacity() const {
+    size_t sum = 0;
+    for (auto it = blocks_.begin(); it != blocks_.end(); ++it)
+      sum += it->size;
+    return sum;
+  }
+  size_t num_blocks() const { return blocks_.size(); }
+
+private:
+  arena(const arena& other);
+  arena& operator=(const arena& other);
+  struct block {
+    uint8_t* data;
+    size_t size;
+  };
+  upstream_allocator_type upstream_;
+  std::vector<block> blocks_;
+  size_t block_size_;
+  size_t current_;
+  size_t offset_;
+};
+
+
+template <typename T, typename UpstreamAllocator = std::allocator<uint8_t> >
+class arena_allocator {
+public:
+  typedef arena_allocator<T, UpstreamAllocator> my_type;
+  typedef arena<UpstreamAllocator> arena_type;
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  typedef std::true_type propagate_on_container_copy_assignment;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  arena_allocator(arena_type& source) : arena_(&source) {}
+  template <typename U>
+  arena_allocator(const arena_allocator<U, UpstreamAllocator>& other) : arena_(other.source()) {}
+
+  T* allocate(size_t n) { return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T))); }
+  void deallocate(T*, size_t) {}
+
+  arena_type* source() const { return arena_; }
+  template <typename U>
+  bool operator==(const arena_allocator<U, UpstreamAllocator>& other) const { return arena_ == other.source(); }
+  template <typename U>
+  bool operator!=(const arena_allocator<U, UpstreamAllocator>& other) const { return arena_ != other.source(); }
+
+private:
+  arena_type* arena_;
+};
+
+
+} // namespace util
@@ -0,0 +1,112 @@
+//
+//  Bit Count
+//    popcount, count_trailing_zeros and count_leading_zeros for 32 and 64 bit unsigned integers,
+//    compiled to the popcnt\tzcnt\lzcnt (or bsf\bsr) instructions where the compiler provides intrinsics.
+//
+//   USAGE:
+//     Iterate set bits of a word
+//     for (uint64_t bits = word; bits != 0; bits &= bits - 1)
+//       visit(util::count_trailing_zeros(bits));
+//
+//  NOTES:
+//  - count_trailing_zeros\count_leading_zeros of zero returns the number of bits of the type
+//
+#pragma once
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+namespace util {
+
+
+inline unsigned popcount(uint32_t val) {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_popcount(val));
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  return static_cast<unsigned>(__popcnt(val));
+#else
+  val = val - ((val >> 1) & 0x55555555u);
+  val = (val & 0x33333333u) + ((val >> 2) & 0x33333333u);
+  return static_cast<unsigned>((((val + (val >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24);
+#endif
+}
+
+inline unsigned popcount(uint64_t val) {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_popcountll(val));
+#elif defined(_MSC_VER) && defined(_M_X64)
+  return static_cast<unsigned>(__popcnt64(val));
+#else
+  return popcount(static_cast<uint32_t>(val)) + popcount(static_cast<uint32_t>(val >> 32));
+#endif
+}
+
+inline unsigned count_trailing_zeros(uint32_t val) {
+  if (val == 0)
+    return 32;
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_ctz(val));
+#elif defined(_MSC_VER)
+  unsigned long idx = 0;
+  _BitScanForward(&idx, val);
+  return static_cast<unsigned>(idx);
+#else
+  unsigned count = 0;
+  for (; (val & 1) == 0; val >>= 1)
+    ++count;
+  return count;
+#endif
+}
+
+inline unsigned count_trailing_zeros(uint64_t val) {
+  if (val == 0)
+    return 64;
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_ctzll(val));
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long idx = 0;
+  _BitScanForward64(&idx, val);
+  return static_cast<unsigned>(idx);
+#else
+  const uint32_t low = static_cast<uint32_t>(val);
+  return low != 0 ? count_trailing_zeros(low) : 32 + count_trailing_zeros(static_cast<uint32_t>(val >> 32));
+#endif
+}
+
+inline unsigned count_leading_zeros(uint32_t val) {
+  if (val == 0)
+    return 32;
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_clz(val));
+#elif defined(_MSC_VER)
+  unsigned long idx = 0;
+  _BitScanReverse(&idx, val);
+  return 31 - static_cast<unsigned>(idx);
+#else
+  unsigned count = 0;
+  for (; (val & 0x80000000u) == 0; val <<= 1)
+    ++count;
+  return count;
+#endif
+}
+
+inline unsigned count_leading_zeros(uint64_t val) {
+  if (val == 0)
+    return 64;
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_clzll(val));
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long idx = 0;
+  _BitScanReverse64(&idx, val);
+  return 63 - static_cast<unsigned>(idx);
+#else
+  const uint32_t high = static_cast<uint32_t>(val >> 32);
+  return high != 0 ? count_leading_zeros(high) : 32 + count_leading_zeros(static_cast<uint32_t>(val));
+#endif
+}
+
+
+} // namespace util
@@ -0,0 +1,52 @@
+//
+//  Checksum
+//    Fast non-cryptographic 64 bit checksum for detecting corrupt or truncated data. Four independent
+//    multiply-rotate lanes process 32 bytes per iteration, fast enough to verify data at memory bandwidth.
+//
+//   USAGE:
+//     const uint64_t sum = util::checksum64(data, num_bytes);
+//     Multiple blocks, the checksum of the previous block is the seed of the next
+//     const uint64_t sum = util::checksum64(values, num_value_bytes, util::checksum64(keys, num_key_bytes));
+//
+//  NOTES:
+//  - The result depends on the byte order of the machine
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace util {
+
+
+namespace _impl_checksum {
+  inline uint64_t rotl(uint64_t val, unsigned bits) { return (val << bits) | (val >> (64 - bits)); }
+} // namespace _impl_checksum
+
+
+inline uint64_t checksum64(const void* data, size_t num_bytes, uint64_t seed = 0) {
+  using _impl_checksum::rotl;
+  const uint64_t prime0 = 0x9E3779B185EBCA87ull;
+  const uint64_t prime1 = 0xC2B2AE3D27D4EB4Full;
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  uint64_t lanes[4] = { seed + prime0, seed + prime1, seed, seed - prime0 };
+  size_t pos = 0;
+  for (; pos + 32 <= num_bytes; pos += 32) {
+    for (size_t lane = 0; lane < 4; ++lane) {
+      uint64_t word = 0;
+      memcpy(&word, bytes + pos + lane * 8, 8);
+      lanes[lane] = rotl(lanes[lane] + word * prime1, 31) * prime0;
+    }
+  }
+  uint64_t hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18) + num_bytes;
+  for (; pos < num_bytes; ++pos)
+    hash = (hash ^ bytes[pos]) * 0x100000001B3ull;
+  hash ^= hash >> 33;
+  hash *= prime1;
+  hash ^= hash >> 29;
+  return hash;
+}
+
+
+} // namespace util
@@ -0,0 +1,416 @@
+//
+//  Compressed Set
+//    Set of uint32_t values for sparse values in a large universe (roaring bitmap layout).
+//    Values are partitioned by their upper 16 bits into containers, each holding the lower 16 bits either as a sorted
+//    array (up to 4096 values, 2 bytes per value) or as a 65536 bit bitmap (8 kB), whichever is smaller.
+//    Set operations are performed container by container, word-parallel for bitmaps.
+//
+//   USAGE:
+//     util::compressed_set ids;
+//     ids.insert(3000000000u);
+//     if (ids.count(42)) { ... }
+//     for (auto id : ids) { ... }                   // Ascending order
+//     auto both = util::set_intersection(a, b);
+//
+//  NOTES:
+//  - For dense values in a small universe util::dense_set (dense_set.h) is faster
+//  - Iterators are invalidated by any modification
+//
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <initializer_list>
+#include "bit_count.h"
+
+namespace util {
+
+
+namespace _impl_compressed_set {
+  static const size_t array_max_size = 4096;
+  static const size_t bitmap_num_words = 65536 / 64;
+
+  // Lower 16 bits of the values sharing the upper 16 bits
+  class container {
+  public:
+    explicit container(uint16_t key) : key_(key), size_(0) {}
+
+    uint16_t key() const { return key_; }
+    size_t size() const { return size_; }
+    bool is_bitmap() const { return !bitmap_.empty(); }
+    const std::vector<uint16_t>& array() const { return array_; }
+    const std::vector<uint64_t>& bitmap() const { return bitmap_; }
+    bool operator==(const container& other) const {
+      if (key_ != other.key_ || size_ != other.size_)
+        return false;
+      if (is_bitmap() == other.is_bitmap())
+        return is_bitmap() ? bitmap_ == other.bitmap_ : array_ == other.array_;
+      const container& arr = is_bitmap() ? other : *this;
+      const container& bmp = is_bitmap() ? *this : other;
+      for (auto low : arr.array_)
+        if (!bmp.contains(low))
+          return false;
+      return true;
+    }
+
+    bool contains(uint16_t low) const {
+      if (is_bitmap())
+        return ((bitmap_[low / 64] >> (low % 64)) & 1) != 0;
+      return std::binary_search(array_.begin(), array_.end(), low);
+    }
+    bool insert(uint16_t low) {
+      if (is_bitmap()) {
+        uint64_t& word = bitmap_[low / 64];
+        const uint64_t bit = uint64_t(1) << (low % 64);
+        if ((word & bit) != 0)
+          return false;
+        word |= bit;
+        ++size_;
+        return true;
+      }
+      const auto pos = std::lower_bound(array_.begin(), array_.end(), low);
+      if (pos != array_.end() && *pos == low)
+        return false;
+      array_.insert(pos, low);
+      ++size_;
+      normalize_();
+      return true;
+    }
+    bool erase(uint16_t low) {
+      if (is_bitmap()) {
+        uint64_t& word = bitmap_[low / 64];
+        const uint64_t bit = uint64_t(1) << (low % 64);
+        if ((word & bit) == 0)
+          return false;
+        word &= ~bit;
+        --size_;
+        normalize_();
+        return true;
+      }
+      const auto pos = std::lower_bound(array_.begin(), array_.end(), low);
+      if (pos == array_.end() || *pos != low)
+        return false;
+      array_.erase(pos);
+      --size_;
+      return true;
+    }
+    template <typename F>
+    void for_each(F& f) const {
+      const uint32_t high = static_cast<uint32_t>(key_) << 16;
+      if (!is_bitmap()) {
+        for (auto low : array_)
+          f(high | low);
+        return;
+      }
+      for (size_t word_idx = 0; word_idx < bitmap_num_words; ++word_idx) {
+        for (uint64_t bits = bitmap_[word_idx]; bits != 0; bits &= bits - 1)
+          f(high | static_cast<uint32_t>(word_idx * 64 + util::count_trailing_zeros(bits)));
+      }
+    }
+
+    // Set operations, the result is normalized
+    static container set_union(const container& left, const container& right) {
+      container ret(left.key_);
+      if (!left.is_bitmap() && !right.is_bitmap()) {
+        ret.array_.reserve(left.size_ + right.size_);
+        std::set_union(left.array_.begin(), left.array_.end(), right.array_.begin(), right.array_.end(), std::back_inserter(ret.array_));
+        ret.size_ = ret.array_.size();
+      }
+      else {
+        ret.bitmap_ = left.to_bitmap_();
+        right.or_into_(ret.bitmap_);
+        ret.size_ = count_bitmap_(ret.bitmap_);
+      }
+      ret.normalize_();
+      return ret;
+    }
+    static container set_intersection(const container& left, const container& right) {
+      container ret(left.key_);
+      if (left.is_bitmap() && right.is_bitmap()) {
+        ret.bitmap_.resize(bitmap_num_words);
+        for (size_t i = 0; i < bitmap_num_words; ++i)
+          ret.bitmap_[i] = left.bitmap_[i] & right.bitmap_[i];
+        ret.size_ = count_bitmap_(ret.bitmap_);
+      }
+      else if (!left.is_bitmap() && !right.is_bitmap()) {
+        std::set_intersection(left.array_.begin(), left.array_.end(), right.array_.begin(), right.array_.end(), std::back_inserter(ret.array_));
+        ret.size_ = ret.array_.size();
+      }
+      else {
+        const container& arr = left.is_bitmap() ? right : left;
+        const container& bmp = left.is_bitmap() ? left : right;
+        for (auto low : arr.array_)
+          if (bmp.contains(low))
+            ret.array_.push_back(low);
+        ret.size_ = ret.array_.size();
+      }
+      ret.normalize_();
+      return ret;
+    }
+    static container set_difference(const container& left, const container& right) {
+      container ret(left.key_);
+      if (!left.is_bitmap()) {
+        for (auto low : left.array_)
+          if (!right.contains(low))
+            ret.array_.push_back(low);
+        ret.size_ = ret.array_.size();
+      }
+      else {
+        ret.bitmap_ = left.bitmap_;
+        if (right.is_bitmap()) {
+          for (size_t i = 0; i < bitmap_num_words; ++i)
+            ret.bitmap_[i] &= ~right.bitmap_[i];
+        }
+        else {
+          for (auto low : right.array_)
+            ret.bitmap_[low / 64] &= ~(uint64_t(1) << (low % 64));
+        }
+        ret.size_ = count_bitmap_(ret.bitmap_);
+      }
+      ret.normalize_();
+      return ret;
+    }
+
+  private:
+    static size_t count_bitmap_(const std::vector<uint64_t>& bitmap) {
+      size_t count = 0;
+      for (auto word : bitmap)
+        count += util::popcount(word);
+      return count;
+    }
+    std::vector<uint64_t> to_bitmap_() const {
+      if (is_bitmap())
+        return bitmap_;
+      std::vector<uint64_t> bitmap(bitmap_num_words, 0);
+      or_into_(bitmap);
+      return bitmap;
+    }
+    void or_into_(std::vector<uint64_t>& bitmap) const {
+      if (is_bitmap()) {
+        for (size_t i = 0; i < bitmap_num_words; ++i)
+          bitmap[i] |= bitmap_[i];
+        return;
+      }
+      for (auto low : array_)
+        bitmap[low / 64] |= uint64_t(1) << (low % 64);
+    }
+    // Switches representation when the array grows beyond array_max_size or the bitmap shrinks to it
+    void normalize_() {
+      if (!is_bitmap() && size_ > array_max_size) {
+        bitmap_ = to_bitmap_();
+        array_ = std::vector<uint16_t>();
+      }
+      else if (is_bitmap() && size_ <= array_max_size) {
+        array_.clear();
+        array_.reserve(size_);
+        auto append = [this](uint32_t val) { array_.push_back(static_cast<uint16_t>(val)); };
+        for_each(append);
+        bitmap_ = std::vector<uint64_t>();
+      }
+    }
+
+    uint16_t key_;
+    size_t size_;
+    std::vector<uint16_t> array_;
+    std::vector<uint64_t> bitmap_; // Empty unless bitmap representation
+  };
+} // namespace _impl_compressed_set
+
+
+class compressed_set {
+  typedef _impl_compressed_set::container container;
+public:
+  typedef compressed_set my_type;
+  typedef uint32_t value_type;
+  typedef uint32_t key_type;
+  typedef size_t size_type;
+
+  class const_iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef uint32_t value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const uint32_t* pointer;
+    typedef uint32_t reference;
+
+    const_iterator() : containers_(nullptr), container_idx_(0), pos_(0), bits_(0) {}
+    const_iterator(const std::vector<container>* containers, size_t container_idx) : containers_(containers), container_idx_(container_idx), pos_(0), bits_(0) {
+      enter_container_();
+    }
+    uint32_t operator*() const {
+      const container& c = (*containers_)[container_idx_];
+      const uint32_t low = c.is_bitmap() ? static_cast<uint32_t>(pos_ * 64 + util::count_trailing_zeros(bits_)) : c.array()[pos_];
+      return (static_cast<uint32_t>(c.key()) << 16) | low;
+    }
+    const_iterator& operator++() {
+      const container& c = (*containers_)[container_idx_];
+      if (c.is_bitmap()) {
+        bits_ &= bits_ - 1;
+        while (bits_ == 0 && ++pos_ < _impl_compressed_set::bitmap_num_words)
+          bits_ = c.bitmap()[pos_];
+        if (bits_ != 0)
+          return *this;
+      }
+      else if (++pos_ < c.array().size())
+        return *this;
+      ++container_idx_;
+      enter_container_();
+      return *this;
+    }
+    const_iterator operator++(int) { const_iterator ret = *this; ++(*this); return ret; }
+    bool operator==(const const_iterator& other) const { return container_idx_ == other.container_idx_ && pos_ == other.pos_ && bits_ == other.bits_; }
+    bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+  private:
+    // Moves to the first value of the current container, containers are never empty
+    void enter_container_() {
+      pos_ = 0;
+      bits_ = 0;
+      if (container_idx_ >= containers_->size())
+        return;
+      const container& c = (*containers_)[container_idx_];
+      if (!c.is_bitmap())
+        return;
+      while ((bits_ = c.bitmap()[pos_]) == 0)
+        ++pos_;
+    }
+    const std::vector<container>* containers_;
+    size_t container_idx_;
+    size_t pos_; // Array index or bitmap word index
+    uint64_t bits_; // Remaining bits of the current bitmap word
+  };
+  typedef const_iterator iterator;
+
+  compressed_set() : size_(0) {}
+  template <typename IT>
+  compressed_set(IT start, IT stop) : size_(0) {
+    insert(start, stop);
+  }
+  compressed_set(std::initializer_list<uint32_t> values) : size_(0) {
+    insert(values.begin(), values.end());
+  }
+
+  // Comparison
+  bool operator==(const compressed_set& other) const { return size_ == other.size_ && containers_ == other.containers_; }
+  bool operator!=(const compressed_set& other) const { return !(*this == other); }
+
+  // Size
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  // Approximate number of bytes used by the values
+  size_t memory_usage() const {
+    size_t bytes = containers_.capacity() * sizeof(container);
+    for (const auto& c : containers_)
+      bytes += c.array().capacity() * sizeof(uint16_t) + c.bitmap().capacity() * sizeof(uint64_t);
+    return bytes;
+  }
+
+  // Modify collection
+  bool insert(uint32_t val) {
+    const uint16_t key = static_cast<uint16_t>(val >> 16);
+    auto pos = lower_bound_(key);
+    if (pos == containers_.end() || pos->key() != key)
+      pos = containers_.insert(pos, container(key));
+    if (!pos->insert(static_cast<uint16_t>(val)))
+      return false;
+    ++size_;
+    return true;
+  }
+  template <typename IT>
+  void insert(IT start, IT stop) {
+    for (; start != stop; ++start)
+      insert(*start);
+  }
+  size_t erase(uint32_t val) {
+    const uint16_t key = static_cast<uint16_t>(val >> 16);
+    const auto pos = lower_bound_(key);
+    if (pos == containers_.end() || pos->key() != key || !pos->erase(static_cast<uint16_t>(val)))
+      return 0;
+    if (pos->size() == 0)
+      containers_.erase(pos);
+    --size_;
+    return 1;
+  }
+  void clear() {
+    containers_.clear();
+    size_ = 0;
+  }
+
+  // Lookup
+  size_t count(uint32_t val) const {
+    const uint16_t key = static_cast<uint16_t>(val >> 16);
+    const auto pos = std::lower_bound(containers_.begin(), containers_.end(), key, [](const container& c, uint16_t k) { return c.key() < k; });
+    return pos != containers_.end() && pos->key() == key && pos->contains(static_cast<uint16_t>(val)) ? 1 : 0;
+  }
+  bool contains(uint32_t val) const { return count(val) != 0; }
+
+  // Iteration, ascending order
+  const_iterator begin() const { return const_iterator(&containers_, 0); }
+  const_iterator end() const { return const_iterator(&containers_, containers_.size()); }
+  template <typename F>
+  void for_each(F f) const {
+    for (const auto& c : containers_)
+      c.for_each(f);
+  }
+
+  // Set operations
+  friend compressed_set set_union(const compressed_set& left, const compressed_set& right) {
+    compressed_set ret;
+    auto l = left.containers_.begin(), l_end = left.containers_.end();
+    auto r = right.containers_.begin(), r_end = right.containers_.end();
+    while (l != l_end || r != r_end) {
+      if (r == r_end || (l != l_end && l->key() < r->key()))
+        ret.append_(*l++);
+      else if (l == l_end || r->key() < l->key())
+        ret.append_(*r++);
+      else
+        ret.append_(container::set_union(*l++, *r++));
+    }
+    return ret;
+  }
+  friend compressed_set set_intersection(const compressed_set& left, const compressed_set& right) {
+    compressed_set ret;
+    auto l = left.containers_.begin(), l_end = left.containers_.end();
+    auto r = right.containers_.begin(), r_end = right.containers_.end();
+    while (l != l_end && r != r_end) {
+      if (l->key() < r->key())
+        ++l;
+      else if (r->key() < l->key())
+        ++r;
+      else
+        ret.append_(container::set_intersection(*l++, *r++));
+    }
+    return ret;
+  }
+  friend compressed_set set_difference(const compressed_set& left, const compressed_set& right) {
+    compressed_set ret;
+    auto r = right.containers_.begin(), r_end = right.containers_.end();
+    for (const auto& c : left.containers_) {
+      while (r != r_end && r->key() < c.key())
+        ++r;
+      ret.append_(r != r_end && r->key() == c.key() ? container::set_difference(c, *r) : c);
+    }
+    return ret;
+  }
+
+private:
+  std::vector<container>::iterator lower_bound_(uint16_t key) {
+    return std::lower_bound(containers_.begin(), containers_.end(), key, [](const container& c, uint16_t k) { return c.key() < k; });
+  }
+  // Appends a container with a key larger than all current ones, empty containers are dropped
+  void append_(const container& c) {
+    if (c.size() == 0)
+      return;
+    containers_.push_back(c);
+    size_ += c.size();
+  }
+
+  std::vector<container> containers_; // Sorted by key, never empty
+  size_t size_;
+};
+
+
+} // namespace util
@@ -119,7 +119,7 @@ public:
   void swap(cow_vector& other) { ptr_.swap(other.ptr_); }
   void clear() { 
     if (unique()) 
-      raw_vector_().clear() 
+      raw_vector_().clear();
     else { // Avoid unnessesary copy before clearing
       const auto n = size();
       ptr_ = std::make_shared<vector_type>();
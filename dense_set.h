@@ -0,0 +1,243 @@
+//
+//  Dense Set
+//    Bitset based set of small non-negative integers, one bit per value of the universe [0, universe()).
+//    Set operations work on 64 bits at a time and iteration jumps between set bits using tzcnt.
+//    For sparse values in a large universe, use util::compressed_set (compressed_set.h) instead.
+//
+//   USAGE:
+//     util::dense_set<uint32_t> visited(num_nodes);
+//     visited.insert(node_id);
+//     if (visited.count(node_id)) { ... }
+//     for (auto id : visited) { ... }            // Ascending order
+//     visited |= other_visited;                  // Word-parallel union
+//     auto both = util::set_intersection(a, b);  // Word-parallel intersection
+//
+//  NOTES:
+//  - The universe grows automatically on insert, memory usage is universe() / 8 bytes regardless of size()
+//  - Values must be non-negative
+//
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+#include <initializer_list>
+#include "bit_count.h"
+
+namespace util {
+
+
+template <typename T = uint32_t>
+class dense_set {
+  static_assert(std::is_integral<T>::value, "dense_set only stores integral values");
+public:
+  typedef dense_set<T> my_type;
+  typedef T value_type;
+  typedef T key_type;
+  typedef size_t size_type;
+
+  class const_iterator {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const T* pointer;
+    typedef T reference;
+
+    const_iterator() : words_(nullptr), word_idx_(0), num_words_(0), bits_(0) {}
+    const_iterator(const uint64_t* words, size_t word_idx, size_t num_words) : words_(words), word_idx_(word_idx), num_words_(num_words), bits_(0) {
+      if (word_idx_ < num_words_)
+        bits_ = words_[word_idx_];
+      skip_empty_words_();
+    }
+    T operator*() const { return static_cast<T>(word_idx_ * 64 + util::count_trailing_zeros(bits_)); }
+    const_iterator& operator++() {
+      bits_ &= bits_ - 1;
+      skip_empty_words_();
+      return *this;
+    }
+    const_iterator operator++(int) { const_iterator ret = *this; ++(*this); return ret; }
+    bool operator==(const const_iterator& other) const { return word_idx_ == other.word_idx_ && bits_ == other.bits_; }
+    bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+  private:
+    void skip_empty_words_() {
+      while (bits_ == 0 && word_idx_ < num_words_) {
+        if (++word_idx_ < num_words_)
+          bits_ = words_[word_idx_];
+      }
+    }
+    const uint64_t* words_;
+    size_t word_idx_;
+    size_t num_words_;
+    uint64_t bits_;
+  };
+  typedef const_iterator iterator;
+
+  explicit dense_set(size_t universe = 0) : words_(num_words_for_(universe), 0), size_(0) {}
+  template <typename IT>
+  dense_set(IT start, IT stop, size_t universe = 0) : words_(num_words_for_(universe), 0), size_(0) {
+    insert(start, stop);
+  }
+  dense_set(std::initializer_list<T> values, size_t universe = 0) : words_(num_words_for_(universe), 0), size_(0) {
+    insert(values.begin(), values.end());
+  }
+
+  // Comparison, independent of universe
+  bool operator==(const dense_set& other) const {
+    if (size_ != other.size_)
+      return false;
+    const size_t num_common = std::min(words_.size(), other.words_.size());
+    return std::equal(words_.begin(), words_.begin() + num_common, other.words_.begin());
+  }
+  bool operator!=(const dense_set& other) const { return !(*this == other); }
+
+  // Size
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  size_t universe() const { return words_.size() * 64; }
+  void reserve(size_t universe) {
+    if (num_words_for_(universe) > words_.size())
+      words_.resize(num_words_for_(universe), 0);
+  }
+  // Shrinks the universe to the largest value
+  void shrink_to_fit() {
+    while (!words_.empty() && words_.back() == 0)
+      words_.pop_back();
+    words_.shrink_to_fit();
+  }
+
+  // Modify collection
+  bool insert(T val) {
+    const size_t idx = index_(val);
+    if (idx / 64 >= words_.size())
+      words_.resize(std::max(idx / 64 + 1, words_.size() * 2), 0);
+    uint64_t& word = words_[idx / 64];
+    const uint64_t bit = uint64_t(1) << (idx % 64);
+    if ((word & bit) != 0)
+      return false;
+    word |= bit;
+    ++size_;
+    return true;
+  }
+  template <typename IT>
+  void insert(IT start, IT stop) {
+    for (; start != stop; ++start)
+      insert(*start);
+  }
+  size_t erase(T val) {
+    const size_t idx = index_(val);
+    if (idx / 64 >= words_.size())
+      return 0;
+    uint64_t& word = words_[idx / 64];
+    const uint64_t bit = uint64_t(1) << (idx % 64);
+    if ((word & bit) == 0)
+      return 0;
+    word &= ~bit;
+    --size_;
+    return 1;
+  }
+  void clear() {
+    std::fill(words_.begin(), words_.end(), 0);
+    size_ = 0;
+  }
+
+  // Lookup
+  size_t count(T val) const {
+    const size_t idx = index_(val);
+    return idx / 64 < words_.size() ? static_cast<size_t>((words_[idx / 64] >> (idx % 64)) & 1) : 0;
+  }
+  bool contains(T val) const { return count(val) != 0; }
+
+  // Iteration, ascending order
+  const_iterator begin() const { return const_iterator(words_.data(), 0, words_.size()); }
+  const_iterator end() const { return const_iterator(words_.data(), words_.size(), words_.size()); }
+  // Calls f(value) for all values in ascending order, faster than iterators as the word loop is kept tight
+  template <typename F>
+  void for_each(F f) const {
+    for (size_t word_idx = 0, num_words = words_.size(); word_idx < num_words; ++word_idx) {
+      for (uint64_t bits = words_[word_idx]; bits != 0; bits &= bits - 1)
+        f(static_cast<T>(word_idx * 64 + util::count_trailing_zeros(bits)));
+    }
+  }
+  const std::vector<uint64_t>& words() const { return words_; }
+
+  // Set operations, in place
+  dense_set& operator|=(const dense_set& other) {
+    if (other.words_.size() > words_.size())
+      words_.resize(other.words_.size(), 0);
+    size_t new_size = 0;
+    for (size_t i = 0, i_end = other.words_.size(); i < i_end; ++i) {
+      words_[i] |= other.words_[i];
+      new_size += util::popcount(words_[i]);
+    }
+    size_ = new_size + count_range_(other.words_.size(), words_.size());
+    return *this;
+  }
+  dense_set& operator&=(const dense_set& other) {
+    const size_t num_common = std::min(words_.size(), other.words_.size());
+    size_t new_size = 0;
+    for (size_t i = 0; i < num_common; ++i) {
+      words_[i] &= other.words_[i];
+      new_size += util::popcount(words_[i]);
+    }
+    std::fill(words_.begin() + num_common, words_.end(), 0);
+    size_ = new_size;
+    return *this;
+  }
+  dense_set& operator-=(const dense_set& other) {
+    const size_t num_common = std::min(words_.size(), other.words_.size());
+    size_t new_size = 0;
+    for (size_t i = 0; i < num_common; ++i) {
+      words_[i] &= ~other.words_[i];
+      new_size += util::popcount(words_[i]);
+    }
+    size_ = new_size + count_range_(num_common, words_.size());
+    return *this;
+  }
+
+private:
+  static size_t num_words_for_(size_t universe) { return (universe + 63) / 64; }
+  static size_t index_(T val) {
+    DASSERT(val >= T(0));
+    return static_cast<size_t>(val);
+  }
+  size_t count_range_(size_t word_start, size_t word_stop) const {
+    size_t count = 0;
+    for (size_t i = word_start; i < word_stop; ++i)
+      count += util::popcount(words_[i]);
+    return count;
+  }
+
+  std::vector<uint64_t> words_;
+  size_t size_;
+};
+
+
+// Set operations
+template <typename T>
+dense_set<T> set_union(const dense_set<T>& left, const dense_set<T>& right) {
+  dense_set<T> ret(left);
+  ret |= right;
+  return ret;
+}
+
+template <typename T>
+dense_set<T> set_intersection(const dense_set<T>& left, const dense_set<T>& right) {
+  dense_set<T> ret(left.size() <= right.size() ? left : right);
+  ret &= left.size() <= right.size() ? right : left;
+  return ret;
+}
+
+template <typename T>
+dense_set<T> set_difference(const dense_set<T>& left, const dense_set<T>& right) {
+  dense_set<T> ret(left);
+  ret -= right;
+  return ret;
+}
+
+
+} // namespace util
@@ -0,0 +1,79 @@
+//
+//  First Touch
+//    Places the pages of large buffers on the NUMA nodes of the threads that will process them.
+//    Operating systems commit a page on the node of the thread that first writes to it, hence a buffer
+//    filled by a single thread ends up on a single node and every later pfor pass reads it remotely.
+//    These functions touch\initialize the buffer in parallel, chunked exactly like pfor over the same range.
+//
+//   USAGE:
+//     auto samples = util::parallel_uninitialized_vector<float>(num_samples);
+//     pfor(size_t i, 0, samples.size()) { // Thread i processes the pages it touched
+//       samples[i] = compute(i);
+//     };
+//
+//     auto volume = marray3f();
+//     volume.allocate_first_touch(1024, 1024, 1024); // Chunked along z, use pfor(size_t z, 0, volume.depth())
+//
+//  NOTES:
+//  - Only effective for memory which is untouched when handed over, ie allocated by default_init_vector,
+//    huge_page_allocator or other allocations large enough to be served directly by mmap\VirtualAlloc
+//  - Thread to core affinity is up to the OS, pin threads to get guaranteed placement
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include "parallel_for.h"
+#include "uninitialized_vector.h"
+
+#ifndef FIRST_TOUCH_PAGE_SIZE
+#  define FIRST_TOUCH_PAGE_SIZE 4096
+#endif
+
+namespace util {
+
+
+// Writes one byte per page of the elements in [0, n), leaves the values indeterminate
+template <typename T>
+void first_touch(T* data, size_t n, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  static_assert(std::is_trivial<T>::value, "first_touch would leave non-trivial objects in an invalid state, use parallel_fill instead");
+  auto bytes = reinterpret_cast<volatile uint8_t*>(data);
+  partitioner.for_each_chunk(size_t(0), n, [bytes](size_t start, size_t stop) {
+    const size_t byte_start = start * sizeof(T);
+    const size_t byte_stop = stop * sizeof(T);
+    for (size_t i = byte_start; i < byte_stop; i += FIRST_TOUCH_PAGE_SIZE)
+      bytes[i] = 0;
+  });
+}
+
+// Assigns val to the elements in [0, n) in parallel
+template <typename T>
+void parallel_fill(T* data, size_t n, const T& val, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  partitioner.for_each_chunk(size_t(0), n, [data, &val](size_t start, size_t stop) {
+    std::fill(data + start, data + stop, val);
+  });
+}
+
+// Vector of n indeterminate values whose pages has been touched by the threads processing them in pfor(i, 0, n)
+template <typename T, typename A = std::allocator<T> >
+default_init_vector<T, A>
+parallel_uninitialized_vector(size_t n, const pfor_partitioner& partitioner = pfor_partitioner(), const A& allocator = A()) {
+  auto ret = uninitialized_vector<T, A>(n, allocator);
+  if (n > 0)
+    first_touch(ret.data(), n, partitioner);
+  return ret;
+}
+
+// Vector of n copies of val, initialized in parallel
+template <typename T, typename A = std::allocator<T> >
+default_init_vector<T, A>
+parallel_initialized_vector(size_t n, const T& val = T(), const pfor_partitioner& partitioner = pfor_partitioner(), const A& allocator = A()) {
+  auto ret = uninitialized_vector<T, A>(n, allocator);
+  if (n > 0)
+    parallel_fill(ret.data(), n, val, partitioner);
+  return ret;
+}
+
+
+} // namespace util
@@ -1,100 +1,206 @@
 #pragma once
 
-#include <array>
+#include <cstring>
+#include <iterator>
 #include <algorithm>
+#include <type_traits>
+#include <utility>
+
+// Constructors of fixed_vectors holding trivial types are constexpr when the compiler allows uninitialized members in constant expressions (C++20)
+#if defined(__cpp_constexpr) && __cpp_constexpr >= 201907L
+#  define FIXED_VECTOR_CONSTEXPR constexpr
+#else
+#  define FIXED_VECTOR_CONSTEXPR
+#endif
 
 namespace util {
 
 
+namespace _impl_fixed_vector {
+  // Trivial types are stored as a plain array, which keeps fixed_vector a literal type
+  template <typename T, size_t MAX_ELEMENTS, bool IS_TRIVIAL = std::is_trivial<T>::value>
+  struct storage {
+    FIXED_VECTOR_CONSTEXPR storage() : size_(0) {}
+    constexpr T* ptr() { return elements_; }
+    constexpr const T* ptr() const { return elements_; }
+    T elements_[MAX_ELEMENTS];
+    size_t size_;
+  };
+  // Non-trivial types are stored in raw storage and constructed on demand
+  template <typename T, size_t MAX_ELEMENTS>
+  struct storage<T, MAX_ELEMENTS, false> {
+    storage() : size_(0) {}
+    ~storage() {
+      for (size_t i = 0; i < size_; ++i)
+        ptr()[i].~T();
+    }
+    T* ptr() { return reinterpret_cast<T*>(&bytes_[0]); }
+    const T* ptr() const { return reinterpret_cast<const T*>(&bytes_[0]); }
+    alignas(T) unsigned char bytes_[MAX_ELEMENTS * sizeof(T)];
+    size_t size_;
+  };
+} // namespace _impl_fixed_vector
+
+
 template <typename T, size_t MAX_ELEMENTS>
-class fixed_vector {
+class fixed_vector : private _impl_fixed_vector::storage<T, MAX_ELEMENTS> {
+  typedef _impl_fixed_vector::storage<T, MAX_ELEMENTS> storage_type;
+  using storage_type::size_;
+  using storage_type::ptr;
 public:
   typedef fixed_vector<T, MAX_ELEMENTS> my_type;
-  typedef std::array<T, MAX_ELEMENTS> array_type;
-
-  typedef typename array_type::pointer pointer;
-  typedef typename array_type::const_pointer const_pointer;
-  typedef typename array_type::difference_type difference_type;
-  typedef typename array_type::size_type size_type;
-  typedef typename array_type::reference reference;
-  typedef typename array_type::const_reference const_reference;
-  typedef typename array_type::value_type value_type;
-  typedef typename array_type::iterator iterator;
-  typedef typename array_type::const_iterator const_iterator;
-  typedef typename array_type::reverse_iterator reverse_iterator;
-  typedef typename array_type::const_reverse_iterator const_reverse_iterator;
-
-  fixed_vector( size_t size = 0) : size_(size) {}
-  fixed_vector( size_t size, const value_type& val) : size_(size) { std::fill(begin(), end(), val); }
-  fixed_vector( const fixed_vector& other) { 
-    std::copy(other.begin(), other.end(), begin());
-    size_ = other.size_;
+
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef ptrdiff_t difference_type;
+  typedef size_t size_type;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef T value_type;
+  typedef T* iterator;
+  typedef const T* const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  FIXED_VECTOR_CONSTEXPR fixed_vector() {}
+  explicit fixed_vector( size_t size) { resize(size); }
+  fixed_vector( size_t size, const value_type& val) { resize(size, val); }
+  fixed_vector( const fixed_vector& other) {
+    copy_construct_(other.begin(), other.size_);
+  }
+  fixed_vector( fixed_vector&& other) {
+    for (auto it = other.begin(); it != other.end(); ++it)
+      emplace_back(std::move(*it));
   }
   fixed_vector& operator=(const fixed_vector& other) {
-    std::copy(other.begin(), other.end(), begin());
+    if (this == &other)
+      return *this;
+    if (std::is_trivially_copyable<value_type>::value) {
+      copy_construct_(other.begin(), other.size_);
+      return *this;
+    }
+    const size_t num_assigned = std::min(size_, other.size_);
+    std::copy(other.begin(), other.begin() + num_assigned, begin());
+    for (size_t i = num_assigned; i < other.size_; ++i)
+      emplace_back(other[i]);
+    destroy_(begin() + other.size_, end());
+    size_ = other.size_;
+    return *this;
+  }
+  fixed_vector& operator=(fixed_vector&& other) {
+    const size_t num_assigned = std::min(size_, other.size_);
+    std::move(other.begin(), other.begin() + num_assigned, begin());
+    for (size_t i = num_assigned; i < other.size_; ++i)
+      emplace_back(std::move(other[i]));
+    destroy_(begin() + other.size_, end());
     size_ = other.size_;
     return *this;
   }
-  bool empty() const { return size_ == 0; }
-  size_t size() const { return size_; }
+  constexpr bool empty() const { return size_ == 0; }
+  constexpr size_t size() const { return size_; }
+  static constexpr size_t capacity() { return MAX_ELEMENTS; }
+  static constexpr size_t max_size() { return MAX_ELEMENTS; }
 
   // Modify range
-  void erase(iterator it) {
-    DASSERT(std::distance(begin(), it) <= size_);
-    std::copy(it+1, end(), it);
-    --size_;
+  iterator erase(const_iterator it) {
+    DASSERT(it >= begin() && it < end());
+    return erase(it, it + 1);
+  }
+  iterator erase(const_iterator start, const_iterator stop) {
+    DASSERT(start >= begin() && start <= stop && stop <= end());
+    const iterator first = begin() + (start - cbegin());
+    const iterator last = begin() + (stop - cbegin());
+    const iterator new_end = std::move(last, end(), first);
+    destroy_(new_end, end());
+    size_ -= static_cast<size_t>(last - first);
+    return first;
   }
-  void erase(iterator start, iterator stop) {
-    DASSERT(std::distance(begin(), stop) <= size_);
-    std::copy(stop, end(), start);
-    size_ -= std::distance(start, stop);
+  constexpr void push_back(const value_type& val) { emplace_back(val); }
+  constexpr void push_back(value_type&& val) { emplace_back(std::move(val)); }
+  template <typename... Args>
+  constexpr reference emplace_back(Args&&... args) {
+    DASSERT(size_ < MAX_ELEMENTS);
+    construct_(std::integral_constant<bool, std::is_trivial<value_type>::value>(), ptr() + size_, std::forward<Args>(args)...);
+    return ptr()[size_++];
   }
-  void push_back(const value_type& val) {
-    DASSERT(size_ <= MAX_ELEMENTS);
-    data_[size_] = val;
-    ++size_;
+  void pop_back() {
+    DASSERT(!empty());
+    --size_;
+    ptr()[size_].~value_type();
   }
-  void emplace_back(value_type&& val) {
-    DASSERT(size_ <= MAX_ELEMENTS);
-    std::move(val, data_[size_]);
-    ++size_;
+  void clear() {
+    destroy_(begin(), end());
+    size_ = 0;
   }
-  void pop_back() { DASSERT(!empty()); --size_; }
-  void clear() { size_ = 0; }
-  
+
   void reserve(size_t n) { DASSERT(n <= MAX_ELEMENTS); } // Doesn't actually do anything, only here for syntax-compatiblity with std::vector
-  void resize(size_t n, const value_type& val = value_type()){
+  void resize(size_t n) {
+    DASSERT(n <= MAX_ELEMENTS);
+    while (size_ < n)
+      emplace_back();
+    destroy_(begin() + n, end());
+    size_ = std::min(size_, n);
+  }
+  void resize(size_t n, const value_type& val) {
     DASSERT(n <= MAX_ELEMENTS);
-    const auto new_end = begin() + n;
-    if ( new_end > end() )
-      std::fill(end(), new_end, val);
-    size_ = n;
+    while (size_ < n)
+      emplace_back(val);
+    destroy_(begin() + n, end());
+    size_ = std::min(size_, n);
   }
 
   // Access by iterator
-  iterator begin() { return data_.begin(); }
-  const_iterator begin() const { return data_.begin(); }
-  iterator end() { return data_.begin() + size_; }
-  const_iterator end() const { return data_.begin() + size_; }
-  reverse_iterator rend() { return data_.rend(); }
-  const_reverse_iterator rend() const { return data_.rend(); }
-  reverse_iterator rbegin() { return rend() - size_; }
-  const_reverse_iterator rbegin() const { return rend() - size_; }
+  constexpr iterator begin() { return ptr(); }
+  constexpr const_iterator begin() const { return ptr(); }
+  constexpr iterator end() { return ptr() + size_; }
+  constexpr const_iterator end() const { return ptr() + size_; }
+  constexpr const_iterator cbegin() const { return ptr(); }
+  constexpr const_iterator cend() const { return ptr() + size_; }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
 
   // Element access
-  value_type& operator[](size_t idx) { DASSERT(idx < size_); return data_[idx]; }
-  const value_type& operator[](size_t idx) const { DASSERT(idx < size_); return data_[idx]; }
-  value_type& at(size_t idx) { DASSERT(idx < size_); return data_.at(idx); }
-  const value_type& at(size_t idx) const { DASSERT(idx < size_); return data_.at(idx); }
-  value_type& front() { DASSERT(!empty()); return data_.front(); }
-  const value_type& front() const { DASSERT(!empty()); return data_.front(); }
-  value_type& back() { DASSERT(!empty()) ;return *rbegin(); }
-  const value_type& back() const { DASSERT(!empty()); return *rbegin(); }
+  constexpr value_type& operator[](size_t idx) { DASSERT(idx < size_); return ptr()[idx]; }
+  constexpr const value_type& operator[](size_t idx) const { DASSERT(idx < size_); return ptr()[idx]; }
+  constexpr value_type& at(size_t idx) { DASSERT(idx < size_); return ptr()[idx]; }
+  constexpr const value_type& at(size_t idx) const { DASSERT(idx < size_); return ptr()[idx]; }
+  constexpr value_type& front() { DASSERT(!empty()); return ptr()[0]; }
+  constexpr const value_type& front() const { DASSERT(!empty()); return ptr()[0]; }
+  constexpr value_type& back() { DASSERT(!empty()); return ptr()[size_ - 1]; }
+  constexpr const value_type& back() const { DASSERT(!empty()); return ptr()[size_ - 1]; }
+  constexpr T* data() { return ptr(); }
+  constexpr const T* data() const { return ptr(); }
 
 private:
-  array_type data_;
-  size_t size_;
+  // Expects all current elements to be trivially destructible or this to be empty
+  void copy_construct_(const T* src, size_t n) {
+    if (std::is_trivially_copyable<value_type>::value) {
+      if (n > 0)
+        memcpy((void*) ptr(), (const void*) src, n * sizeof(value_type));
+      size_ = n;
+      return;
+    }
+    for (size_t i = 0; i < n; ++i)
+      emplace_back(src[i]);
+  }
+  // Trivial types are assigned, as placement-new is not allowed in constant expressions
+  template <typename... Args>
+  static constexpr void construct_(std::true_type, T* dst, Args&&... args) {
+    *dst = value_type(std::forward<Args>(args)...);
+  }
+  template <typename... Args>
+  static void construct_(std::false_type, T* dst, Args&&... args) {
+    ::new (static_cast<void*>(dst)) value_type(std::forward<Args>(args)...);
+  }
+  void destroy_(iterator start, iterator stop) {
+    if (std::is_trivially_destructible<value_type>::value)
+      return;
+    for (; start < stop; ++start)
+      start->~value_type();
+  }
 };
 
 
-} // namespace util
+} // namespace util
\ No newline at end of file
@@ -0,0 +1,95 @@
+//
+//  Flat Map
+//    Sorted vector based map with amortized batched insertion, see flat_set.h for details.
+//
+//   USAGE:
+//     util::flat_map<uint32_t, float> weights;
+//     weights.insert(pairs.begin(), pairs.end()); // One sort + merge
+//     weights[42] += 1.0f;                         // Appended to the unsorted tail if missing
+//     for (const auto& kvp : weights) { ... }      // Sorted by key
+//
+//  NOTES:
+//  - Elements are stored as std::pair<K, V>, ie the key is mutable through iterators, don't modify it
+//  - insert(...) never overwrites the value of an existing key, as std::map
+//  - References returned by operator[] are invalidated by the next insertion or erase
+//
+#pragma once
+
+#include "flat_set.h"
+#include <stdexcept>
+
+namespace util {
+
+
+template <typename K, typename V, typename C = std::less<K>, typename A = std::allocator<std::pair<K, V> > >
+class flat_map : public _impl_flat_set::flat_tree<std::pair<K, V>, K, _impl_flat_set::select_first, C, A> {
+  typedef _impl_flat_set::flat_tree<std::pair<K, V>, K, _impl_flat_set::select_first, C, A> base_type;
+public:
+  typedef flat_map<K, V, C, A> my_type;
+  typedef K key_type;
+  typedef V mapped_type;
+  typedef std::pair<K, V> value_type;
+  typedef value_type& reference;
+  typedef const value_type& const_reference;
+  typedef value_type* iterator;
+  typedef const value_type* const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  flat_map(const C& compare = C(), const A& allocator = A()) : base_type(compare, allocator) {}
+  template <typename IT>
+  flat_map(IT start, IT stop, const C& compare = C(), const A& allocator = A()) : base_type(compare, allocator) {
+    insert(start, stop);
+  }
+  flat_map(std::initializer_list<value_type> values, const C& compare = C(), const A& allocator = A()) : base_type(compare, allocator) {
+    insert(values.begin(), values.end());
+  }
+
+  // Comparison
+  bool operator==(const flat_map& other) const { return this->sorted_data() == other.sorted_data(); }
+  bool operator!=(const flat_map& other) const { return !(*this == other); }
+
+  // Modify collection
+  bool insert(const value_type& val) { return this->insert_(val); }
+  bool insert(value_type&& val) { return this->insert_(std::move(val)); }
+  template <typename IT>
+  void insert(IT start, IT stop) { this->insert_range_(start, stop); }
+  size_t erase(const K& key) { return this->erase_(key); }
+
+  // Element access
+  mapped_type& operator[](const K& key) {
+    size_t idx = this->position_(key);
+    if (idx == base_type::npos_) {
+      this->insert_(value_type(key, mapped_type()));
+      idx = this->position_(key);
+    }
+    return this->data_[idx].second;
+  }
+  mapped_type& at(const K& key) {
+    const size_t idx = this->position_(key);
+    if (idx == base_type::npos_)
+      throw std::out_of_range("flat_map::at");
+    return this->data_[idx].second;
+  }
+  const mapped_type& at(const K& key) const {
+    const size_t idx = this->position_(key);
+    if (idx == base_type::npos_)
+      throw std::out_of_range("flat_map::at");
+    return this->data_[idx].second;
+  }
+
+  // Sorted access, normalizes the map
+  iterator find(const K& key) { return this->find_(key); }
+  const_iterator find(const K& key) const { return this->find_(key); }
+  iterator begin() { this->normalize(); return this->data_begin_(); }
+  const_iterator begin() const { this->normalize(); return this->data_begin_(); }
+  iterator end() { this->normalize(); return this->data_end_(); }
+  const_iterator end() const { this->normalize(); return this->data_end_(); }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+};
+
+
+} // namespace util
@@ -0,0 +1,289 @@
+//
+//  Flat Set
+//    Sorted vector based set with amortized batched insertion.
+//    New elements are buffered in an unsorted tail, which is merged into the sorted range using one sort and one
+//    merge when it grows beyond max(FLAT_SET_MIN_TAIL_SIZE, sqrt(size)) elements. Erased elements of the sorted
+//    range are tombstoned and compacted away automatically.
+//
+//   USAGE:
+//     util::flat_set<uint32_t> ids;
+//     ids.insert(ids_from_somewhere.begin(), ids_from_somewhere.end()); // One sort + merge
+//     ids.insert(42);                                                   // Appended to the tail
+//     if (ids.count(42)) { ... }                                        // Binary search + scan of the tail
+//     for (auto id : ids) { ... }                                       // Sorted order
+//     auto both = util::set_intersection(ids, other_ids);              // Linear merge
+//
+//  NOTES:
+//  - insert(value) returns whether the value was inserted, not an iterator, as the tail is unsorted
+//  - Iteration, find(), lower_bound() etc. normalize the set first (merges the tail, drops tombstones),
+//    this is done lazily in const functions as well, hence const functions are not thread safe unless
+//    normalize() has been called after the last modification
+//  - Iterators and references are invalidated by any insertion or erase
+//
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <initializer_list>
+
+#ifndef FLAT_SET_MIN_TAIL_SIZE // Lower limit for the amount of unsorted elements kept before merging
+#  define FLAT_SET_MIN_TAIL_SIZE 32
+#endif
+
+namespace util {
+
+
+namespace _impl_flat_set {
+  struct identity {
+    template <typename T>
+    const T& operator()(const T& val) const { return val; }
+  };
+  struct select_first {
+    template <typename P>
+    const typename P::first_type& operator()(const P& val) const { return val.first; }
+  };
+
+  // Shared implementation of flat_set and flat_map
+  template <typename Value, typename Key, typename KeyOfValue, typename Compare, typename A>
+  class flat_tree {
+  public:
+    typedef flat_tree<Value, Key, KeyOfValue, Compare, A> my_type;
+    typedef std::vector<Value, A> container_type;
+    typedef Value value_type;
+    typedef Key key_type;
+    typedef Compare key_compare;
+    typedef A allocator_type;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    flat_tree(const Compare& compare = Compare(), const A& allocator = A()) : data_(allocator), sorted_size_(0), num_erased_(0), compare_(compare) {}
+
+    // Size
+    bool empty() const { return size() == 0; }
+    size_t size() const { return data_.size() - num_erased_; }
+    size_t capacity() const { return data_.capacity(); }
+    void reserve(size_t n) { data_.reserve(n); }
+    void clear() {
+      data_.clear();
+      erased_.clear();
+      sorted_size_ = 0;
+      num_erased_ = 0;
+    }
+    void shrink_to_fit() {
+      normalize();
+      data_.shrink_to_fit();
+    }
+
+    // Lookup without normalization
+    size_t count(const Key& key) const { return position_(key) == npos_ ? 0 : 1; }
+    bool contains(const Key& key) const { return position_(key) != npos_; }
+
+    // Merges the tail and drops tombstones, makes the elements available in sorted order
+    void normalize() const {
+      if (sorted_size_ != data_.size() || num_erased_ != 0)
+        merge_();
+    }
+    // Sorted elements, valid until the next modification
+    const container_type& sorted_data() const {
+      normalize();
+      return data_;
+    }
+
+    key_compare key_comp() const { return compare_; }
+    allocator_type get_allocator() const { return data_.get_allocator(); }
+
+    // Takes a range which is already sorted and unique, without sorting
+    void assign_sorted_unique(container_type&& sorted_unique) {
+      data_ = std::move(sorted_unique);
+      erased_.clear();
+      sorted_size_ = data_.size();
+      num_erased_ = 0;
+    }
+
+  protected:
+    static const size_t npos_ = size_t(-1);
+    bool less_(const Key& left, const Key& right) const { return compare_(left, right); }
+    bool equal_(const Key& left, const Key& right) const { return !compare_(left, right) && !compare_(right, left); }
+    const Key& key_(const Value& val) const { return KeyOfValue()(val); }
+
+    size_t position_(const Key& key) const {
+      const auto sorted_end = data_.begin() + sorted_size_;
+      const auto pos = std::lower_bound(data_.begin(), sorted_end, key, [this](const Value& val, const Key& k) { return less_(key_(val), k); });
+      if (pos != sorted_end && !less_(key, key_(*pos))) {
+        const size_t idx = static_cast<size_t>(pos - data_.begin());
+        if (num_erased_ == 0 || !erased_[idx])
+          return idx;
+      }
+      for (size_t i = sorted_size_, i_end = data_.size(); i < i_end; ++i)
+        if (equal_(key_(data_[i]), key))
+          return i;
+      return npos_;
+    }
+    template <typename V>
+    bool insert_(V&& val) {
+      if (contains(key_(val)))
+        return false;
+      data_.push_back(std::forward<V>(val));
+      if (data_.size() - sorted_size_ > max_tail_size_())
+        merge_();
+      return true;
+    }
+    template <typename IT>
+    void insert_range_(IT start, IT stop) {
+      data_.insert(data_.end(), start, stop);
+      merge_();
+    }
+    size_t erase_(const Key& key) {
+      const size_t idx = position_(key);
+      if (idx == npos_)
+        return 0;
+      if (idx >= sorted_size_) {
+        std::swap(data_[idx], data_.back());
+        data_.pop_back();
+        return 1;
+      }
+      if (erased_.empty())
+        erased_.assign(sorted_size_, 0);
+      erased_[idx] = 1;
+      ++num_erased_;
+      if (num_erased_ * 4 > sorted_size_)
+        compact_();
+      return 1;
+    }
+    Value* find_(const Key& key) const {
+      normalize();
+      const auto pos = std::lower_bound(data_.begin(), data_.end(), key, [this](const Value& val, const Key& k) { return less_(key_(val), k); });
+      return pos != data_.end() && !less_(key, key_(*pos)) ? &*pos : data_end_();
+    }
+    Value* data_begin_() const { return data_.data(); }
+    Value* data_end_() const { return data_.data() + data_.size(); }
+
+    mutable container_type data_;
+
+  private:
+    size_t max_tail_size_() const { return std::max<size_t>(FLAT_SET_MIN_TAIL_SIZE, static_cast<size_t>(std::sqrt(static_cast<double>(sorted_size_)))); }
+    // Removes the tombstoned elements of the sorted range
+    void compact_() const {
+      if (num_erased_ == 0)
+        return;
+      size_t dst = 0;
+      for (size_t src = 0; src < sorted_size_; ++src) {
+        if (erased_[src])
+          continue;
+        if (dst != src)
+          data_[dst] = std::move(data_[src]);
+        ++dst;
+      }
+      const size_t new_sorted_size = dst;
+      for (size_t src = sorted_size_, src_end = data_.size(); src < src_end; ++src)
+        data_[dst++] = std::move(data_[src]);
+      data_.erase(data_.begin() + dst, data_.end());
+      sorted_size_ = new_sorted_size;
+      erased_.clear();
+      num_erased_ = 0;
+    }
+    // Sorts the tail and merges it into the sorted range, earlier inserted elements wins over later equal ones
+    void merge_() const {
+      compact_();
+      auto key_less = [this](const Value& left, const Value& right) { return less_(key_(left), key_(right)); };
+      auto key_equal = [this](const Value& left, const Value& right) { return equal_(key_(left), key_(right)); };
+      const auto middle = data_.begin() + sorted_size_;
+      std::stable_sort(middle, data_.end(), key_less);
+      std::inplace_merge(data_.begin(), middle, data_.end(), key_less);
+      data_.erase(std::unique(data_.begin(), data_.end(), key_equal), data_.end());
+      sorted_size_ = data_.size();
+    }
+
+    mutable std::vector<uint8_t> erased_; // Tombstones of the sorted range, empty if none
+    mutable size_t sorted_size_;
+    mutable size_t num_erased_;
+    Compare compare_;
+  };
+} // namespace _impl_flat_set
+
+
+template <typename T, typename C = std::less<T>, typename A = std::allocator<T> >
+class flat_set : public _impl_flat_set::flat_tree<T, T, _impl_flat_set::identity, C, A> {
+  typedef _impl_flat_set::flat_tree<T, T, _impl_flat_set::identity, C, A> base_type;
+public:
+  typedef flat_set<T, C, A> my_type;
+  typedef C value_compare;
+  typedef const T& reference;
+  typedef const T& const_reference;
+  typedef const T* iterator;
+  typedef const T* const_iterator;
+  typedef std::reverse_iterator<const_iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  flat_set(const C& compare = C(), const A& allocator = A()) : base_type(compare, allocator) {}
+  template <typename IT>
+  flat_set(IT start, IT stop, const C& compare = C(), const A& allocator = A()) : base_type(compare, allocator) {
+    insert(start, stop);
+  }
+  flat_set(std::initializer_list<T> values, const C& compare = C(), const A& allocator = A()) : base_type(compare, allocator) {
+    insert(values.begin(), values.end());
+  }
+
+  // Comparison
+  bool operator==(const flat_set& other) const { return this->sorted_data() == other.sorted_data(); }
+  bool operator!=(const flat_set& other) const { return !(*this == other); }
+  bool operator<(const flat_set& other) const { return this->sorted_data() < other.sorted_data(); }
+
+  // Modify collection
+  bool insert(const T& val) { return this->insert_(val); }
+  bool insert(T&& val) { return this->insert_(std::move(val)); }
+  template <typename IT>
+  void insert(IT start, IT stop) { this->insert_range_(start, stop); }
+  size_t erase(const T& val) { return this->erase_(val); }
+
+  // Sorted access, normalizes the set
+  const_iterator find(const T& val) const { return this->find_(val); }
+  const_iterator lower_bound(const T& val) const { this->normalize(); return std::lower_bound(begin(), end(), val, this->key_comp()); }
+  const_iterator upper_bound(const T& val) const { this->normalize(); return std::upper_bound(begin(), end(), val, this->key_comp()); }
+  const_iterator begin() const { this->normalize(); return this->data_begin_(); }
+  const_iterator end() const { this->normalize(); return this->data_end_(); }
+  const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+  const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+  const T& front() const { DASSERT(!this->empty()); return *begin(); }
+  const T& back() const { DASSERT(!this->empty()); return *std::prev(end()); }
+};
+
+
+// Set operations, linear merges of the sorted ranges
+template <typename T, typename C, typename A>
+flat_set<T, C, A> set_union(const flat_set<T, C, A>& left, const flat_set<T, C, A>& right) {
+  typename flat_set<T, C, A>::container_type merged;
+  merged.reserve(left.size() + right.size());
+  std::set_union(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(merged), left.key_comp());
+  flat_set<T, C, A> ret(left.key_comp(), left.get_allocator());
+  ret.assign_sorted_unique(std::move(merged));
+  return ret;
+}
+
+template <typename T, typename C, typename A>
+flat_set<T, C, A> set_intersection(const flat_set<T, C, A>& left, const flat_set<T, C, A>& right) {
+  typename flat_set<T, C, A>::container_type merged;
+  merged.reserve(std::min(left.size(), right.size()));
+  std::set_intersection(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(merged), left.key_comp());
+  flat_set<T, C, A> ret(left.key_comp(), left.get_allocator());
+  ret.assign_sorted_unique(std::move(merged));
+  return ret;
+}
+
+template <typename T, typename C, typename A>
+flat_set<T, C, A> set_difference(const flat_set<T, C, A>& left, const flat_set<T, C, A>& right) {
+  typename flat_set<T, C, A>::container_type merged;
+  merged.reserve(left.size());
+  std::set_difference(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(merged), left.key_comp());
+  flat_set<T, C, A> ret(left.key_comp(), left.get_allocator());
+  ret.assign_sorted_unique(std::move(merged));
+  return ret;
+}
+
+
+} // namespace util
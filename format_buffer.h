@@ -0,0 +1,282 @@
+//
+//  Format Buffer
+//    Growable char buffer for fast text formatting of values and containers, numbers are formatted with
+//    std::to_chars which avoids the locale and sentry overhead of std::ostream.
+//    bracket_style: Same output as the operator<< of serialize_container.h, ie "[1, 2, 3]", "[{key, value}, ...]"
+//    json_style:    JSON, strings are quoted and escaped, maps are objects with the keys as strings
+//
+//   USAGE:
+//     util::format_buffer buf;
+//     buf << "ids: " << ids << ", weights: " << weights; // std::vector<int>, std::map<int, float>
+//     log(buf.str());
+//     buf.clear();                                       // Keeps the memory
+//
+//     util::format_buffer json(util::format_buffer::json_style);
+//     json << name_to_values;                            // {"a": [1, 2], "b": []}
+//     json.append(",\n", 2);                             // Unquoted text
+//
+//  NOTES:
+//  - In json_style all text written by operator<< is quoted, use append(...) for separators
+//  - Floating point values are written with the shortest representation which round-trips,
+//    JSON writes non-finite values as null
+//  - Types without a format_buffer overload are formatted through their std::ostream operator<<,
+//    which is slower
+//  - The formatting does not depend on any stream state: int8_t\uint8_t are numbers, and stream manipulators
+//    do not compile (std::hex, std::endl) or have no effect (std::setprecision), use std::ostringstream for those
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <sstream>
+#include <utility>
+#include <array>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <type_traits>
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#  include <charconv>
+#  include <string_view>
+#  define FORMAT_BUFFER_TO_CHARS_ENABLED
+#endif
+
+namespace util {
+
+
+class format_buffer {
+public:
+  enum style { bracket_style, json_style };
+
+  explicit format_buffer(style s = bracket_style, size_t reserved = 256) : style_(s) { buffer_.reserve(reserved); }
+
+  style get_style() const { return style_; }
+  bool empty() const { return buffer_.empty(); }
+  size_t size() const { return buffer_.size(); }
+  const char* data() const { return buffer_.data(); }
+  const std::string& str() const { return buffer_; }
+  void clear() { buffer_.clear(); }
+
+  format_buffer& append(const char* src, size_t n) {
+    buffer_.append(src, n);
+    return *this;
+  }
+  format_buffer& append(char c) {
+    buffer_.push_back(c);
+    return *this;
+  }
+  // Text, quoted and escaped in json_style
+  format_buffer& append_text(const char* src, size_t n) {
+    if (style_ != json_style)
+      return append(src, n);
+    buffer_.push_back('"');
+    for (size_t i = 0; i < n; ++i)
+      append_escaped_(src[i]);
+    buffer_.push_back('"');
+    return *this;
+  }
+  template <typename T>
+  format_buffer& append_number(T val) {
+    append_number_(val, std::integral_constant<bool, std::is_floating_point<T>::value>());
+    return *this;
+  }
+
+private:
+  void append_escaped_(char c) {
+    switch (c) {
+    case '"': buffer_.append("\\\""); break;
+    case '\\': buffer_.append("\\\\"); break;
+    case '\n': buffer_.append("\\n"); break;
+    case '\r': buffer_.append("\\r"); break;
+    case '\t': buffer_.append("\\t"); break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char escaped[8];
+        const int n = snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+        buffer_.append(escaped, static_cast<size_t>(n));
+      }
+      else
+        buffer_.push_back(c);
+    }
+  }
+  template <typename T>
+  void append_number_(T val, std::false_type) {
+    char digits[32];
+#ifdef FORMAT_BUFFER_TO_CHARS_ENABLED
+    const auto result = std::to_chars(digits, digits + sizeof(digits), val);
+    buffer_.append(digits, static_cast<size_t>(result.ptr - digits));
+#else
+    const int n = std::is_signed<T>::value ?
+      snprintf(digits, sizeof(digits), "%lld", static_cast<long long>(val)) :
+      snprintf(digits, sizeof(digits), "%llu", static_cast<unsigned long long>(val));
+    buffer_.append(digits, static_cast<size_t>(n));
+#endif
+  }
+  template <typename T>
+  void append_number_(T val, std::true_type) {
+    if (style_ == json_style && !std::isfinite(val)) {
+      buffer_.append("null");
+      return;
+    }
+    char digits[64];
+#if defined(FORMAT_BUFFER_TO_CHARS_ENABLED) && defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    const auto result = std::to_chars(digits, digits + sizeof(digits), val);
+    buffer_.append(digits, static_cast<size_t>(result.ptr - digits));
+#else
+    const int n = snprintf(digits, sizeof(digits), "%.*g", sizeof(T) <= sizeof(float) ? 9 : 17, static_cast<double>(val));
+    buffer_.append(digits, static_cast<size_t>(n));
+#endif
+  }
+
+  std::string buffer_;
+  style style_;
+};
+
+
+namespace _impl_format_buffer {
+  template <typename T>
+  struct is_text : std::false_type {};
+  template <typename C, typename TR, typename A>
+  struct is_text<std::basic_string<C, TR, A> > : std::true_type {};
+#ifdef FORMAT_BUFFER_TO_CHARS_ENABLED
+  template <>
+  struct is_text<std::string_view> : std::true_type {};
+#endif
+
+  // Delimited sequence, "[a, b, c]"
+  template <typename IT>
+  void format_sequence(format_buffer& buf, IT first, IT last) {
+    buf.append('[');
+    for (IT it = first; it != last; ++it) {
+      if (it != first)
+        buf.append(", ", 2);
+      buf << *it;
+    }
+    buf.append(']');
+  }
+
+  // JSON object keys must be strings, other keys are formatted and quoted
+  template <typename K>
+  void format_json_key(format_buffer& buf, const K& key, std::true_type) { buf << key; }
+  template <typename K>
+  void format_json_key(format_buffer& buf, const K& key, std::false_type) {
+    format_buffer key_buf(format_buffer::bracket_style, 32);
+    key_buf << key;
+    buf.append_text(key_buf.data(), key_buf.size());
+  }
+
+  // Map, "[{key, value}, ...]" or {"key": value, ...}
+  template <typename IT>
+  void format_map(format_buffer& buf, IT first, IT last) {
+    const bool is_json = buf.get_style() == format_buffer::json_style;
+    buf.append(is_json ? '{' : '[');
+    for (IT it = first; it != last; ++it) {
+      if (it != first)
+        buf.append(", ", 2);
+      if (is_json) {
+        typedef typename std::decay<decltype(it->first)>::type key_type;
+        format_json_key(buf, it->first, std::integral_constant<bool, is_text<key_type>::value>());
+        buf.append(": ", 2) << it->second;
+      }
+      else {
+        buf.append('{') << it->first;
+        buf.append(", ", 2) << it->second;
+        buf.append('}');
+      }
+    }
+    buf.append(is_json ? '}' : ']');
+  }
+} // namespace _impl_format_buffer
+
+
+// Numbers, bool and char
+template <typename T>
+typename std::enable_if<std::is_arithmetic<T>::value, format_buffer&>::type operator<<(format_buffer& buf, T val) {
+  return buf.append_number(val);
+}
+inline format_buffer& operator<<(format_buffer& buf, bool val) {
+  if (buf.get_style() == format_buffer::json_style)
+    return val ? buf.append("true", 4) : buf.append("false", 5);
+  return buf.append(val ? '1' : '0');
+}
+inline format_buffer& operator<<(format_buffer& buf, char val) {
+  return buf.append_text(&val, 1);
+}
+
+// Text
+inline format_buffer& operator<<(format_buffer& buf, const char* str) {
+  return buf.append_text(str, std::char_traits<char>::length(str));
+}
+template <typename TR, typename A>
+format_buffer& operator<<(format_buffer& buf, const std::basic_string<char, TR, A>& str) {
+  return buf.append_text(str.data(), str.size());
+}
+#ifdef FORMAT_BUFFER_TO_CHARS_ENABLED
+inline format_buffer& operator<<(format_buffer& buf, std::string_view str) {
+  return buf.append_text(str.data(), str.size());
+}
+#endif
+
+// Types without overload, formatted through std::ostream
+template <typename T>
+typename std::enable_if<!std::is_arithmetic<T>::value, format_buffer&>::type operator<<(format_buffer& buf, const T& val) {
+  std::ostringstream oss;
+  oss << val;
+  const std::string str = oss.str();
+  return buf.append_text(str.data(), str.size());
+}
+
+// Stream manipulators, see NOTES
+format_buffer& operator<<(format_buffer& buf, std::ios_base& (*manipulator)(std::ios_base&)) = delete;
+format_buffer& operator<<(format_buffer& buf, std::ostream& (*manipulator)(std::ostream&)) = delete;
+
+// Containers
+template <typename T, typename Y>
+format_buffer& operator<<(format_buffer& buf, const std::pair<T, Y>& pair) {
+  buf.append('[') << pair.first;
+  buf.append(", ", 2) << pair.second;
+  return buf.append(']');
+}
+template <typename T, typename A>
+format_buffer& operator<<(format_buffer& buf, const std::vector<T, A>& container) {
+  _impl_format_buffer::format_sequence(buf, container.begin(), container.end());
+  return buf;
+}
+template <typename T, typename A>
+format_buffer& operator<<(format_buffer& buf, const std::deque<T, A>& container) {
+  _impl_format_buffer::format_sequence(buf, container.begin(), container.end());
+  return buf;
+}
+template <typename T, size_t N>
+format_buffer& operator<<(format_buffer& buf, const std::array<T, N>& container) {
+  _impl_format_buffer::format_sequence(buf, container.begin(), container.end());
+  return buf;
+}
+template <typename T, typename C, typename A>
+format_buffer& operator<<(format_buffer& buf, const std::set<T, C, A>& container) {
+  _impl_format_buffer::format_sequence(buf, container.begin(), container.end());
+  return buf;
+}
+template <typename T, typename H, typename E, typename A>
+format_buffer& operator<<(format_buffer& buf, const std::unordered_set<T, H, E, A>& container) {
+  _impl_format_buffer::format_sequence(buf, container.begin(), container.end());
+  return buf;
+}
+template <typename K, typename V, typename C, typename A>
+format_buffer& operator<<(format_buffer& buf, const std::map<K, V, C, A>& container) {
+  _impl_format_buffer::format_map(buf, container.begin(), container.end());
+  return buf;
+}
+template <typename K, typename V, typename H, typename E, typename A>
+format_buffer& operator<<(format_buffer& buf, const std::unordered_map<K, V, H, E, A>& container) {
+  _impl_format_buffer::format_map(buf, container.begin(), container.end());
+  return buf;
+}
+
+
+} // namespace util
@@ -0,0 +1,143 @@
+//
+//  Huge Page Allocator
+//    Std-compatible allocator which backs large allocations by huge pages in order to reduce TLB misses.
+//    Allocations smaller than HUGE_PAGE_ALLOCATOR_THRESHOLD are forwarded to operator new.
+//
+//   USAGE:
+//     util::pod_vector<float, util::huge_page_allocator<float>> scratch(1 << 28);
+//     std::vector<double, util::huge_page_allocator<double>> samples(1 << 26);
+//
+//  NOTES:
+//  - Linux: Transparent huge pages are requested via madvise(MADV_HUGEPAGE).
+//    If HUGE_PAGE_ALLOCATOR_USE_HUGETLB is defined, MAP_HUGETLB is tried first, which requires
+//    pages to be reserved up front (vm.nr_hugepages). Falls back to THP if the reservation is exhausted.
+//  - Windows: MEM_LARGE_PAGES is tried first (requires SeLockMemoryPrivilege), falls back to regular pages.
+//  - Pages are not touched by the allocator, they are committed when first written to.
+//  - Stateless, all instances compare equal.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <memory>
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#endif
+
+#ifndef HUGE_PAGE_ALLOCATOR_THRESHOLD // Allocations below this amount of bytes are not backed by huge pages
+#  define HUGE_PAGE_ALLOCATOR_THRESHOLD (size_t(1) << 21)
+#endif
+
+namespace util {
+
+
+namespace _impl_huge_page_allocator {
+  const size_t default_huge_page_size = size_t(1) << 21;
+
+  inline size_t huge_page_size() {
+#ifdef _WIN32
+    static const size_t page_size = ::GetLargePageMinimum() != 0 ? ::GetLargePageMinimum() : default_huge_page_size;
+    return page_size;
+#else
+    return default_huge_page_size;
+#endif
+  }
+
+  inline size_t round_up(size_t bytes, size_t alignment) {
+    return (bytes + alignment - 1) / alignment * alignment;
+  }
+
+#ifdef _WIN32
+  inline void* allocate_pages(size_t bytes) {
+    void* ptr = ::VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if (ptr == nullptr)
+      ptr = ::VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    return ptr;
+  }
+  inline void deallocate_pages(void* ptr, size_t) {
+    ::VirtualFree(ptr, 0, MEM_RELEASE);
+  }
+#else
+  inline void* allocate_pages(size_t bytes) {
+#  if defined(HUGE_PAGE_ALLOCATOR_USE_HUGETLB) && defined(MAP_HUGETLB)
+    void* explicit_ptr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (explicit_ptr != MAP_FAILED)
+      return explicit_ptr;
+#  endif
+    // Over-allocate in order to align the region to a huge page boundary, as THP only backs aligned ranges
+    const size_t alignment = huge_page_size();
+    const size_t mapped_bytes = bytes + alignment;
+    void* mapped = ::mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+      return nullptr;
+    const auto mapped_address = reinterpret_cast<uintptr_t>(mapped);
+    const auto aligned_address = round_up(mapped_address, alignment);
+    const size_t head = aligned_address - mapped_address;
+    const size_t tail = mapped_bytes - head - bytes;
+    if (head > 0)
+      ::munmap(mapped, head);
+    if (tail > 0)
+      ::munmap(reinterpret_cast<void*>(aligned_address + bytes), tail);
+    void* ptr = reinterpret_cast<void*>(aligned_address);
+#  ifdef MADV_HUGEPAGE
+    ::madvise(ptr, bytes, MADV_HUGEPAGE);
+#  endif
+    return ptr;
+  }
+  inline void deallocate_pages(void* ptr, size_t bytes) {
+    ::munmap(ptr, bytes);
+  }
+#endif
+} // namespace _impl_huge_page_allocator
+
+
+template <typename T>
+class huge_page_allocator {
+public:
+  typedef huge_page_allocator<T> my_type;
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  typedef std::true_type is_always_equal;
+
+  huge_page_allocator() {}
+  template <typename U>
+  huge_page_allocator(const huge_page_allocator<U>&) {}
+
+  T* allocate(size_t n) {
+    const size_t bytes = n * sizeof(T);
+    if (bytes < HUGE_PAGE_ALLOCATOR_THRESHOLD)
+      return static_cast<T*>(::operator new(bytes));
+    const size_t page_bytes = _impl_huge_page_allocator::round_up(bytes, _impl_huge_page_allocator::huge_page_size());
+    void* ptr = _impl_huge_page_allocator::allocate_pages(page_bytes);
+    if (ptr == nullptr)
+      throw std::bad_alloc();
+    return static_cast<T*>(ptr);
+  }
+  void deallocate(T* ptr, size_t n) {
+    const size_t bytes = n * sizeof(T);
+    if (bytes < HUGE_PAGE_ALLOCATOR_THRESHOLD) {
+      ::operator delete(ptr);
+      return;
+    }
+    const size_t page_bytes = _impl_huge_page_allocator::round_up(bytes, _impl_huge_page_allocator::huge_page_size());
+    _impl_huge_page_allocator::deallocate_pages(ptr, page_bytes);
+  }
+
+  template <typename U>
+  bool operator==(const huge_page_allocator<U>&) const { return true; }
+  template <typename U>
+  bool operator!=(const huge_page_allocator<U>&) const { return false; }
+};
+
+
+} // namespace util
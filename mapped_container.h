@@ -0,0 +1,596 @@
+//
+//  Mapped Container
+//    Flat, relocatable file format for vectors, sorted sets\maps and marrays which is read in place through a
+//    memory mapping, without a parse step. All references within the file are offsets, hence the file can be
+//    mapped at any address. Elements must be trivially copyable.
+//    mapped_writer:  Collects named containers and saves the file
+//    mapped_archive: Maps a file (or wraps a memory block) and returns views of its containers
+//    Views:          mapped_vector_view<T>, mapped_set_view<T>, mapped_flat_map_view<K, V>, mapped_marray_view<T, N>
+//
+//   USAGE:
+//     util::mapped_writer writer;
+//     writer.write("ids", ids);                   // std::vector<uint32_t>
+//     writer.write("id_to_weight", id_to_weight); // std::map<uint32_t, float>, std::unordered_map is sorted
+//     writer.write("volume", volume);             // marray<float, 3>
+//     writer.save("tables.bin");
+//
+//     util::mapped_archive archive("tables.bin");
+//     auto ids = archive.get_vector<uint32_t>("ids");
+//     auto weights = archive.get_flat_map<uint32_t, float>("id_to_weight");
+//     if (const float* w = weights.find(42)) { ... }
+//     auto volume = archive.get_marray<float, 3>("volume");
+//     float val = volume.at(1, 2, 3);
+//
+//  NOTES:
+//  - Views point into the archive and are valid as long as the archive is alive
+//  - Each container has a checksum, which is verified depending on the checksum_mode of the archive:
+//    checksum_lazy (default) verifies a container the first time it is requested, checksum_on_open verifies all
+//    containers when the archive is opened and checksum_none skips verification. verify() checks all on request
+//  - Element sizes are validated when a container is requested, the byte order of the file must match the reader
+//  - The data of every container is aligned to MAPPED_CONTAINER_ALIGNMENT bytes within the file
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <array>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+#include <type_traits>
+#include "sorted_search.h"
+#include "checksum.h"
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#ifndef MAPPED_CONTAINER_ALIGNMENT // Alignment of container data within the file, must be a power of two
+#  define MAPPED_CONTAINER_ALIGNMENT 64
+#endif
+
+// Forward declaration, the overloads are instantiated only when used
+template <typename T, size_t N, typename A, typename L> class marray;
+
+namespace util {
+
+
+namespace _impl_mapped_container {
+  static const uint32_t magic = 0x4D504E43; // "CNPM"
+  static const uint16_t current_version = 1;
+  enum kind { kind_vector = 1, kind_set = 2, kind_map = 3, kind_marray = 4 };
+  static const size_t max_name_size = 63;
+
+  // Fixed layout structures, explicitly padded
+  struct header {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t big_endian;
+    uint8_t reserved0;
+    uint32_t num_entries;
+    uint32_t reserved1;
+    uint64_t directory_offset;
+    uint64_t file_size;
+    uint64_t directory_checksum;
+    uint8_t reserved2[24];
+  };
+  struct entry {
+    char name[max_name_size + 1];
+    uint32_t kind;
+    uint32_t key_size;   // Element size of vectors\sets\marrays, key size of maps
+    uint32_t value_size; // Value size of maps
+    uint32_t dimensions; // Of marrays
+    uint64_t size;
+    uint64_t key_offset;
+    uint64_t value_offset;
+    uint64_t dims[3];
+    uint64_t checksum;
+  };
+  static_assert(sizeof(header) == 64, "Unexpected mapped_container header size");
+  static_assert(sizeof(entry) == 64 + 16 + 8 * 7, "Unexpected mapped_container entry size");
+
+  inline bool is_big_endian() {
+    const uint16_t probe = 1;
+    uint8_t first_byte = 0;
+    memcpy(&first_byte, &probe, 1);
+    return first_byte == 0;
+  }
+
+  template <typename T>
+  void check_element_type() {
+    static_assert(std::is_trivially_copyable<T>::value && !std::is_pointer<T>::value, "Mapped containers require trivially copyable, pointer free elements");
+  }
+
+  // Whether the comparator C orders T as operator< does, which the views search with
+  template <typename C, typename T>
+  struct is_less_order : std::integral_constant<bool,
+    std::is_same<C, std::less<T> >::value || std::is_same<C, std::less<> >::value> {};
+} // namespace _impl_mapped_container
+
+
+// Read-only memory mapping of a whole file
+class mapped_file {
+public:
+  mapped_file() : data_(nullptr), size_(0) {}
+  explicit mapped_file(const std::string& path) : data_(nullptr), size_(0) { open(path); }
+  mapped_file(mapped_file&& other) : data_(other.data_), size_(other.size_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+  mapped_file& operator=(mapped_file&& other) {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+  ~mapped_file() { close(); }
+
+  // Returns false if the file could not be opened or mapped
+  bool open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    const HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+      return false;
+    LARGE_INTEGER file_size;
+    if (::GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+      const HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (mapping != nullptr) {
+        data_ = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size_ = data_ != nullptr ? static_cast<size_t>(file_size.QuadPart) : 0;
+        ::CloseHandle(mapping);
+      }
+    }
+    ::CloseHandle(file);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+      void* ptr = ::mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr != MAP_FAILED) {
+        data_ = ptr;
+        size_ = static_cast<size_t>(file_stat.st_size);
+      }
+    }
+    ::close(fd);
+#endif
+    return data_ != nullptr;
+  }
+  void close() {
+    if (data_ == nullptr)
+      return;
+#ifdef _WIN32
+    ::UnmapViewOfFile(data_);
+#else
+    ::munmap(data_, size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+  }
+  bool is_open() const { return data_ != nullptr; }
+  const void* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  mapped_file(const mapped_file& other);
+  mapped_file& operator=(const mapped_file& other);
+  void* data_;
+  size_t size_;
+};
+
+
+// Views
+template <typename T>
+class mapped_vector_view {
+public:
+  typedef T value_type;
+  typedef const T* iterator;
+  typedef const T* const_iterator;
+
+  mapped_vector_view() : data_(nullptr), size_(0) {}
+  mapped_vector_view(const T* data, size_t size) : data_(data), size_(size) {}
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  const T* data() const { return data_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+  const T& operator[](size_t idx) const { DASSERT(idx < size_); return data_[idx]; }
+  const T& front() const { DASSERT(!empty()); return data_[0]; }
+  const T& back() const { DASSERT(!empty()); return data_[size_ - 1]; }
+
+private:
+  const T* data_;
+  size_t size_;
+};
+
+// Sorted unique elements
+template <typename T>
+class mapped_set_view : public mapped_vector_view<T> {
+public:
+  typedef typename mapped_vector_view<T>::const_iterator const_iterator;
+
+  mapped_set_view() {}
+  mapped_set_view(const T* data, size_t size) : mapped_vector_view<T>(data, size) {}
+
+  const_iterator lower_bound(const T& val) const { return util::branchless_lower_bound(this->begin(), this->end(), val); }
+  const_iterator find(const T& val) const {
+    const auto pos = lower_bound(val);
+    return pos != this->end() && !(val < *pos) ? pos : this->end();
+  }
+  size_t count(const T& val) const { return find(val) != this->end() ? 1 : 0; }
+  bool contains(const T& val) const { return count(val) != 0; }
+};
+
+// Sorted unique keys and their values, stored as two arrays
+template <typename K, typename V>
+class mapped_flat_map_view {
+public:
+  typedef K key_type;
+  typedef V mapped_type;
+
+  mapped_flat_map_view() : keys_(nullptr), values_(nullptr), size_(0) {}
+  mapped_flat_map_view(const K* keys, const V* values, size_t size) : keys_(keys), values_(values), size_(size) {}
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  mapped_set_view<K> keys() const { return mapped_set_view<K>(keys_, size_); }
+  mapped_vector_view<V> values() const { return mapped_vector_view<V>(values_, size_); }
+
+  // Returns the value of key, or nullptr if missing
+  const V* find(const K& key) const {
+    const K* pos = util::branchless_lower_bound(keys_, keys_ + size_, key);
+    return pos != keys_ + size_ && !(key < *pos) ? values_ + (pos - keys_) : nullptr;
+  }
+  size_t count(const K& key) const { return find(key) != nullptr ? 1 : 0; }
+  bool contains(const K& key) const { return find(key) != nullptr; }
+  const V& at(const K& key) const {
+    const V* val = find(key);
+    RASSERT_MSG(val != nullptr, "mapped_flat_map_view::at, key not found");
+    return *val;
+  }
+
+private:
+  const K* keys_;
+  const V* values_;
+  size_t size_;
+};
+
+template <typename T, size_t N>
+class mapped_marray_view {
+public:
+  typedef T value_type;
+  typedef const T* const_iterator;
+  static const size_t dimensions = N;
+
+  mapped_marray_view() : data_(nullptr), width_mul_height_(0) { dims_.fill(0); }
+  mapped_marray_view(const T* data, size_t w, size_t h, size_t d) : data_(data), width_mul_height_(w * h) {
+    dims_[0] = w;
+    dims_[1] = h;
+    dims_[2] = d;
+  }
+
+  size_t width() const { return dims_[0]; }
+  size_t height() const { return dims_[1]; }
+  size_t depth() const { return dims_[2]; }
+  size_t size() const { return width_mul_height_ * depth(); }
+  bool empty() const { return size() == 0; }
+  const T* data() const { return data_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size(); }
+  const T& operator[](size_t idx) const { DASSERT(idx < size()); return data_[idx]; }
+  const T& at(size_t x) const { DASSERT(x < size()); return data_[x]; }
+  const T& at(size_t x, size_t y) const { DASSERT(x < width() && y < height()); return data_[y * width() + x]; }
+  const T& at(size_t x, size_t y, size_t z) const {
+    DASSERT(x < width() && y < height() && z < depth());
+    return data_[z * width_mul_height_ + y * width() + x];
+  }
+
+private:
+  const T* data_;
+  size_t width_mul_height_;
+  std::array<size_t, 3> dims_;
+};
+
+
+class mapped_writer {
+  typedef _impl_mapped_container::entry entry;
+public:
+  mapped_writer() {}
+
+  // Raw ranges
+  template <typename T>
+  void write_vector(const std::string& name, const T* data, size_t n) {
+    _impl_mapped_container::check_element_type<T>();
+    entry& e = add_entry_(name, _impl_mapped_container::kind_vector, sizeof(T), 0, n);
+    e.key_offset = append_(data, n * sizeof(T));
+    e.checksum = util::checksum64(data, n * sizeof(T));
+  }
+  // Sorted unique range, becomes a mapped_set_view
+  template <typename T>
+  void write_sorted_set(const std::string& name, const T* data, size_t n) {
+    _impl_mapped_container::check_element_type<T>();
+    DASSERT(std::adjacent_find(data, data + n, [](const T& a, const T& b) { return !(a < b); }) == data + n);
+    entry& e = add_entry_(name, _impl_mapped_container::kind_set, sizeof(T), 0, n);
+    e.key_offset = append_(data, n * sizeof(T));
+    e.checksum = util::checksum64(data, n * sizeof(T));
+  }
+  // Sorted unique keys and their values, becomes a mapped_flat_map_view
+  template <typename K, typename V>
+  void write_sorted_map(const std::string& name, const K* keys, const V* values, size_t n) {
+    _impl_mapped_container::check_element_type<K>();
+    _impl_mapped_container::check_element_type<V>();
+    DASSERT(std::adjacent_find(keys, keys + n, [](const K& a, const K& b) { return !(a < b); }) == keys + n);
+    entry& e = add_entry_(name, _impl_mapped_container::kind_map, sizeof(K), sizeof(V), n);
+    e.key_offset = append_(keys, n * sizeof(K));
+    e.value_offset = append_(values, n * sizeof(V));
+    e.checksum = util::checksum64(values, n * sizeof(V), util::checksum64(keys, n * sizeof(K)));
+  }
+
+  // Containers
+  template <typename T, typename A>
+  void write(const std::string& name, const std::vector<T, A>& container) { write_vector(name, container.data(), container.size()); }
+  template <typename T, typename A>
+  void write(const std::string& name, const std::deque<T, A>& container) {
+    const std::vector<T> values(container.begin(), container.end());
+    write_vector(name, values.data(), values.size());
+  }
+  template <typename T, size_t N>
+  void write(const std::string& name, const std::array<T, N>& container) { write_vector(name, container.data(), N); }
+  // Sets and maps of other comparators than std::less are sorted by operator<
+  template <typename T, typename C, typename A>
+  void write(const std::string& name, const std::set<T, C, A>& container) {
+    std::vector<T> values(container.begin(), container.end());
+    if (!_impl_mapped_container::is_less_order<C, T>::value)
+      std::sort(values.begin(), values.end());
+    write_sorted_set(name, values.data(), values.size());
+  }
+  template <typename T, typename H, typename E, typename A>
+  void write(const std::string& name, const std::unordered_set<T, H, E, A>& container) {
+    std::vector<T> values(container.begin(), container.end());
+    std::sort(values.begin(), values.end());
+    write_sorted_set(name, values.data(), values.size());
+  }
+  template <typename K, typename V, typename C, typename A>
+  void write(const std::string& name, const std::map<K, V, C, A>& container) {
+    if (_impl_mapped_container::is_less_order<C, K>::value)
+      write_map_(name, container.begin(), container.end(), container.size());
+    else
+      write_unsorted_map_(name, container.begin(), container.end());
+  }
+  template <typename K, typename V, typename H, typename E, typename A>
+  void write(const std::string& name, const std::unordered_map<K, V, H, E, A>& container) { write_unsorted_map_(name, container.begin(), container.end()); }
+  template <typename T, size_t N, typename A, typename L>
+  void write(const std::string& name, const marray<T, N, A, L>& container) {
+    static_assert(L::is_linear, "mapped marrays require the linear layout, see util::convert_layout");
+    _impl_mapped_container::check_element_type<T>();
+    entry& e = add_entry_(name, _impl_mapped_container::kind_marray, sizeof(T), 0, container.size());
+    e.dimensions = static_cast<uint32_t>(N);
+    e.dims[0] = container.width();
+    e.dims[1] = container.height();
+    e.dims[2] = container.depth();
+    e.key_offset = append_(container.data(), container.size() * sizeof(T));
+    e.checksum = util::checksum64(container.data(), container.size() * sizeof(T));
+  }
+
+  // Saves header, containers and directory, returns false on failure
+  bool save(std::ostream& os) const {
+    const size_t directory_offset = round_up_(sizeof(_impl_mapped_container::header) + payload_.size());
+    const size_t directory_bytes = entries_.size() * sizeof(entry);
+    _impl_mapped_container::header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = _impl_mapped_container::magic;
+    h.version = _impl_mapped_container::current_version;
+    h.big_endian = _impl_mapped_container::is_big_endian() ? 1 : 0;
+    h.num_entries = static_cast<uint32_t>(entries_.size());
+    h.directory_offset = directory_offset;
+    h.file_size = directory_offset + directory_bytes;
+    h.directory_checksum = util::checksum64(entries_.data(), directory_bytes);
+    os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    os.write(payload_.data(), static_cast<std::streamsize>(payload_.size()));
+    const std::vector<char> padding(directory_offset - sizeof(h) - payload_.size(), 0);
+    os.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    os.write(reinterpret_cast<const char*>(entries_.data()), static_cast<std::streamsize>(directory_bytes));
+    return os.good();
+  }
+  bool save(const std::string& path) const {
+    std::ofstream ofs(path.c_str(), std::ios::binary);
+    return ofs.good() && save(ofs);
+  }
+
+private:
+  static size_t round_up_(size_t offset) { return (offset + MAPPED_CONTAINER_ALIGNMENT - 1) & ~size_t(MAPPED_CONTAINER_ALIGNMENT - 1); }
+  entry& add_entry_(const std::string& name, uint32_t kind, size_t key_size, size_t value_size, size_t size) {
+    RASSERT_MSG(name.size() <= _impl_mapped_container::max_name_size, "mapped_writer: name too long, " << name);
+    entry e;
+    memset(&e, 0, sizeof(e));
+    memcpy(e.name, name.data(), name.size());
+    e.kind = kind;
+    e.key_size = static_cast<uint32_t>(key_size);
+    e.value_size = static_cast<uint32_t>(value_size);
+    e.dimensions = 1;
+    e.size = size;
+    e.dims[0] = size;
+    e.dims[1] = e.dims[2] = 1;
+    entries_.push_back(e);
+    return entries_.back();
+  }
+  // Appends aligned data and returns its file offset
+  uint64_t append_(const void* data, size_t num_bytes) {
+    const size_t header_size = sizeof(_impl_mapped_container::header);
+    const size_t offset = round_up_(header_size + payload_.size());
+    payload_.resize(offset - header_size + num_bytes, 0);
+    if (num_bytes > 0)
+      memcpy(&payload_[offset - header_size], data, num_bytes);
+    return offset;
+  }
+  template <typename IT>
+  void write_map_(const std::string& name, IT start, IT stop, size_t n) {
+    typedef typename std::decay<decltype(start->first)>::type key_type;
+    typedef typename std::decay<decltype(start->second)>::type value_type;
+    std::vector<key_type> keys;
+    std::vector<value_type> values;
+    keys.reserve(n);
+    values.reserve(n);
+    for (; start != stop; ++start) {
+      keys.push_back(start->first);
+      values.push_back(start->second);
+    }
+    write_sorted_map(name, keys.data(), values.data(), n);
+  }
+  template <typename IT>
+  void write_unsorted_map_(const std::string& name, IT start, IT stop) {
+    typedef typename std::decay<decltype(start->first)>::type key_type;
+    typedef typename std::decay<decltype(start->second)>::type value_type;
+    std::vector<std::pair<key_type, value_type> > sorted(start, stop);
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<key_type, value_type>& a, const std::pair<key_type, value_type>& b) { return a.first < b.first; });
+    write_map_(name, sorted.begin(), sorted.end(), sorted.size());
+  }
+
+  std::vector<char> payload_; // File contents after the header
+  std::vector<entry> entries_;
+};
+
+
+class mapped_archive {
+  typedef _impl_mapped_container::entry entry;
+public:
+  enum checksum_mode { checksum_lazy, checksum_on_open, checksum_none };
+
+  // Maps a file written by mapped_writer
+  explicit mapped_archive(const std::string& path, checksum_mode mode = checksum_lazy) : file_(path), data_(nullptr), size_(0), mode_(mode) {
+    RASSERT_MSG(file_.is_open(), "mapped_archive: cannot map " << path);
+    open_(static_cast<const char*>(file_.data()), file_.size());
+  }
+  // Wraps a memory block, which must be aligned to MAPPED_CONTAINER_ALIGNMENT and outlive the archive
+  mapped_archive(const void* data, size_t size, checksum_mode mode = checksum_lazy) : data_(nullptr), size_(0), mode_(mode) {
+    open_(static_cast<const char*>(data), size);
+  }
+
+  size_t num_containers() const { return num_entries_; }
+  std::string name(size_t idx) const { DASSERT(idx < num_entries_); return entries_[idx].name; }
+  bool contains(const std::string& name) const { return find_(name) != nullptr; }
+
+  // Verifies the checksums of all containers
+  bool verify() const {
+    for (size_t i = 0; i < num_entries_; ++i) {
+      if (!verify_entry_(i))
+        return false;
+    }
+    return true;
+  }
+
+  template <typename T>
+  mapped_vector_view<T> get_vector(const std::string& name) const {
+    const entry& e = get_(name, _impl_mapped_container::kind_vector, sizeof(T), 0);
+    return mapped_vector_view<T>(pointer_<T>(e.key_offset, e.size), static_cast<size_t>(e.size));
+  }
+  template <typename T>
+  mapped_set_view<T> get_set(const std::string& name) const {
+    const entry& e = get_(name, _impl_mapped_container::kind_set, sizeof(T), 0);
+    return mapped_set_view<T>(pointer_<T>(e.key_offset, e.size), static_cast<size_t>(e.size));
+  }
+  template <typename K, typename V>
+  mapped_flat_map_view<K, V> get_flat_map(const std::string& name) const {
+    const entry& e = get_(name, _impl_mapped_container::kind_map, sizeof(K), sizeof(V));
+    return mapped_flat_map_view<K, V>(pointer_<K>(e.key_offset, e.size), pointer_<V>(e.value_offset, e.size), static_cast<size_t>(e.size));
+  }
+  template <typename T, size_t N>
+  mapped_marray_view<T, N> get_marray(const std::string& name) const {
+    const entry& e = get_(name, _impl_mapped_container::kind_marray, sizeof(T), 0);
+    RASSERT_MSG(e.dimensions == N, "mapped_archive: " << name << " has " << e.dimensions << " dimensions");
+    return mapped_marray_view<T, N>(pointer_<T>(e.key_offset, e.size), static_cast<size_t>(e.dims[0]), static_cast<size_t>(e.dims[1]), static_cast<size_t>(e.dims[2]));
+  }
+
+private:
+  mapped_archive(const mapped_archive& other);
+  mapped_archive& operator=(const mapped_archive& other);
+
+  void open_(const char* data, size_t size) {
+    data_ = data;
+    size_ = size;
+    _impl_mapped_container::header h;
+    RASSERT_MSG(size_ >= sizeof(h), "mapped_archive: file too small");
+    memcpy(&h, data_, sizeof(h));
+    RASSERT_MSG(h.magic == _impl_mapped_container::magic, "mapped_archive: not a mapped container file");
+    RASSERT_MSG(h.version <= _impl_mapped_container::current_version, "mapped_archive: unsupported version " << h.version);
+    RASSERT_MSG((h.big_endian != 0) == _impl_mapped_container::is_big_endian(), "mapped_archive: file was written with another byte order");
+    RASSERT_MSG(h.file_size <= size_ && h.directory_offset + uint64_t(h.num_entries) * sizeof(entry) <= h.file_size, "mapped_archive: truncated file");
+    RASSERT_MSG(reinterpret_cast<uintptr_t>(data_) % MAPPED_CONTAINER_ALIGNMENT == 0, "mapped_archive: data is not aligned");
+    entries_ = reinterpret_cast<const entry*>(data_ + h.directory_offset);
+    num_entries_ = h.num_entries;
+    RASSERT_MSG(util::checksum64(entries_, num_entries_ * sizeof(entry)) == h.directory_checksum, "mapped_archive: corrupt directory");
+    verified_.reset(new std::atomic<bool>[num_entries_]);
+    for (size_t i = 0; i < num_entries_; ++i)
+      verified_[i].store(false, std::memory_order_relaxed);
+    if (mode_ == checksum_on_open)
+      RASSERT_MSG(verify(), "mapped_archive: checksum mismatch");
+  }
+  const entry* find_(const std::string& name) const {
+    for (size_t i = 0; i < num_entries_; ++i) {
+      if (name == entries_[i].name)
+        return entries_ + i;
+    }
+    return nullptr;
+  }
+  const entry& get_(const std::string& name, uint32_t kind, size_t key_size, size_t value_size) const {
+    const entry* e = find_(name);
+    RASSERT_MSG(e != nullptr, "mapped_archive: no container named " << name);
+    RASSERT_MSG(e->kind == kind, "mapped_archive: " << name << " is another kind of container");
+    RASSERT_MSG(e->key_size == key_size && e->value_size == value_size, "mapped_archive: element size mismatch for " << name);
+    // checksum_none skips the check on request only, verified_ holds the containers actually verified
+    RASSERT_MSG(mode_ == checksum_none || verify_entry_(static_cast<size_t>(e - entries_)), "mapped_archive: checksum mismatch for " << name);
+    return *e;
+  }
+  bool verify_entry_(size_t idx) const {
+    if (verified_[idx].load(std::memory_order_acquire))
+      return true;
+    const entry& e = entries_[idx];
+    const uint64_t key_bytes = e.size * e.key_size;
+    const uint64_t value_bytes = e.size * e.value_size;
+    if (e.key_offset + key_bytes > size_ || e.value_offset + value_bytes > size_)
+      return false;
+    uint64_t sum = util::checksum64(data_ + e.key_offset, static_cast<size_t>(key_bytes));
+    if (e.kind == _impl_mapped_container::kind_map)
+      sum = util::checksum64(data_ + e.value_offset, static_cast<size_t>(value_bytes), sum);
+    if (sum != e.checksum)
+      return false;
+    verified_[idx].store(true, std::memory_order_release);
+    return true;
+  }
+  template <typename T>
+  const T* pointer_(uint64_t offset, uint64_t n) const {
+    RASSERT_MSG(offset + n * sizeof(T) <= size_, "mapped_archive: container out of range");
+    return reinterpret_cast<const T*>(data_ + offset);
+  }
+
+  mapped_file file_;
+  const char* data_;
+  size_t size_;
+  const entry* entries_;
+  size_t num_entries_;
+  checksum_mode mode_;
+  std::unique_ptr<std::atomic<bool>[]> verified_; // Containers whose checksum has been verified
+};
+
+
+} // namespace util
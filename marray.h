@@ -3,13 +3,24 @@
 #include <vector>
 #include <array>
 #include <math_src/vec_maker.h>
+#include "uninitialized_vector.h"
+#include "first_touch.h"
+#include "marray_layout.h"
+#include "marray_view.h"
+#include "marray_sample.h"
+#include "marray_stencil.h"
+#include "marray_resample.h"
 
-template <typename T, size_t N>
+// L is the memory layout, see marray_layout.h
+template <typename T, size_t N, typename A = std::allocator<T>, typename L = util::marray_layout_linear>
 class marray {
+  static_assert(L::is_linear || N == 3, "non-linear layouts are 3D only");
 public:
   static const size_t dimensions = N;
-  typedef marray<T, N> my_type;
-  typedef std::vector<T> container_type;
+  typedef marray<T, N, A, L> my_type;
+  typedef A allocator_type;
+  typedef L layout_type;
+  typedef util::default_init_vector<T, A> container_type;
   typedef typename container_type::pointer pointer;
   typedef typename container_type::const_pointer const_pointer;
   typedef typename container_type::difference_type difference_type;
@@ -17,10 +28,11 @@ public:
   typedef typename container_type::reference reference;
   typedef typename container_type::const_reference const_reference;
   typedef typename container_type::value_type value_type;
-  typedef typename container_type::iterator iterator;
-  typedef typename container_type::const_iterator const_iterator;
-  typedef typename container_type::reverse_iterator reverse_iterator;
-  typedef typename container_type::const_reverse_iterator const_reverse_iterator;
+  // Non-linear layouts are iterated in the order of the linear layout
+  typedef typename std::conditional<L::is_linear, typename container_type::iterator, util::marray_layout_iterator<T, L> >::type iterator;
+  typedef typename std::conditional<L::is_linear, typename container_type::const_iterator, util::marray_layout_iterator<const T, L> >::type const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
   
   marray() : width_mul_height_(0) { dims_.fill(0); }
 
@@ -28,12 +40,51 @@ public:
     set_size(w, h, d);
   }
 
+  explicit marray(const allocator_type& allocator) : data_(allocator), width_mul_height_(0) { dims_.fill(0); }
+
+  // The storage is moved rather than swapped with a default constructed one, ie allocators without a default
+  // constructor (util::arena_allocator) are supported. A moved-from marray is empty
+  marray(const my_type& other) : data_(other.data_), width_mul_height_(other.width_mul_height_), dims_(other.dims_), layout_(other.layout_) {}
+  marray(my_type&& other) : data_(std::move(other.data_)), width_mul_height_(other.width_mul_height_), dims_(other.dims_), layout_(other.layout_) {
+    other.reset_();
+  }
+  my_type& operator=(const my_type& other) {
+    data_ = other.data_;
+    set_dims_(other.width(), other.height(), other.depth());
+    return *this;
+  }
+  my_type& operator=(my_type&& other) {
+    if (this != &other) {
+      data_ = std::move(other.data_);
+      set_dims_(other.width(), other.height(), other.depth());
+      other.reset_();
+    }
+    return *this;
+  }
+  bool operator==(const my_type& other) const { return dims_ == other.dims_ && data_ == other.data_; }
+  bool operator!=(const my_type& other) const { return !(*this == other); }
+
   void set_size(size_t w, size_t h = 1, size_t d = 1) {
-    dims_[0] = w;
-    dims_[1] = h;
-    dims_[2] = d;
-    width_mul_height_ = width() * height();
-    data_.resize(w*h*d);
+    set_dims_(w, h, d);
+    data_.resize(layout_.storage_size(), value_type());
+  }
+
+  // Allocates without touching the memory and value-initializes it in parallel, slab by slab along the outermost axis.
+  // The chunks equals those of pfor over the outermost axis, ie pfor(size_t z, 0, depth()) in 3D, 
+  // which places every slab on the NUMA node of the thread processing it.
+  void allocate_first_touch(size_t w, size_t h = 1, size_t d = 1, const pfor_partitioner& partitioner = pfor_partitioner()) {
+    container_type(get_allocator()).swap(data_);
+    set_dims_(w, h, d);
+    data_.resize_uninitialized(layout_.storage_size());
+    if (data_.empty())
+      return;
+    // Slabs of non-linear layouts are not contiguous, the storage is split evenly instead
+    const size_t num_slabs = !L::is_linear ? data_.size() : N == 3 ? d : N == 2 ? h : w;
+    const size_t slab_size = data_.size() / num_slabs;
+    const auto ptr = data_.data();
+    partitioner.for_each_chunk(size_t(0), num_slabs, [ptr, slab_size](size_t start, size_t stop) {
+      std::fill(ptr + start*slab_size, ptr + stop*slab_size, value_type());
+    });
   }
 
   // Emplace data
@@ -47,11 +98,21 @@ public:
     data_ = std::move(new_data);
     set_size(w,h);
   }
+  // Elements in layout order, see data()
   void set_data(size_t w, size_t h, size_t d, container_type new_data) {
-    RASSERT(w*h*d == new_data.size());
+    layout_type layout;
+    layout.set_dims(w, h, d);
+    RASSERT(layout.storage_size() == new_data.size());
     data_ = std::move(new_data);
     set_size(w,h,d);
   }
+  // From std::vector of any allocator, the elements are copied as the container types differ
+  template <typename VA>
+  void set_data(size_t w, const std::vector<T, VA>& new_data) { set_data(w, copy_container_(new_data)); }
+  template <typename VA>
+  void set_data(size_t w, size_t h, const std::vector<T, VA>& new_data) { set_data(w, h, copy_container_(new_data)); }
+  template <typename VA>
+  void set_data(size_t w, size_t h, size_t d, const std::vector<T, VA>& new_data) { set_data(w, h, d, copy_container_(new_data)); }
 
   // Size
   size_t width() const { return dims_[0]; }
@@ -62,22 +123,23 @@ public:
   bool empty() const { return size() == 0; }
 
   // Data access by iterator
-  iterator begin() { return data_.begin(); }
-  const_iterator begin() const { return data_.begin(); }
-  iterator end() { return data_.end(); }
-  const_iterator end() const { return data_.end(); }
-  reverse_iterator rend() { return data_.rend(); }
-  const_reverse_iterator rend() const { return data_.rend(); }
-  reverse_iterator rbegin() { return data_.rbegin(); }
-  const_reverse_iterator rbegin() const { return data_.rbegin(); }
+  iterator begin() { return make_iterator_<iterator>(data_, 0, is_linear_()); }
+  const_iterator begin() const { return make_iterator_<const_iterator>(data_, 0, is_linear_()); }
+  iterator end() { return make_iterator_<iterator>(data_, size(), is_linear_()); }
+  const_iterator end() const { return make_iterator_<const_iterator>(data_, size(), is_linear_()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
 
   value_type& front() { return data_.front(); }
   const value_type& front() const { return data_.front(); }
-  value_type& back() { return data_.back(); }
-  const value_type& back() const { return data_.back(); }
+  value_type& back() { return data_[offset_(size() - 1)]; }
+  const value_type& back() const { return data_[offset_(size() - 1)]; }
 
-  value_type& operator[](size_t idx) { return data_[idx]; }
-  const value_type& operator[](size_t idx) const { return data_[idx]; }
+  // Element idx in the order of the linear layout
+  value_type& operator[](size_t idx) { return data_[offset_(idx)]; }
+  const value_type& operator[](size_t idx) const { return data_[offset_(idx)]; }
 
   // Element access - 1D
   value_type& at(size_t x) { 
@@ -109,7 +171,7 @@ public:
     static_assert(std::is_integral<Y>::value && sizeof(Y) > 1, "");
     static_assert(std::is_integral<Z>::value && sizeof(Z) > 1, "");
     DASSERT(x < width() && y < height() && z < depth());
-    return data_[size_t(z)*width_mul_height_ + size_t(y)*width() + size_t(x)];
+    return data_[layout_.offset(size_t(x), size_t(y), size_t(z))];
   }
   template <typename X, typename Y, typename Z>
   const value_type& at(X x, Y y, Z z) const {
@@ -118,7 +180,7 @@ public:
     static_assert(std::is_integral<Y>::value && sizeof(Y) > 1, "");
     static_assert(std::is_integral<Z>::value && sizeof(Z) > 1, "");
     DASSERT(x < width() && y < height() && z < depth());
-    return data_[size_t(z)*width_mul_height_ + size_t(y)*width() + size_t(x)];
+    return data_[layout_.offset(size_t(x), size_t(y), size_t(z))];
   }
 
   // Fill
@@ -127,17 +189,10 @@ public:
     return *this;
   }
 
-  // Linear interpolation
+  // Bilinear interpolation, positions are clamped to the array, see marray_sample.h
   value_type atli(float x, float y) const {
-    auto lt = at(floor(x), floor(y));
-    auto rt = at(ceil(x), floor(y));
-    auto lb = at(floor(x), ceil(y));
-    auto rb = at(ceil(x), ceil(y));
-    auto xt = fmod(x, dims_[0]);
-    auto yt = fmod(y, dims_[1]);
-    auto ti = interpolate(lt, rt, xt);
-    auto bi = interpolate(lb, rb, xt);
-    return interpolate(ti, bi, yt);
+    STATIC_ASSERT(N == 2);
+    return util::_impl_marray_sample::to_element<value_type>(util::sample_bilinear(*this, x, y));
   }
 
   // Nearest neighbour interpolation
@@ -169,63 +224,60 @@ public:
   }
 
   
+  // 7 point average, border elements are copied
   my_type smooth() const {
-    auto ret = *this;
-    for (size_t x = 1; x + 1 < width(); ++x)
-      for (size_t y = 1; y + 1 < height(); ++y)
-        for (size_t z = 1; z + 1 < depth(); ++z) {
-          ret.at(x, y, z) = 
-            at(x+1, y  , z  ) + 
-            at(x  , y+1, z  ) + 
-            at(x  , y  , z+1) + 
-            at(x-1, y  , z  ) + 
-            at(x  , y-1, z  ) + 
-            at(x  , y  , z-1) + 
-            at(x  , y  , z  );
-          ret.at(x, y, z) /= 7;
-        }
+    static_assert(N == 3, "");
+    my_type ret(get_allocator());
+    ret.allocate_first_touch(width(), height(), depth());
+    util::apply_stencil<1>(*this, ret, [](const value_type* p, ptrdiff_t dy, ptrdiff_t dz) {
+      value_type sum = p[1] + p[dy] + p[dz] + p[-1] + p[-dy] + p[-dz] + p[0];
+      sum /= 7;
+      return sum;
+    });
     return ret;
   }
 
+  // Average of the 4 neighbours, border elements are copied
   my_type smooth2() const {
-    auto ret = *this;
-
-    pfor(size_t x, 1, width()-1) {
-      for (size_t y = 1; y + 1 < height(); ++y)
-        ret.at(x, y) = (
-          at(x-1, y) + 
-          at(x+1, y) + 
-          at(x, y-1) + 
-          at(x, y+1)
-          ) / 4;
-    };
+    static_assert(N == 2, "");
+    my_type ret(get_allocator());
+    ret.allocate_first_touch(width(), height());
+    util::apply_stencil<1>(*this, ret, [](const value_type* p, ptrdiff_t dy, ptrdiff_t) {
+      return (p[-1] + p[1] + p[-dy] + p[dy]) / 4;
+    });
     return ret;
   }
 
 
+  // Non-owning views of the elements, see marray_view.h
+  util::marray_view<value_type, N> view() {
+    static_assert(L::is_linear, "views require the linear layout");
+    return util::marray_view<value_type, N>(data(), width(), height(), depth());
+  }
+  util::const_marray_view<value_type, N> view() const {
+    static_assert(L::is_linear, "views require the linear layout");
+    return util::const_marray_view<value_type, N>(data(), width(), height(), depth());
+  }
+
+  // Pointers to the elements of the cube [x - w, x + w)^3, for a view of the same elements use view().crop()
   std::vector<value_type*> sub_range(int x, int y, int z, int w) {
     std::vector<value_type*> ret;
-    for (auto xt = x - w; xt < x + w; ++x)
-      for (auto yt = y - w; yt < y + w; ++y)
-        for (auto zt = z - w; zt < z + w; ++z) 
-          ret.push_back(&at(x,y,z));
+    for (auto xt = x - w; xt < x + w; ++xt)
+      for (auto yt = y - w; yt < y + w; ++yt)
+        for (auto zt = z - w; zt < z + w; ++zt) 
+          ret.push_back(&at(xt,yt,zt));
     return ret;
   }
 
+  // Copies of a region, for a view of the same elements use view().crop()
   my_type sub_marray(size_t xstart, size_t ystart, size_t w, size_t h) const {
     STATIC_ASSERT(N==2);
-    my_type ret(w,h);
-    loopm((auto x=w)(auto y=h))
-      ret.at(x,y) = this->at(x+xstart, y+ystart);
-    return ret;
+    return view().crop(xstart, ystart, w, h).to_marray(get_allocator());
   }
-
-  /*
-  my_type sub_marray(size_t x, size_t y, size_t z, size_t w, size_t h, size_t d) const {
+  my_type sub_marray(size_t xstart, size_t ystart, size_t zstart, size_t w, size_t h, size_t d) const {
     STATIC_ASSERT(N==3);
-    my_type ret(w,h,d);
+    return view().crop(xstart, ystart, zstart, w, h, d).to_marray(get_allocator());
   }
-  */
 
   math::Vec3<value_type> gradient(size_t x, size_t y, size_t z) const {
     static_assert(N == 3 && !std::is_unsigned<value_type>::value, "");
@@ -252,32 +304,55 @@ public:
     return sum;
   }
 
+  // Nearest neighbour resampling, see marray_resample.h for linear and cubic
   my_type resized_nn(const math::Vec3i& newSize) const {
     STATIC_ASSERT(N == 3);
-    auto ret = my_type(newSize.x, newSize.y, newSize.z);
-    for (size_t x = 0; x < ret.width(); ++x) {
-      for (size_t y = 0; y < ret.height(); ++y) {
-        for (size_t z = 0; z < ret.depth(); ++z) {
-          float xf = math::reinterval<float>((float)x, 0, (float)ret.width(), 0, (float)width());
-          float yf = math::reinterval<float>((float)y, 0, (float)ret.height(), 0, (float)height());
-          float zf = math::reinterval<float>((float)z, 0, (float)ret.depth(), 0, (float)depth());
-          ret.at(x, y, z) = atnn(xf, yf, zf);
-        }
-      }
-    }
-    return ret;
+    return util::resample(*this, (size_t)newSize.x, (size_t)newSize.y, (size_t)newSize.z, util::resample_nearest);
   }
 
+  // The storage in layout order, including the padding of non-linear layouts
   value_type* data() { return data_.data(); }
   const value_type* data() const { return data_.data(); }
-  const std::vector<value_type>& data_vector() const { return data_; }
+  // container_type is util::default_init_vector, a std::vector<T, util::default_init_allocator<T, A> >,
+  // use std::vector<T>(data_vector().begin(), data_vector().end()) where a std::vector<T> is required
+  const container_type& data_vector() const { return data_; }
+  allocator_type get_allocator() const { return data_.get_allocator(); }
+  const layout_type& layout() const { return layout_; }
 
-  std::vector<value_type> data_;
+  container_type data_;
 
 private:
+  void set_dims_(size_t w, size_t h, size_t d) {
+    dims_[0] = w;
+    dims_[1] = h;
+    dims_[2] = d;
+    width_mul_height_ = width() * height();
+    layout_.set_dims(w, h, d);
+  }
+  void reset_() {
+    data_.clear();
+    set_dims_(0, 0, 0);
+  }
+  size_t offset_(size_t idx) const {
+    if (L::is_linear)
+      return idx;
+    return layout_.offset(idx % width(), idx / width() % height(), idx / width_mul_height_);
+  }
+  template <typename VA>
+  container_type copy_container_(const std::vector<T, VA>& src) const {
+    container_type ret(get_allocator());
+    ret.assign(src.begin(), src.end());
+    return ret;
+  }
+  typedef std::integral_constant<bool, L::is_linear> is_linear_;
+  // Iterator to element 0 or size()
+  template <typename It, typename C>
+  It make_iterator_(C& data, size_t idx, std::true_type) const { return data.begin() + idx; }
+  template <typename It, typename C>
+  It make_iterator_(C& data, size_t idx, std::false_type) const { return It(data.data(), &layout_, 0, 0, idx == size() ? depth() : 0); }
   size_t width_mul_height_;
   std::array <size_t, 3> dims_;
-  IMPLEMENTS_ALL((data_)(dims_)(width_mul_height_));
+  layout_type layout_;
 };
 
 
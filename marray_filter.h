@@ -0,0 +1,384 @@
+//
+//  Marray Filter
+//    Separable filters for marray<T, N>, applied one axis at a time
+//    convolve_axis\convolve_separable: Arbitrary 1D kernel of odd size along one\every axis, O(k) per element
+//    gaussian_blur:                    Sampled gaussian kernel, O(sigma) per element
+//    box_blur:                         Mean of the 2 * radius + 1 elements along each axis, running sums
+//                                      make it O(1) per element regardless of the radius. With border_zero
+//                                      the mean of each box is read from a summed-area table instead
+//    fast_gaussian_blur:               Gaussian approximated by three box blurs, O(1) per element
+//    Lines along y and z are processed as whole segments of rows, hence the inner loops have unit stride
+//    and are vectorized. Rows and segments are distributed on the pfor threads.
+//
+//   USAGE:
+//     marray<float, 3> blurred = util::gaussian_blur(volume, 2.0);
+//     marray<float, 3> mean = util::box_blur(volume, 5, util::border_zero);
+//     const std::vector<float> derivative = { 0.5f, 0.0f, -0.5f };
+//     marray<float, 3> dx(volume.width(), volume.height(), volume.depth());
+//     util::convolve_axis(volume, dx, 0, derivative, util::border_mirror);
+//
+//  NOTES:
+//  - Border modes, for a line a b c d:
+//    border_clamp:  a a a | a b c d | d d d
+//    border_mirror: d c b | a b c d | c b a
+//    border_zero:   0 0 0 | a b c d | 0 0 0
+//  - Integral values are filtered in float, rounded and clamped to the range of T. Box sums are accumulated in
+//    double (int64_t\uint64_t in the summed-area table of integral values, which also rounds once instead of
+//    once per axis)
+//  - The kernel is applied as a correlation, ie kernel[0] weights the element at -radius
+//  - Requires the linear layout, see util::convert_layout
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "parallel_for.h"
+#include "marray_stencil.h"
+#include "marray_sample.h"
+#include "marray_integral.h"
+
+#ifndef MARRAY_FILTER_SEGMENT_SIZE // Elements of a row segment processed by one task along y and z
+#  define MARRAY_FILTER_SEGMENT_SIZE 2048
+#endif
+
+namespace util {
+
+
+enum border_mode { border_clamp, border_mirror, border_zero };
+
+
+namespace _impl_marray_filter {
+  using _impl_marray_sample::to_element;
+
+  // Floating point values are filtered in their own type, integral values in float
+  template <typename T>
+  struct weight_type { typedef typename std::conditional<std::is_floating_point<T>::value, T, float>::type type; };
+
+  // Index on a line of n elements to read for index i, or -1 for zero
+  inline ptrdiff_t border_index(ptrdiff_t i, ptrdiff_t n, border_mode mode) {
+    if (i >= 0 && i < n)
+      return i;
+    if (mode == border_zero)
+      return -1;
+    if (mode == border_clamp || n == 1)
+      return i < 0 ? 0 : n - 1;
+    const ptrdiff_t period = 2 * (n - 1);
+    i %= period;
+    if (i < 0)
+      i += period;
+    return i < n ? i : period - i;
+  }
+
+  // The array as outer * n * inner elements, where n is the size of the filtered axis
+  struct line_layout {
+    size_t outer;
+    size_t n;
+    size_t inner;
+  };
+  template <typename M>
+  line_layout make_layout(const M& m, size_t axis) {
+    static_assert(M::layout_type::is_linear, "marray filters require the linear layout, see util::convert_layout");
+    RASSERT_MSG(axis < M::dimensions, "Axis " << axis << " out of range");
+    const line_layout layouts[3] = {
+      { m.height() * m.depth(), m.width(), 1 },
+      { m.depth(), m.height(), m.width() },
+      { 1, m.depth(), m.width() * m.height() }
+    };
+    return layouts[axis];
+  }
+
+  // acc[i] += c * src[i], in blocks of constant size which are vectorized
+  template <typename A, typename S>
+  void multiply_add(A* acc, const S* src, A c, size_t n) {
+    const size_t block_size = 16;
+    size_t i = 0;
+    for (; i + block_size <= n; i += block_size) {
+      A* block_acc = acc + i;
+      const S* block_src = src + i;
+      MARRAY_STENCIL_IVDEP
+      for (size_t j = 0; j < block_size; ++j)
+        block_acc[j] += c * static_cast<A>(block_src[j]);
+    }
+    for (; i < n; ++i)
+      acc[i] += c * static_cast<A>(src[i]);
+  }
+  template <typename T, typename A>
+  void store(T* dst, const A* acc, A scale, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+      dst[i] = to_element<T>(acc[i] * scale);
+  }
+
+  // Padded copy of a row, buf[j] is the element at j - radius
+  template <typename T, typename A>
+  void pad_row(const T* row, size_t n, size_t radius, border_mode mode, std::vector<A>& buf) {
+    buf.resize(n + 2 * radius);
+    for (size_t j = 0; j < buf.size(); ++j) {
+      const ptrdiff_t idx = border_index(static_cast<ptrdiff_t>(j) - static_cast<ptrdiff_t>(radius), static_cast<ptrdiff_t>(n), mode);
+      buf[j] = idx < 0 ? A(0) : static_cast<A>(row[idx]);
+    }
+  }
+
+  // Calls f(outer, segment_start, segment_stop) for segments of the rows of lines along y or z, in parallel
+  template <typename F>
+  void for_each_segment(const line_layout& layout, const pfor_partitioner& partitioner, F f) {
+    const size_t segment_size = MARRAY_FILTER_SEGMENT_SIZE;
+    const size_t num_segments = (layout.inner + segment_size - 1) / segment_size;
+    partitioner.for_each_chunk(size_t(0), layout.outer * num_segments, [&](size_t start, size_t stop) {
+      for (size_t task = start; task < stop; ++task) {
+        const size_t segment_start = (task % num_segments) * segment_size;
+        f(task / num_segments, segment_start, std::min(layout.inner, segment_start + segment_size));
+      }
+    });
+  }
+
+  template <typename T, typename W>
+  void convolve(const T* src, T* dst, const line_layout& layout, const W* kernel, size_t kernel_size, border_mode mode, const pfor_partitioner& partitioner) {
+    const size_t radius = kernel_size / 2;
+    const ptrdiff_t n = static_cast<ptrdiff_t>(layout.n);
+    if (layout.inner == 1) {
+      // Along x, rows are padded and convolved in place
+      partitioner.for_each_chunk(size_t(0), layout.outer, [&](size_t start, size_t stop) {
+        std::vector<W> buf;
+        std::vector<W> acc(layout.n);
+        for (size_t row = start; row < stop; ++row) {
+          pad_row(src + row * layout.n, layout.n, radius, mode, buf);
+          std::fill(acc.begin(), acc.end(), W(0));
+          for (size_t k = 0; k < kernel_size; ++k)
+            multiply_add(acc.data(), buf.data() + k, kernel[k], layout.n);
+          store(dst + row * layout.n, acc.data(), W(1), layout.n);
+        }
+      });
+      return;
+    }
+    for_each_segment(layout, partitioner, [&](size_t outer, size_t segment_start, size_t segment_stop) {
+      const size_t len = segment_stop - segment_start;
+      const T* lines = src + outer * layout.n * layout.inner + segment_start;
+      T* out = dst + outer * layout.n * layout.inner + segment_start;
+      std::vector<W> acc(len);
+      for (ptrdiff_t i = 0; i < n; ++i) {
+        std::fill(acc.begin(), acc.end(), W(0));
+        for (size_t k = 0; k < kernel_size; ++k) {
+          const ptrdiff_t j = border_index(i + static_cast<ptrdiff_t>(k) - static_cast<ptrdiff_t>(radius), n, mode);
+          if (j >= 0)
+            multiply_add(acc.data(), lines + static_cast<size_t>(j) * layout.inner, kernel[k], len);
+        }
+        store(out + static_cast<size_t>(i) * layout.inner, acc.data(), W(1), len);
+      }
+    });
+  }
+
+  template <typename T>
+  void box(const T* src, T* dst, const line_layout& layout, size_t radius, border_mode mode, const pfor_partitioner& partitioner) {
+    const ptrdiff_t n = static_cast<ptrdiff_t>(layout.n);
+    const ptrdiff_t r = static_cast<ptrdiff_t>(radius);
+    const double scale = 1.0 / static_cast<double>(2 * radius + 1);
+    if (layout.inner == 1) {
+      partitioner.for_each_chunk(size_t(0), layout.outer, [&](size_t start, size_t stop) {
+        std::vector<double> buf;
+        for (size_t row = start; row < stop; ++row) {
+          pad_row(src + row * layout.n, layout.n, radius, mode, buf);
+          T* out = dst + row * layout.n;
+          double sum = 0;
+          for (size_t k = 0; k < 2 * radius; ++k)
+            sum += buf[k];
+          for (size_t x = 0; x < layout.n; ++x) {
+            sum += buf[x + 2 * radius];
+            out[x] = to_element<T>(sum * scale);
+            sum -= buf[x];
+          }
+        }
+      });
+      return;
+    }
+    for_each_segment(layout, partitioner, [&](size_t outer, size_t segment_start, size_t segment_stop) {
+      const size_t len = segment_stop - segment_start;
+      const T* lines = src + outer * layout.n * layout.inner + segment_start;
+      T* out = dst + outer * layout.n * layout.inner + segment_start;
+      auto line = [&](ptrdiff_t i) -> const T* {
+        const ptrdiff_t j = border_index(i, n, mode);
+        return j < 0 ? nullptr : lines + static_cast<size_t>(j) * layout.inner;
+      };
+      // Running sum of the window [i - r, i + r]
+      std::vector<double> sum(len, 0.0);
+      for (ptrdiff_t k = -r; k < r; ++k) {
+        if (const T* row = line(k))
+          multiply_add(sum.data(), row, 1.0, len);
+      }
+      for (ptrdiff_t i = 0; i < n; ++i) {
+        if (const T* row = line(i + r))
+          multiply_add(sum.data(), row, 1.0, len);
+        store(out + static_cast<size_t>(i) * layout.inner, sum.data(), scale, len);
+        if (const T* row = line(i - r))
+          multiply_add(sum.data(), row, -1.0, len);
+      }
+    });
+  }
+
+  template <typename M>
+  M make_like(const M& src) {
+    M ret(src.get_allocator());
+    ret.allocate_first_touch(src.width(), src.height(), src.depth());
+    return ret;
+  }
+
+  // Box mean with zeros outside src, each output row combines the table rows at the corners of its boxes
+  template <typename M>
+  M box_integral(const M& src, size_t radius, const pfor_partitioner& partitioner) {
+    static_assert(M::layout_type::is_linear, "marray filters require the linear layout, see util::convert_layout");
+    typedef typename M::value_type T;
+    typedef typename integral_sum_type<T>::type S;
+    const size_t N = M::dimensions;
+    const marray_integral<T, N> sat(src, false, partitioner);
+    M ret = make_like(src);
+    const size_t w = src.width();
+    const size_t h = src.height();
+    const size_t d = src.depth();
+    const double scale = 1.0 / std::pow(static_cast<double>(2 * radius + 1), static_cast<double>(N));
+    partitioner.for_each_chunk(size_t(0), h * d, [&](size_t start, size_t stop) {
+      std::vector<S> columns(w + 1);
+      for (size_t yz = start; yz < stop; ++yz) {
+        const size_t y = yz % h;
+        const size_t z = yz / h;
+        const size_t y0 = y > radius ? y - radius : 0;
+        const size_t y1 = std::min(h, y + radius + 1);
+        const size_t z0 = N == 3 && z > radius ? z - radius : 0;
+        const size_t z1 = N == 3 ? std::min(d, z + radius + 1) : 0;
+        // Sums of [0, x) * [y0, y1) * [z0, z1)
+        const S* upper_y1 = sat.table_row(y1, z1);
+        const S* upper_y0 = sat.table_row(y0, z1);
+        if (N == 3) {
+          const S* lower_y1 = sat.table_row(y1, z0);
+          const S* lower_y0 = sat.table_row(y0, z0);
+          for (size_t x = 0; x <= w; ++x)
+            columns[x] = upper_y1[x] - upper_y0[x] - lower_y1[x] + lower_y0[x];
+        }
+        else {
+          for (size_t x = 0; x <= w; ++x)
+            columns[x] = upper_y1[x] - upper_y0[x];
+        }
+        T* out = ret.data() + yz * w;
+        for (size_t x = 0; x < w; ++x) {
+          const size_t x0 = x > radius ? x - radius : 0;
+          const size_t x1 = std::min(w, x + radius + 1);
+          out[x] = to_element<T>(static_cast<double>(columns[x1] - columns[x0]) * scale);
+        }
+      }
+    });
+    return ret;
+  }
+
+  // Sizes of three boxes approximating a gaussian
+  inline std::array<size_t, 3> gaussian_box_radii(double sigma) {
+    const double num_boxes = 3;
+    size_t lower = static_cast<size_t>(std::floor(std::sqrt(12 * sigma * sigma / num_boxes + 1)));
+    if (lower % 2 == 0)
+      --lower;
+    const double wl = static_cast<double>(lower);
+    const double num_lower = std::round((12 * sigma * sigma - num_boxes * wl * wl - 4 * num_boxes * wl - 3 * num_boxes) / (-4 * wl - 4));
+    std::array<size_t, 3> radii;
+    for (size_t i = 0; i < 3; ++i)
+      radii[i] = (static_cast<double>(i) < num_lower ? lower : lower + 2) / 2;
+    return radii;
+  }
+} // namespace _impl_marray_filter
+
+
+// Convolves src along axis with kernel (of odd size), result in dst which must have the size of src
+template <typename M, typename W>
+void convolve_axis(const M& src, M& dst, size_t axis, const std::vector<W>& kernel, border_mode mode = border_clamp, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  typedef typename _impl_marray_filter::weight_type<typename M::value_type>::type weight_type;
+  RASSERT_MSG(kernel.size() % 2 == 1, "convolve_axis: kernel size must be odd");
+  RASSERT(src.width() == dst.width() && src.height() == dst.height() && src.depth() == dst.depth());
+  DASSERT(src.empty() || src.data() != dst.data());
+  const std::vector<weight_type> weights(kernel.begin(), kernel.end());
+  _impl_marray_filter::convolve(src.data(), dst.data(), _impl_marray_filter::make_layout(src, axis), weights.data(), weights.size(), mode, partitioner);
+}
+
+// Convolves src along every axis with kernel
+template <typename M, typename W>
+M convolve_separable(const M& src, const std::vector<W>& kernel, border_mode mode = border_clamp, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  M ret = _impl_marray_filter::make_like(src);
+  convolve_axis(src, ret, 0, kernel, mode, partitioner);
+  if (M::dimensions > 1) {
+    M tmp = _impl_marray_filter::make_like(src);
+    for (size_t axis = 1; axis < M::dimensions; ++axis) {
+      convolve_axis(ret, tmp, axis, kernel, mode, partitioner);
+      std::swap(ret, tmp);
+    }
+  }
+  return ret;
+}
+
+// Normalized gaussian kernel of 2 * radius + 1 weights, radius defaults to ceil(3 * sigma)
+template <typename W = float>
+std::vector<W> gaussian_kernel(double sigma, size_t radius = size_t(-1)) {
+  RASSERT_MSG(sigma > 0, "gaussian_kernel: sigma must be positive");
+  if (radius == size_t(-1))
+    radius = static_cast<size_t>(std::ceil(3 * sigma));
+  std::vector<double> weights(2 * radius + 1);
+  double sum = 0;
+  for (size_t i = 0; i < weights.size(); ++i) {
+    const double x = static_cast<double>(i) - static_cast<double>(radius);
+    weights[i] = std::exp(-x * x / (2 * sigma * sigma));
+    sum += weights[i];
+  }
+  std::vector<W> kernel(weights.size());
+  for (size_t i = 0; i < weights.size(); ++i)
+    kernel[i] = static_cast<W>(weights[i] / sum);
+  return kernel;
+}
+
+template <typename M>
+M gaussian_blur(const M& src, double sigma, border_mode mode = border_clamp, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  typedef typename _impl_marray_filter::weight_type<typename M::value_type>::type weight_type;
+  return convolve_separable(src, gaussian_kernel<weight_type>(sigma), mode, partitioner);
+}
+
+// Mean of the 2 * radius + 1 elements along axis
+template <typename M>
+void box_blur_axis(const M& src, M& dst, size_t axis, size_t radius, border_mode mode = border_clamp, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  RASSERT(src.width() == dst.width() && src.height() == dst.height() && src.depth() == dst.depth());
+  DASSERT(src.empty() || src.data() != dst.data());
+  _impl_marray_filter::box(src.data(), dst.data(), _impl_marray_filter::make_layout(src, axis), radius, mode, partitioner);
+}
+
+// Mean of the (2 * radius + 1)^N box around each element
+template <typename M>
+M box_blur(const M& src, size_t radius, border_mode mode = border_clamp, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  if (mode == border_zero && M::dimensions > 1)
+    return _impl_marray_filter::box_integral(src, radius, partitioner);
+  M ret = _impl_marray_filter::make_like(src);
+  box_blur_axis(src, ret, 0, radius, mode, partitioner);
+  if (M::dimensions > 1) {
+    M tmp = _impl_marray_filter::make_like(src);
+    for (size_t axis = 1; axis < M::dimensions; ++axis) {
+      box_blur_axis(ret, tmp, axis, radius, mode, partitioner);
+      std::swap(ret, tmp);
+    }
+  }
+  return ret;
+}
+
+// Gaussian approximated by three successive box blurs along each axis
+template <typename M>
+M fast_gaussian_blur(const M& src, double sigma, border_mode mode = border_clamp, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  RASSERT_MSG(sigma > 0, "fast_gaussian_blur: sigma must be positive");
+  const std::array<size_t, 3> radii = _impl_marray_filter::gaussian_box_radii(sigma);
+  M ret = src;
+  M tmp = _impl_marray_filter::make_like(src);
+  for (size_t axis = 0; axis < M::dimensions; ++axis) {
+    for (size_t i = 0; i < radii.size(); ++i) {
+      box_blur_axis(ret, tmp, axis, radii[i], mode, partitioner);
+      std::swap(ret, tmp);
+    }
+  }
+  return ret;
+}
+
+
+} // namespace util
@@ -0,0 +1,186 @@
+//
+//  Marray Gradient
+//    Whole volume gradient and curvature kernels for marray<T, 3>, computing each voxel's gradient once.
+//    Same values as marray::gradient(x, y, z) and marray::curvature(x, y, z), ie the central difference
+//    (f(x-1) - f(x+1)) / 2 per axis and the sum of the gradient distances to the 6 face neighbours.
+//    compute_gradient_field:   Gradient as three component volumes (structure of arrays)
+//    gradient_length_volume:   Gradient magnitude, streamed slab by slab without storing the gradient
+//    curvature_length_volume:  Curvature, gradients are kept in a rolling buffer of 3 slabs per thread
+//    gradient_and_curvature:   Both in one pass
+//
+//   USAGE:
+//     marray<float, 3> curvature = util::curvature_length_volume(volume);
+//     marray<float, 3> magnitude, curvature;
+//     util::gradient_and_curvature(volume, &magnitude, &curvature);
+//     util::gradient_field<float> g = util::compute_gradient_field(volume);
+//     float dx = g.x.at(10, 20, 30);
+//
+//  NOTES:
+//  - Gradients are defined 1 voxel and curvatures 2 voxels from the faces, the other voxels are zero
+//  - The slabs along z are distributed on the pfor threads, memory use besides the results is 9 slabs per thread
+//  - Requires the linear layout, see util::convert_layout
+//
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "parallel_for.h"
+#include "marray_layout.h"
+
+template <typename T, size_t N, typename A, typename L> class marray;
+
+namespace util {
+
+
+// Gradient as component volumes
+template <typename T, typename A = std::allocator<T> >
+struct gradient_field {
+  marray<T, 3, A, marray_layout_linear> x;
+  marray<T, 3, A, marray_layout_linear> y;
+  marray<T, 3, A, marray_layout_linear> z;
+};
+
+
+namespace _impl_marray_gradient {
+  // Gradient components of a slab, rows [1, h - 1) with elements [1, w - 1) are defined
+  template <typename T>
+  struct slab {
+    void resize(size_t n) {
+      x.resize(n);
+      y.resize(n);
+      z.resize(n);
+    }
+    std::vector<T> x;
+    std::vector<T> y;
+    std::vector<T> z;
+  };
+
+  template <typename T>
+  void compute_slab(const T* f, size_t w, size_t h, size_t z, T* gx, T* gy, T* gz) {
+    const T minus_two = T(-2);
+    const size_t dz = w * h;
+    for (size_t y = 1; y + 1 < h; ++y) {
+      const T* p = f + z * dz + y * w;
+      const size_t row = y * w;
+      for (size_t x = 1; x + 1 < w; ++x) {
+        gx[row + x] = (p[x + 1] - p[x - 1]) / minus_two;
+        gy[row + x] = (p[x + w] - p[x - w]) / minus_two;
+        gz[row + x] = (p[x + dz] - p[x - dz]) / minus_two;
+      }
+    }
+  }
+
+  template <typename T>
+  T length(T x, T y, T z) { return std::sqrt(x * x + y * y + z * z); }
+
+  template <typename T>
+  T distance(const slab<T>& a, size_t ia, const slab<T>& b, size_t ib) {
+    return length(a.x[ia] - b.x[ib], a.y[ia] - b.y[ib], a.z[ia] - b.z[ib]);
+  }
+
+  // Slabs [z_start, z_stop) of the requested outputs, null outputs are skipped
+  template <typename T>
+  void process_slabs(const T* f, size_t w, size_t h, size_t d, size_t z_start, size_t z_stop, T* magnitude, T* curvature) {
+    const size_t dz = w * h;
+    slab<T> ring[3];
+    for (size_t i = 0; i < 3; ++i)
+      ring[i].resize(dz);
+    // Gradient slabs z - 1, z and z + 1 are needed for the curvature of z
+    const size_t g_start = curvature != nullptr ? std::max<size_t>(z_start, 2) - 1 : std::max<size_t>(z_start, 1);
+    const size_t g_stop = curvature != nullptr ? std::min(z_stop + 1, d - 1) : std::min(z_stop, d - 1);
+    for (size_t gz = g_start; gz < g_stop; ++gz) {
+      slab<T>& s = ring[gz % 3];
+      compute_slab(f, w, h, gz, s.x.data(), s.y.data(), s.z.data());
+      if (magnitude != nullptr && gz >= z_start && gz < z_stop) {
+        T* out = magnitude + gz * dz;
+        for (size_t y = 1; y + 1 < h; ++y) {
+          for (size_t x = 1, i = y * w + 1; x + 1 < w; ++x, ++i)
+            out[i] = length(s.x[i], s.y[i], s.z[i]);
+        }
+      }
+      // Gradient slab gz completes the neighbourhood of the curvature slab gz - 1
+      const size_t cz = gz - 1;
+      if (curvature == nullptr || cz < 2 || cz + 2 >= d || cz < z_start || cz >= z_stop)
+        continue;
+      const slab<T>& prev = ring[(cz - 1) % 3];
+      const slab<T>& cur = ring[cz % 3];
+      const slab<T>& next = ring[gz % 3];
+      T* out = curvature + cz * dz;
+      for (size_t y = 2; y + 2 < h; ++y) {
+        for (size_t x = 2, i = y * w + 2; x + 2 < w; ++x, ++i) {
+          T sum = 0;
+          sum += distance(cur, i, cur, i + 1);
+          sum += distance(cur, i, cur, i + w);
+          sum += distance(cur, i, next, i);
+          sum += distance(cur, i, cur, i - 1);
+          sum += distance(cur, i, cur, i - w);
+          sum += distance(cur, i, prev, i);
+          out[i] = sum;
+        }
+      }
+    }
+  }
+
+  template <typename T, typename A, typename L>
+  void allocate_like(const marray<T, 3, A, L>& f, marray<T, 3, A, L>& m, const pfor_partitioner& partitioner) {
+    m = marray<T, 3, A, L>(f.get_allocator());
+    m.allocate_first_touch(f.width(), f.height(), f.depth(), partitioner);
+  }
+} // namespace _impl_marray_gradient
+
+
+template <typename T, typename A, typename L>
+gradient_field<T, A> compute_gradient_field(const marray<T, 3, A, L>& f, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  static_assert(!std::is_unsigned<T>::value, "");
+  static_assert(L::is_linear, "compute_gradient_field requires the linear layout, see util::convert_layout");
+  gradient_field<T, A> g;
+  _impl_marray_gradient::allocate_like(f, g.x, partitioner);
+  _impl_marray_gradient::allocate_like(f, g.y, partitioner);
+  _impl_marray_gradient::allocate_like(f, g.z, partitioner);
+  const size_t w = f.width();
+  const size_t h = f.height();
+  const size_t d = f.depth();
+  partitioner.for_each_chunk(size_t(0), d, [&](size_t start, size_t stop) {
+    for (size_t z = std::max<size_t>(start, 1); z < std::min(stop, d - 1); ++z)
+      _impl_marray_gradient::compute_slab(f.data(), w, h, z, g.x.data() + z * w * h, g.y.data() + z * w * h, g.z.data() + z * w * h);
+  });
+  return g;
+}
+
+// Gradient magnitude and\or curvature in one pass, pass null for an unwanted result
+template <typename T, typename A, typename L>
+void gradient_and_curvature(const marray<T, 3, A, L>& f, marray<T, 3, A, L>* magnitude, marray<T, 3, A, L>* curvature, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  static_assert(!std::is_unsigned<T>::value, "");
+  static_assert(L::is_linear, "gradient_and_curvature requires the linear layout, see util::convert_layout");
+  if (magnitude != nullptr)
+    _impl_marray_gradient::allocate_like(f, *magnitude, partitioner);
+  if (curvature != nullptr)
+    _impl_marray_gradient::allocate_like(f, *curvature, partitioner);
+  if (f.width() < 3 || f.height() < 3 || f.depth() < 3)
+    return;
+  T* magnitude_data = magnitude != nullptr ? magnitude->data() : nullptr;
+  T* curvature_data = curvature != nullptr ? curvature->data() : nullptr;
+  partitioner.for_each_chunk(size_t(0), f.depth(), [&](size_t start, size_t stop) {
+    _impl_marray_gradient::process_slabs(f.data(), f.width(), f.height(), f.depth(), start, stop, magnitude_data, curvature_data);
+  });
+}
+
+template <typename T, typename A, typename L>
+marray<T, 3, A, L> gradient_length_volume(const marray<T, 3, A, L>& f, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  marray<T, 3, A, L> magnitude;
+  gradient_and_curvature(f, &magnitude, static_cast<marray<T, 3, A, L>*>(nullptr), partitioner);
+  return magnitude;
+}
+
+template <typename T, typename A, typename L>
+marray<T, 3, A, L> curvature_length_volume(const marray<T, 3, A, L>& f, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  marray<T, 3, A, L> curvature;
+  gradient_and_curvature(f, static_cast<marray<T, 3, A, L>*>(nullptr), &curvature, partitioner);
+  return curvature;
+}
+
+
+} // namespace util
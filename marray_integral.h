@@ -0,0 +1,243 @@
+//
+//  Marray Integral
+//    Summed-area table of a 2D or 3D array, ie the integral image\volume. Element (x, y, z) of the table is the
+//    sum of the elements of [0, x) * [0, y) * [0, z), hence the sum over any box is a combination of 2 ^ N table
+//    elements. The table is built with one inclusive scan per axis, in 3D the scans along x and y are fused
+//    slab by slab and lines along z are scanned as whole segments of slabs, distributed on the pfor threads.
+//    The sums are accumulated in a wider type, int64_t\uint64_t for integral elements and double otherwise.
+//
+//   USAGE:
+//     util::marray_integral<float, 2> sat(image);
+//     double s = sat.sum(10, 20, 30, 40);                     // Sum of [10, 30) * [20, 40)
+//     double m = sat.mean(10, 20, 30, 40);
+//     util::marray_integral<uint8_t, 3> sat3(volume, true);   // Also tabulates the squares for variance()
+//     double v = sat3.variance(0, 0, 0, 8, 8, 8);
+//
+//  NOTES:
+//  - Boxes are half-open, [x0, x1) * [y0, y1) * [z0, z1), and must lie within the array
+//  - The table has one more element than the array along each axis, the first being zero
+//  - Works on any layout and on marray_view
+//  - box_blur with border_zero is computed through a summed-area table, see marray_filter.h
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "parallel_for.h"
+#include "uninitialized_vector.h"
+#include "marray_layout.h"
+#include "marray_stencil.h"
+
+#ifndef MARRAY_INTEGRAL_SEGMENT_SIZE // Elements of a row segment scanned by one task along y and z
+#  define MARRAY_INTEGRAL_SEGMENT_SIZE 2048
+#endif
+
+namespace util {
+
+
+// Accumulator type of the sums of T
+template <typename T>
+struct integral_sum_type {
+  typedef typename std::conditional<
+    std::is_floating_point<T>::value, double, typename std::conditional<
+    std::is_signed<T>::value, int64_t, uint64_t>::type>::type type;
+};
+
+
+namespace _impl_marray_integral {
+  // dst[i] += src[i], in blocks of constant size which are vectorized
+  template <typename S>
+  void add(S* dst, const S* src, size_t n) {
+    const size_t block_size = 16;
+    size_t i = 0;
+    for (; i + block_size <= n; i += block_size) {
+      S* block_dst = dst + i;
+      const S* block_src = src + i;
+      MARRAY_STENCIL_IVDEP
+      for (size_t j = 0; j < block_size; ++j)
+        block_dst[j] += block_src[j];
+    }
+    for (; i < n; ++i)
+      dst[i] += src[i];
+  }
+
+  // Inclusive scan of outer groups of n lines of inner elements, the lines inner elements apart
+  template <typename S>
+  void scan_lines(S* table, size_t outer, size_t n, size_t inner, const pfor_partitioner& partitioner) {
+    const size_t segment_size = MARRAY_INTEGRAL_SEGMENT_SIZE;
+    const size_t num_segments = (inner + segment_size - 1) / segment_size;
+    partitioner.for_each_chunk(size_t(0), outer * num_segments, [&](size_t start, size_t stop) {
+      for (size_t task = start; task < stop; ++task) {
+        const size_t segment_start = (task % num_segments) * segment_size;
+        const size_t len = std::min(inner, segment_start + segment_size) - segment_start;
+        S* lines = table + (task / num_segments) * n * inner + segment_start;
+        for (size_t i = 1; i < n; ++i)
+          add(lines + i * inner, lines + (i - 1) * inner, len);
+      }
+    });
+  }
+} // namespace _impl_marray_integral
+
+
+template <typename T, size_t N, typename S = typename integral_sum_type<T>::type>
+class marray_integral {
+public:
+  static_assert(N == 2 || N == 3, "marray_integral is 2D or 3D");
+  static const size_t dimensions = N;
+  typedef T value_type;
+  typedef S sum_type;
+
+  marray_integral() : w_(0), h_(0), d_(0) {}
+  // with_squares also tabulates the squares of the elements, which variance() requires
+  template <typename M>
+  explicit marray_integral(const M& src, bool with_squares = false, const pfor_partitioner& partitioner = pfor_partitioner()) : w_(0), h_(0), d_(0) {
+    reset(src, with_squares, partitioner);
+  }
+
+  template <typename M>
+  void reset(const M& src, bool with_squares = false, const pfor_partitioner& partitioner = pfor_partitioner()) {
+    static_assert(M::dimensions == N, "");
+    w_ = src.width();
+    h_ = src.height();
+    d_ = src.depth();
+    const size_t tw = w_ + 1;
+    const size_t th = h_ + 1;
+    const size_t td = N == 3 ? d_ + 1 : 1;
+    squares_.clear();
+    if (w_ * h_ * d_ == 0) {
+      sums_.assign(tw * th * td, S(0));
+      if (with_squares)
+        squares_.assign(sums_.size(), 0.0);
+      return;
+    }
+    sums_.resize_uninitialized(tw * th * td);
+    if (with_squares)
+      squares_.resize_uninitialized(sums_.size());
+    // The first slab in 3D, and the first row and element of every row, are zero
+    const size_t first_slab = N == 3 ? 1 : 0;
+    std::fill(sums_.begin(), sums_.begin() + first_slab * tw * th, S(0));
+    std::fill(squares_.begin(), squares_.begin() + (with_squares ? first_slab * tw * th : 0), 0.0);
+    // Rows are scanned along x and added to the row above, ie the scans along x and y are fused within a slab.
+    // In 2D the slab is a single task, hence the rows are scanned on their own and along y afterwards
+    const bool is_fused = N == 3;
+    const size_t num_tasks = is_fused ? d_ : h_ * d_;
+    partitioner.for_each_chunk(size_t(0), num_tasks, [&](size_t start, size_t stop) {
+      std::vector<T> row(w_);
+      for (size_t task = start; task < stop; ++task) {
+        const size_t z = is_fused ? task : 0;
+        const size_t y_start = is_fused ? 0 : task;
+        const size_t y_stop = is_fused ? h_ : task + 1;
+        if (y_start == 0) {
+          std::fill_n(sums_.data() + index_(0, 0, z + first_slab), tw, S(0));
+          if (with_squares)
+            std::fill_n(squares_.data() + index_(0, 0, z + first_slab), tw, 0.0);
+        }
+        for (size_t y = y_start; y < y_stop; ++y) {
+          layout_read_row(src.layout(), static_cast<const T*>(src.data()), 0, y, z, w_, row.data());
+          const size_t offset = index_(0, y + 1, z + first_slab);
+          scan_row_(sums_.data() + offset, row.data(), is_fused ? sums_.data() + offset - tw : nullptr, [](T v) { return static_cast<S>(v); });
+          if (with_squares)
+            scan_row_(squares_.data() + offset, row.data(), is_fused ? squares_.data() + offset - tw : nullptr, [](T v) { return static_cast<double>(v) * static_cast<double>(v); });
+        }
+      }
+    });
+    // Along y in 2D, along z in 3D
+    _impl_marray_integral::scan_lines(sums_.data(), 1, is_fused ? td : th, is_fused ? tw * th : tw, partitioner);
+    if (with_squares)
+      _impl_marray_integral::scan_lines(squares_.data(), 1, is_fused ? td : th, is_fused ? tw * th : tw, partitioner);
+  }
+
+  size_t width() const { return w_; }
+  size_t height() const { return h_; }
+  size_t depth() const { return d_; }
+  bool empty() const { return w_ * h_ * d_ == 0; }
+  bool has_squares() const { return !squares_.empty(); }
+  // Table element (x, y, z), the sum of [0, x) * [0, y) * [0, z)
+  S table(size_t x, size_t y, size_t z = 0) const { return sums_[index_(x, y, z)]; }
+  // The width() + 1 table elements (0, y, z) to (width(), y, z)
+  const S* table_row(size_t y, size_t z = 0) const { return sums_.data() + index_(0, y, z); }
+
+  // Sums of boxes
+  S sum(size_t x0, size_t y0, size_t x1, size_t y1) const {
+    static_assert(N == 2, "");
+    DASSERT(x0 <= x1 && x1 <= w_ && y0 <= y1 && y1 <= h_);
+    return box_(sums_, x0, y0, 0, x1, y1, 1);
+  }
+  S sum(size_t x0, size_t y0, size_t z0, size_t x1, size_t y1, size_t z1) const {
+    static_assert(N == 3, "");
+    DASSERT(x0 <= x1 && x1 <= w_ && y0 <= y1 && y1 <= h_ && z0 <= z1 && z1 <= d_);
+    return box_(sums_, x0, y0, z0, x1, y1, z1);
+  }
+
+  // Means and variances of non-empty boxes
+  double mean(size_t x0, size_t y0, size_t x1, size_t y1) const {
+    return static_cast<double>(sum(x0, y0, x1, y1)) / count_(x0, y0, 0, x1, y1, 1);
+  }
+  double mean(size_t x0, size_t y0, size_t z0, size_t x1, size_t y1, size_t z1) const {
+    return static_cast<double>(sum(x0, y0, z0, x1, y1, z1)) / count_(x0, y0, z0, x1, y1, z1);
+  }
+  double variance(size_t x0, size_t y0, size_t x1, size_t y1) const {
+    static_assert(N == 2, "");
+    return variance_(x0, y0, 0, x1, y1, 1, mean(x0, y0, x1, y1));
+  }
+  double variance(size_t x0, size_t y0, size_t z0, size_t x1, size_t y1, size_t z1) const {
+    static_assert(N == 3, "");
+    return variance_(x0, y0, z0, x1, y1, z1, mean(x0, y0, z0, x1, y1, z1));
+  }
+
+private:
+  size_t index_(size_t x, size_t y, size_t z) const { return (z * (h_ + 1) + y) * (w_ + 1) + x; }
+
+  // dst[x + 1] = above[x + 1] + f(row[0]) + ... + f(row[x]), dst[0] = 0, no above in the first row
+  template <typename U, typename F>
+  void scan_row_(U* dst, const T* row, const U* above, F f) const {
+    U sum = U(0);
+    dst[0] = U(0);
+    if (above) {
+      for (size_t x = 0; x < w_; ++x) {
+        sum += f(row[x]);
+        dst[x + 1] = above[x + 1] + sum;
+      }
+    }
+    else {
+      for (size_t x = 0; x < w_; ++x) {
+        sum += f(row[x]);
+        dst[x + 1] = sum;
+      }
+    }
+  }
+
+  // Inclusion-exclusion of the corners, in 2D the table is the single slab z = 0
+  template <typename V>
+  typename V::value_type box_(const V& t, size_t x0, size_t y0, size_t z0, size_t x1, size_t y1, size_t z1) const {
+    typedef typename V::value_type U;
+    if (N == 2) {
+      return t[index_(x1, y1, 0)] - t[index_(x0, y1, 0)] - t[index_(x1, y0, 0)] + t[index_(x0, y0, 0)];
+    }
+    const U upper = t[index_(x1, y1, z1)] - t[index_(x0, y1, z1)] - t[index_(x1, y0, z1)] + t[index_(x0, y0, z1)];
+    const U lower = t[index_(x1, y1, z0)] - t[index_(x0, y1, z0)] - t[index_(x1, y0, z0)] + t[index_(x0, y0, z0)];
+    return upper - lower;
+  }
+  double count_(size_t x0, size_t y0, size_t z0, size_t x1, size_t y1, size_t z1) const {
+    const double count = static_cast<double>((x1 - x0) * (y1 - y0) * (z1 - z0));
+    DASSERT(count > 0);
+    return count;
+  }
+  double variance_(size_t x0, size_t y0, size_t z0, size_t x1, size_t y1, size_t z1, double mean) const {
+    RASSERT_MSG(has_squares(), "marray_integral: variance requires the table of squares");
+    const double mean_square = box_(squares_, x0, y0, z0, x1, y1, z1) / count_(x0, y0, z0, x1, y1, z1);
+    return std::max(0.0, mean_square - mean * mean);
+  }
+
+  size_t w_;
+  size_t h_;
+  size_t d_;
+  default_init_vector<S> sums_;
+  default_init_vector<double> squares_;
+};
+
+
+} // namespace util
@@ -0,0 +1,288 @@
+//
+//  Marray Layout
+//    Memory layout policies of marray, the 4th template parameter, mapping (x, y, z) to an offset in the storage.
+//    marray_layout_linear:    Row major, x + (y + z * height) * width, the default
+//    marray_layout_brick<B>:  Bricks of B * B * B elements stored contiguously and linearly within the brick,
+//                             the bricks are ordered row major. Sides are padded to multiples of B
+//    marray_layout_morton:    Z-order, the bits of x, y and z are interleaved. Axes with fewer bits than the
+//                             others are left out of the interleaving once their bits run out, hence the
+//                             storage is at most the size padded to powers of 2 along each axis
+//    Neighbours along y and z are B resp. B * B elements apart within a brick, and on average close in Z-order,
+//    which keeps stencils and random sampling within fewer cache lines and pages than the linear layout.
+//
+//   USAGE:
+//     typedef marray<float, 3, std::allocator<float>, util::marray_layout_brick<8> > brick_volume;
+//     brick_volume bricks = util::convert_layout<util::marray_layout_brick<8> >(volume);
+//     float v = bricks.at(10, 20, 30);              // at(), iterators, smooth(), gradient() etc are layout-agnostic
+//     marray<float, 3> linear = util::convert_layout<util::marray_layout_linear>(bricks);
+//
+//     Layout policy interface
+//     void set_dims(size_t w, size_t h, size_t d);
+//     size_t storage_size() const;                  // Elements including padding
+//     size_t offset(size_t x, size_t y, size_t z) const;
+//     size_t run_length(size_t x) const;            // Elements from x along x at consecutive offsets
+//     bool has_strided_rows() const;                // Rows along x are contiguous and rows\slabs a constant offset apart
+//
+//  NOTES:
+//  - Non-linear layouts are 3D only
+//  - data() exposes the storage in layout order including padding, padding elements are value-initialized
+//  - The pointer based algorithms (marray_filter.h, marray_gradient.h, serialization) require the linear layout,
+//    convert_layout in parallel is a single pass of row copies
+//
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+#include "parallel_for.h"
+
+template <typename T, size_t N, typename A, typename L> class marray;
+
+namespace util {
+
+
+namespace _impl_marray_layout {
+  template <size_t N>
+  struct log2 { static const size_t value = 1 + log2<N / 2>::value; };
+  template <>
+  struct log2<1> { static const size_t value = 0; };
+
+  // Smallest b such that 2^b >= n
+  inline size_t ceil_log2(size_t n) {
+    size_t b = 0;
+    while ((size_t(1) << b) < n)
+      ++b;
+    return b;
+  }
+} // namespace _impl_marray_layout
+
+
+class marray_layout_linear {
+public:
+  static const bool is_linear = true;
+  marray_layout_linear() : w_(0), h_(0), d_(0), wh_(0) {}
+  void set_dims(size_t w, size_t h, size_t d) {
+    w_ = w;
+    h_ = h;
+    d_ = d;
+    wh_ = w * h;
+  }
+  size_t width() const { return w_; }
+  size_t height() const { return h_; }
+  size_t depth() const { return d_; }
+  size_t storage_size() const { return wh_ * d_; }
+  size_t offset(size_t x, size_t y, size_t z) const { return z * wh_ + y * w_ + x; }
+  size_t run_length(size_t x) const { return w_ - x; }
+  bool has_strided_rows() const { return true; }
+  bool operator==(const marray_layout_linear& other) const { return w_ == other.w_ && h_ == other.h_ && d_ == other.d_; }
+  bool operator!=(const marray_layout_linear& other) const { return !(*this == other); }
+private:
+  size_t w_;
+  size_t h_;
+  size_t d_;
+  size_t wh_;
+};
+
+
+template <size_t B = 8>
+class marray_layout_brick {
+public:
+  static_assert(B >= 2 && (B & (B - 1)) == 0, "brick side must be a power of 2");
+  static const bool is_linear = false;
+  static const size_t brick_side = B;
+  static const size_t brick_size = B * B * B;
+  marray_layout_brick() : w_(0), h_(0), d_(0), row_stride_(0), slab_stride_(0), storage_size_(0) {}
+  void set_dims(size_t w, size_t h, size_t d) {
+    w_ = w;
+    h_ = h;
+    d_ = d;
+    const size_t bricks_x = (w + B - 1) / B;
+    const size_t bricks_y = (h + B - 1) / B;
+    const size_t bricks_z = (d + B - 1) / B;
+    row_stride_ = bricks_x * brick_size;
+    slab_stride_ = bricks_y * row_stride_;
+    storage_size_ = bricks_z * slab_stride_;
+  }
+  size_t width() const { return w_; }
+  size_t height() const { return h_; }
+  size_t depth() const { return d_; }
+  size_t storage_size() const { return storage_size_; }
+  size_t offset(size_t x, size_t y, size_t z) const {
+    return (x >> shift) * brick_size + (y >> shift) * row_stride_ + (z >> shift) * slab_stride_ +
+      (x & mask) + ((y & mask) << shift) + ((z & mask) << (2 * shift));
+  }
+  size_t run_length(size_t x) const { return std::min(w_ - x, B - (x & mask)); }
+  bool has_strided_rows() const { return false; }
+  bool operator==(const marray_layout_brick& other) const { return w_ == other.w_ && h_ == other.h_ && d_ == other.d_; }
+  bool operator!=(const marray_layout_brick& other) const { return !(*this == other); }
+private:
+  static const size_t shift = _impl_marray_layout::log2<B>::value;
+  static const size_t mask = B - 1;
+  size_t w_;
+  size_t h_;
+  size_t d_;
+  size_t row_stride_;
+  size_t slab_stride_;
+  size_t storage_size_;
+};
+
+
+// The interleaved bits of each coordinate are looked up in one table per axis
+class marray_layout_morton {
+public:
+  static const bool is_linear = false;
+  marray_layout_morton() : w_(0), h_(0), d_(0), x_run_bits_(0), storage_size_(0) {}
+  void set_dims(size_t w, size_t h, size_t d) {
+    using _impl_marray_layout::ceil_log2;
+    w_ = w;
+    h_ = h;
+    d_ = d;
+    const size_t dims[3] = { w, h, d };
+    const size_t bits[3] = { ceil_log2(w), ceil_log2(h), ceil_log2(d) };
+    std::vector<size_t>* tables[3] = { &x_, &y_, &z_ };
+    for (size_t axis = 0; axis < 3; ++axis)
+      tables[axis]->assign(dims[axis], 0);
+    // Bit i of each axis in turn, skipping axes without a bit i
+    const size_t max_bits = std::max(bits[0], std::max(bits[1], bits[2]));
+    size_t position = 0;
+    x_run_bits_ = 0;
+    for (size_t i = 0; i < max_bits; ++i) {
+      for (size_t axis = 0; axis < 3; ++axis) {
+        if (i >= bits[axis])
+          continue;
+        if (axis == 0 && position == i)
+          ++x_run_bits_;
+        std::vector<size_t>& table = *tables[axis];
+        for (size_t c = 0; c < table.size(); ++c)
+          table[c] |= ((c >> i) & 1) << position;
+        ++position;
+      }
+    }
+    // The offset grows with each coordinate, hence the last element has the largest offset
+    storage_size_ = w * h * d == 0 ? 0 : offset(w - 1, h - 1, d - 1) + 1;
+  }
+  size_t width() const { return w_; }
+  size_t height() const { return h_; }
+  size_t depth() const { return d_; }
+  size_t storage_size() const { return storage_size_; }
+  size_t offset(size_t x, size_t y, size_t z) const { return x_[x] | y_[y] | z_[z]; }
+  size_t run_length(size_t x) const {
+    const size_t run_mask = (size_t(1) << x_run_bits_) - 1;
+    return std::min(w_ - x, run_mask + 1 - (x & run_mask));
+  }
+  bool has_strided_rows() const { return false; }
+  bool operator==(const marray_layout_morton& other) const { return w_ == other.w_ && h_ == other.h_ && d_ == other.d_; }
+  bool operator!=(const marray_layout_morton& other) const { return !(*this == other); }
+private:
+  size_t w_;
+  size_t h_;
+  size_t d_;
+  size_t x_run_bits_;
+  size_t storage_size_;
+  std::vector<size_t> x_;
+  std::vector<size_t> y_;
+  std::vector<size_t> z_;
+};
+
+
+// Visits the elements of a non-linear layout in the order of the linear layout, ie x fastest
+template <typename V, typename L>
+class marray_layout_iterator {
+public:
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef typename std::remove_const<V>::type value_type;
+  typedef ptrdiff_t difference_type;
+  typedef V* pointer;
+  typedef V& reference;
+  marray_layout_iterator() : data_(nullptr), layout_(nullptr), x_(0), y_(0), z_(0) {}
+  marray_layout_iterator(V* data, const L* layout, size_t x, size_t y, size_t z) : data_(data), layout_(layout), x_(x), y_(y), z_(z) {}
+  // iterator to const_iterator
+  template <typename U, typename = typename std::enable_if<std::is_same<const U, V>::value>::type>
+  marray_layout_iterator(const marray_layout_iterator<U, L>& other) : data_(other.data_), layout_(other.layout_), x_(other.x_), y_(other.y_), z_(other.z_) {}
+
+  reference operator*() const { return data_[layout_->offset(x_, y_, z_)]; }
+  pointer operator->() const { return &**this; }
+  marray_layout_iterator& operator++() {
+    if (++x_ == layout_->width()) {
+      x_ = 0;
+      if (++y_ == layout_->height()) {
+        y_ = 0;
+        ++z_;
+      }
+    }
+    return *this;
+  }
+  marray_layout_iterator& operator--() {
+    if (x_ == 0) {
+      x_ = layout_->width() - 1;
+      if (y_ == 0) {
+        y_ = layout_->height() - 1;
+        --z_;
+      }
+      else
+        --y_;
+    }
+    else
+      --x_;
+    return *this;
+  }
+  marray_layout_iterator operator++(int) { marray_layout_iterator ret = *this; ++*this; return ret; }
+  marray_layout_iterator operator--(int) { marray_layout_iterator ret = *this; --*this; return ret; }
+  bool operator==(const marray_layout_iterator& other) const { return x_ == other.x_ && y_ == other.y_ && z_ == other.z_; }
+  bool operator!=(const marray_layout_iterator& other) const { return !(*this == other); }
+private:
+  template <typename U, typename M> friend class marray_layout_iterator;
+  V* data_;
+  const L* layout_;
+  size_t x_;
+  size_t y_;
+  size_t z_;
+};
+
+
+// Copies the n elements starting at (x, y, z) along x to\from a contiguous row, run by run
+template <typename L, typename T>
+void layout_read_row(const L& layout, const T* data, size_t x, size_t y, size_t z, size_t n, T* row) {
+  for (size_t i = 0; i < n;) {
+    const size_t run = std::min(n - i, layout.run_length(x + i));
+    const T* src = data + layout.offset(x + i, y, z);
+    std::copy(src, src + run, row + i);
+    i += run;
+  }
+}
+template <typename L, typename T>
+void layout_write_row(const L& layout, T* data, size_t x, size_t y, size_t z, size_t n, const T* row) {
+  for (size_t i = 0; i < n;) {
+    const size_t run = std::min(n - i, layout.run_length(x + i));
+    std::copy(row + i, row + i + run, data + layout.offset(x + i, y, z));
+    i += run;
+  }
+}
+
+
+// Copy of src in layout L, the slabs along z are distributed on the pfor threads
+template <typename L, typename T, size_t N, typename A, typename SrcL>
+marray<T, N, A, L> convert_layout(const marray<T, N, A, SrcL>& src, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  marray<T, N, A, L> dst(src.get_allocator());
+  dst.allocate_first_touch(src.width(), src.height(), src.depth(), partitioner);
+  const size_t w = src.width();
+  const size_t h = src.height();
+  const size_t d = src.depth();
+  if (dst.empty())
+    return dst;
+  partitioner.for_each_chunk(size_t(0), d, [&](size_t start, size_t stop) {
+    std::vector<T> row(w);
+    for (size_t z = start; z < stop; ++z) {
+      for (size_t y = 0; y < h; ++y) {
+        layout_read_row(src.layout(), src.data(), 0, y, z, w, row.data());
+        layout_write_row(dst.layout(), dst.data(), 0, y, z, w, row.data());
+      }
+    }
+  });
+  return dst;
+}
+
+
+} // namespace util
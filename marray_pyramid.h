@@ -0,0 +1,243 @@
+//
+//  Marray Pyramid
+//    Mipmap of a 2D or 3D array, level i + 1 is level i reduced by 2 along each axis of more than one element,
+//    down to a single element. All levels are stored in a single allocation, level 0 being a copy of the source.
+//    pyramid_box:      Mean of the 2 ^ N elements covered by each element of the next level
+//    pyramid_gaussian: Binomial 1 3 3 1 \ 8 along each axis, smoother than box at the same cost per element
+//    A level is computed row by row in memory order from the previous one, the rows are distributed on the pfor
+//    threads. Levels are built at construction, or on demand after reset().
+//
+//   USAGE:
+//     util::marray_pyramid<float, 3> mips(volume);               // Builds all levels
+//     util::const_marray_view<float, 3> coarse = mips.level(2);  // (width + 3) / 4 elements wide etc
+//     float v = mips.sample(10.5f, 20.0f, 30.0f, 1.5f);          // Quadrilinear, coordinates of level 0
+//     util::marray_pyramid<float, 2> lazy;
+//     lazy.reset(image, util::pyramid_gaussian);                 // Copies level 0 only
+//     auto thumb = lazy.level(4).to_marray();                    // Builds levels 1 to 4
+//
+//  NOTES:
+//  - A level of an odd size n has (n + 1) / 2 elements, its last element repeats the border of the previous level
+//  - Element i of level l is centered at (i + 0.5) * 2 ^ l - 0.5 of level 0
+//  - Sampling and const level() require the levels to be built, on-demand construction is not thread safe
+//
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include "parallel_for.h"
+#include "uninitialized_vector.h"
+#include "marray_layout.h"
+#include "marray_view.h"
+#include "marray_sample.h"
+#include "marray_filter.h"
+
+namespace util {
+
+
+enum pyramid_filter { pyramid_box, pyramid_gaussian };
+
+
+namespace _impl_marray_pyramid {
+  using _impl_marray_filter::weight_type;
+
+  // Source indices and weights of element i of the next level along an axis of n elements, returns the tap count
+  template <typename W>
+  size_t reduce_taps(size_t i, size_t n, pyramid_filter filter, size_t* index, W* weight) {
+    if (n == 1) {
+      index[0] = 0;
+      weight[0] = W(1);
+      return 1;
+    }
+    const ptrdiff_t last = static_cast<ptrdiff_t>(n) - 1;
+    const ptrdiff_t first = filter == pyramid_box ? 2 * static_cast<ptrdiff_t>(i) : 2 * static_cast<ptrdiff_t>(i) - 1;
+    const W box[2] = { W(0.5), W(0.5) };
+    const W gaussian[4] = { W(0.125), W(0.375), W(0.375), W(0.125) };
+    const size_t taps = filter == pyramid_box ? 2 : 4;
+    for (size_t k = 0; k < taps; ++k) {
+      index[k] = static_cast<size_t>(std::min(std::max(first + static_cast<ptrdiff_t>(k), ptrdiff_t(0)), last));
+      weight[k] = filter == pyramid_box ? box[k] : gaussian[k];
+    }
+    return taps;
+  }
+
+  inline size_t reduced(size_t n) { return (n + 1) / 2; }
+
+  // dst, of reduced(w) * reduced(h) * reduced(d) elements, from src of w * h * d elements
+  template <typename T>
+  void reduce(const T* src, size_t w, size_t h, size_t d, T* dst, pyramid_filter filter, const pfor_partitioner& partitioner) {
+    typedef typename weight_type<T>::type W;
+    const size_t dw = reduced(w);
+    const size_t dh = reduced(h);
+    const size_t dd = reduced(d);
+    // Taps along x for every element of a row
+    std::vector<size_t> x_index(4 * dw);
+    std::vector<W> x_weight(4 * dw);
+    std::vector<size_t> x_taps(dw);
+    for (size_t x = 0; x < dw; ++x)
+      x_taps[x] = reduce_taps(x, w, filter, x_index.data() + 4 * x, x_weight.data() + 4 * x);
+    partitioner.for_each_chunk(size_t(0), dh * dd, [&](size_t start, size_t stop) {
+      std::vector<W> acc(w);
+      for (size_t row = start; row < stop; ++row) {
+        const size_t y = row % dh;
+        const size_t z = row / dh;
+        size_t y_index[4];
+        size_t z_index[4];
+        W y_weight[4];
+        W z_weight[4];
+        const size_t y_taps = reduce_taps(y, h, filter, y_index, y_weight);
+        const size_t z_taps = reduce_taps(z, d, filter, z_index, z_weight);
+        // Rows along y and z are combined with unit stride, then reduced along x
+        std::fill(acc.begin(), acc.end(), W(0));
+        for (size_t kz = 0; kz < z_taps; ++kz) {
+          for (size_t ky = 0; ky < y_taps; ++ky)
+            _impl_marray_filter::multiply_add(acc.data(), src + (z_index[kz] * h + y_index[ky]) * w, y_weight[ky] * z_weight[kz], w);
+        }
+        T* out = dst + row * dw;
+        for (size_t x = 0; x < dw; ++x) {
+          const size_t* index = x_index.data() + 4 * x;
+          const W* weight = x_weight.data() + 4 * x;
+          W sum = W(0);
+          for (size_t k = 0; k < x_taps[x]; ++k)
+            sum += weight[k] * acc[index[k]];
+          out[x] = _impl_marray_sample::to_element<T>(sum);
+        }
+      }
+    });
+  }
+} // namespace _impl_marray_pyramid
+
+
+template <typename T, size_t N, typename A = std::allocator<T> >
+class marray_pyramid {
+public:
+  static_assert(N == 2 || N == 3, "marray_pyramid is 2D or 3D");
+  static const size_t dimensions = N;
+  typedef T value_type;
+  typedef A allocator_type;
+  typedef const_marray_view<T, N> level_view;
+
+  marray_pyramid() : filter_(pyramid_box), num_built_(0) {}
+  explicit marray_pyramid(const allocator_type& allocator) : data_(allocator), filter_(pyramid_box), num_built_(0) {}
+  // Builds every level of src, a marray of any layout or a marray_view
+  template <typename M>
+  explicit marray_pyramid(const M& src, pyramid_filter filter = pyramid_box, const pfor_partitioner& partitioner = pfor_partitioner()) : filter_(pyramid_box), num_built_(0) {
+    reset(src, filter, partitioner);
+    build(num_levels(), partitioner);
+  }
+
+  // Copies src to level 0, the other levels are built on demand
+  template <typename M>
+  void reset(const M& src, pyramid_filter filter = pyramid_box, const pfor_partitioner& partitioner = pfor_partitioner()) {
+    static_assert(M::dimensions == N, "");
+    filter_ = filter;
+    dims_.clear();
+    offsets_.clear();
+    size_t w = src.width();
+    size_t h = src.height();
+    size_t d = src.depth();
+    size_t total = 0;
+    for (;;) {
+      dims_.push_back({ { w, h, d } });
+      offsets_.push_back(total);
+      total += w * h * d;
+      if (w <= 1 && h <= 1 && d <= 1)
+        break;
+      w = _impl_marray_pyramid::reduced(w);
+      h = _impl_marray_pyramid::reduced(h);
+      d = _impl_marray_pyramid::reduced(d);
+    }
+    data_.resize_uninitialized(total);
+    num_built_ = 1;
+    const size_t src_w = src.width();
+    const size_t src_h = src.height();
+    T* dst = data_.data();
+    partitioner.for_each_chunk(size_t(0), src_h * src.depth(), [&](size_t start, size_t stop) {
+      for (size_t row = start; row < stop; ++row)
+        layout_read_row(src.layout(), static_cast<const T*>(src.data()), 0, row % src_h, row / src_h, src_w, dst + row * src_w);
+    });
+  }
+
+  // Builds levels [1, n) which are not built yet
+  void build(size_t n, const pfor_partitioner& partitioner = pfor_partitioner()) {
+    RASSERT_MSG(n <= num_levels(), "marray_pyramid: level " << n << " of " << num_levels());
+    for (; num_built_ < n; ++num_built_) {
+      const size_t i = num_built_ - 1;
+      _impl_marray_pyramid::reduce(data_.data() + offsets_[i], width(i), height(i), depth(i), data_.data() + offsets_[i + 1], filter_, partitioner);
+    }
+  }
+
+  // Levels
+  size_t num_levels() const { return dims_.size(); }
+  size_t num_built_levels() const { return num_built_; }
+  bool is_built(size_t i) const { return i < num_built_; }
+  pyramid_filter filter() const { return filter_; }
+  size_t width(size_t i = 0) const { return dims_[i][0]; }
+  size_t height(size_t i = 0) const { return dims_[i][1]; }
+  size_t depth(size_t i = 0) const { return dims_[i][2]; }
+  bool empty() const { return dims_.empty() || width() * height() * depth() == 0; }
+
+  level_view level(size_t i) const {
+    DASSERT(is_built(i));
+    return level_view(data_.data() + offsets_[i], width(i), height(i), depth(i));
+  }
+  // Builds the level and those above it when needed
+  level_view level(size_t i) {
+    build(i + 1);
+    return static_cast<const marray_pyramid&>(*this).level(i);
+  }
+
+  // Samples of level i at coordinates of level 0
+  template <typename F>
+  F sample_level(size_t i, F x, F y, F z) const {
+    static_assert(N == 3, "");
+    const F scale = F(1) / static_cast<F>(size_t(1) << i);
+    return sample_trilinear(level(i), (x + F(0.5)) * scale - F(0.5), (y + F(0.5)) * scale - F(0.5), (z + F(0.5)) * scale - F(0.5));
+  }
+  template <typename F>
+  F sample_level(size_t i, F x, F y) const {
+    static_assert(N == 2, "");
+    const F scale = F(1) / static_cast<F>(size_t(1) << i);
+    return sample_bilinear(level(i), (x + F(0.5)) * scale - F(0.5), (y + F(0.5)) * scale - F(0.5));
+  }
+  // Quadrilinear (trilinear in 2D), linear between the two levels nearest lod, which is clamped to the levels
+  template <typename F>
+  F sample(F x, F y, F z, F lod) const {
+    static_assert(N == 3, "");
+    size_t i0, i1;
+    const F t = level_sample(lod, i0, i1);
+    const F s0 = sample_level(i0, x, y, z);
+    return i0 == i1 ? s0 : _impl_marray_sample::lerp(s0, sample_level(i1, x, y, z), t);
+  }
+  template <typename F>
+  F sample(F x, F y, F lod) const {
+    static_assert(N == 2, "");
+    size_t i0, i1;
+    const F t = level_sample(lod, i0, i1);
+    const F s0 = sample_level(i0, x, y);
+    return i0 == i1 ? s0 : _impl_marray_sample::lerp(s0, sample_level(i1, x, y), t);
+  }
+
+  allocator_type get_allocator() const { return data_.get_allocator(); }
+
+private:
+  template <typename F>
+  F level_sample(F lod, size_t& i0, size_t& i1) const {
+    DASSERT(!empty());
+    lod = std::min(std::max(F(0), lod), static_cast<F>(num_levels() - 1));
+    i0 = static_cast<size_t>(lod);
+    i1 = std::min(i0 + 1, num_levels() - 1);
+    return lod - static_cast<F>(i0);
+  }
+
+  default_init_vector<T, A> data_;
+  std::vector<std::array<size_t, 3> > dims_;
+  std::vector<size_t> offsets_;
+  pyramid_filter filter_;
+  size_t num_built_;
+};
+
+
+} // namespace util
@@ -0,0 +1,243 @@
+//
+//  Marray Resample
+//    Resampling of marray<T, N> to a new size, one axis at a time
+//    resample_nearest: Element (x * src_size) / dst_size along each axis, any layout
+//    resample_linear:  Linear interpolation of the two nearest elements along each axis
+//    resample_cubic:   Catmull-Rom interpolation of the four nearest elements along each axis
+//    The source indices and weights of each output index are tabulated once per axis. The linear and cubic
+//    filters are separable passes where lines along y and z are combined as whole segments of rows, hence the
+//    inner loops have unit stride and are vectorized. The last pass writes the output in memory order, and
+//    rows and segments are distributed on the pfor threads.
+//
+//   USAGE:
+//     marray<float, 3> half = util::resample(volume, volume.width() / 2, volume.height() / 2, volume.depth() / 2);
+//     marray<uint8_t, 2> thumb = util::resample(image, 64, 64, 1, util::resample_cubic);
+//     marray<float, 3> nn = volume.resized_nn(math::Vec3i(128, 128, 128));
+//
+//  NOTES:
+//  - Linear and cubic map the centers of the elements onto each other, ie output index i samples the source
+//    at (i + 0.5) * src_size / dst_size - 0.5, clamped to the border
+//  - Downsampling does not prefilter, blur first (see marray_filter.h) to avoid aliasing at large factors
+//  - Integral values are interpolated in float, rounded and clamped to the range of T (cubic overshoots)
+//  - Nearest works on any layout, linear and cubic resample non-linear layouts through a linear copy
+//
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "parallel_for.h"
+#include "marray_layout.h"
+#include "marray_filter.h"
+
+namespace util {
+
+
+enum resample_filter { resample_nearest, resample_linear, resample_cubic };
+
+
+namespace _impl_marray_resample {
+  using _impl_marray_filter::weight_type;
+  using _impl_marray_filter::line_layout;
+  using _impl_marray_sample::to_element;
+
+  // Source index of each output index along an axis
+  inline std::vector<size_t> nearest_table(size_t src_n, size_t dst_n) {
+    std::vector<size_t> ret(dst_n);
+    for (size_t i = 0; i < dst_n; ++i)
+      ret[i] = std::min(i * src_n / dst_n, src_n - 1);
+    return ret;
+  }
+
+  // Source indices and weights of each output index along an axis, tap k of output index i at k * n + i
+  template <typename W>
+  struct axis_table {
+    size_t src_n;
+    size_t n;
+    size_t taps;
+    std::vector<size_t> index;
+    std::vector<W> weight;
+  };
+
+  template <typename W>
+  axis_table<W> make_table(size_t src_n, size_t dst_n, resample_filter filter) {
+    axis_table<W> ret;
+    ret.src_n = src_n;
+    ret.n = dst_n;
+    ret.taps = filter == resample_cubic ? 4 : 2;
+    ret.index.resize(ret.taps * dst_n);
+    ret.weight.resize(ret.taps * dst_n);
+    const double scale = static_cast<double>(src_n) / static_cast<double>(dst_n);
+    const ptrdiff_t last = static_cast<ptrdiff_t>(src_n) - 1;
+    for (size_t i = 0; i < dst_n; ++i) {
+      const double p = std::min(std::max((static_cast<double>(i) + 0.5) * scale - 0.5, 0.0), static_cast<double>(last));
+      const ptrdiff_t i0 = static_cast<ptrdiff_t>(p);
+      const double t = p - static_cast<double>(i0);
+      double w[4];
+      if (filter == resample_cubic) {
+        const double t2 = t * t;
+        const double t3 = t2 * t;
+        w[0] = 0.5 * (-t3 + 2 * t2 - t);
+        w[1] = 0.5 * (3 * t3 - 5 * t2 + 2);
+        w[2] = 0.5 * (-3 * t3 + 4 * t2 + t);
+        w[3] = 0.5 * (t3 - t2);
+      }
+      else {
+        w[0] = 1 - t;
+        w[1] = t;
+      }
+      const ptrdiff_t first = filter == resample_cubic ? i0 - 1 : i0;
+      for (size_t k = 0; k < ret.taps; ++k) {
+        const ptrdiff_t j = std::min(std::max(first + static_cast<ptrdiff_t>(k), ptrdiff_t(0)), last);
+        ret.index[k * dst_n + i] = static_cast<size_t>(j);
+        ret.weight[k * dst_n + i] = static_cast<W>(w[k]);
+      }
+    }
+    return ret;
+  }
+
+  template <typename D, typename W>
+  void store(D* dst, const W* acc, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+      dst[i] = to_element<D>(acc[i]);
+  }
+
+  // Resamples src, of dims[0] * dims[1] * dims[2] elements, along axis into dst, whose size along axis is table.n
+  template <typename S, typename D, typename W>
+  void resample_axis(const S* src, D* dst, const size_t* dims, size_t axis, const axis_table<W>& table, const pfor_partitioner& partitioner) {
+    const size_t inner = axis == 0 ? 1 : axis == 1 ? dims[0] : dims[0] * dims[1];
+    const size_t outer = axis == 0 ? dims[1] * dims[2] : axis == 1 ? dims[2] : 1;
+    const size_t n = table.n;
+    if (axis == 0) {
+      partitioner.for_each_chunk(size_t(0), outer, [&](size_t start, size_t stop) {
+        std::vector<W> acc(n);
+        for (size_t row = start; row < stop; ++row) {
+          const S* src_row = src + row * table.src_n;
+          std::fill(acc.begin(), acc.end(), W(0));
+          for (size_t k = 0; k < table.taps; ++k) {
+            const size_t* index = table.index.data() + k * n;
+            const W* weight = table.weight.data() + k * n;
+            for (size_t x = 0; x < n; ++x)
+              acc[x] += weight[x] * static_cast<W>(src_row[index[x]]);
+          }
+          store(dst + row * n, acc.data(), n);
+        }
+      });
+      return;
+    }
+    const line_layout layout = { outer, n, inner };
+    _impl_marray_filter::for_each_segment(layout, partitioner, [&](size_t line, size_t segment_start, size_t segment_stop) {
+      const size_t len = segment_stop - segment_start;
+      const S* lines = src + line * table.src_n * inner + segment_start;
+      D* out = dst + line * n * inner + segment_start;
+      std::vector<W> acc(len);
+      for (size_t i = 0; i < n; ++i) {
+        std::fill(acc.begin(), acc.end(), W(0));
+        for (size_t k = 0; k < table.taps; ++k)
+          _impl_marray_filter::multiply_add(acc.data(), lines + table.index[k * n + i] * inner, table.weight[k * n + i], len);
+        store(out + i * inner, acc.data(), len);
+      }
+    });
+  }
+
+  template <typename M>
+  M nearest(const M& src, size_t w, size_t h, size_t d, const pfor_partitioner& partitioner) {
+    typedef typename M::value_type T;
+    M ret(src.get_allocator());
+    ret.allocate_first_touch(w, h, d, partitioner);
+    if (ret.empty())
+      return ret;
+    const std::vector<size_t> xs = nearest_table(src.width(), w);
+    const std::vector<size_t> ys = nearest_table(src.height(), h);
+    const std::vector<size_t> zs = nearest_table(src.depth(), d);
+    const auto& src_layout = src.layout();
+    const bool is_strided = src_layout.has_strided_rows();
+    partitioner.for_each_chunk(size_t(0), h * d, [&](size_t start, size_t stop) {
+      std::vector<T> row(w);
+      for (size_t yz = start; yz < stop; ++yz) {
+        const size_t y = yz % h;
+        const size_t z = yz / h;
+        if (is_strided) {
+          const T* src_row = src.data() + src_layout.offset(0, ys[y], zs[z]);
+          for (size_t x = 0; x < w; ++x)
+            row[x] = src_row[xs[x]];
+        }
+        else {
+          for (size_t x = 0; x < w; ++x)
+            row[x] = src.data()[src_layout.offset(xs[x], ys[y], zs[z])];
+        }
+        layout_write_row(ret.layout(), ret.data(), 0, y, z, w, row.data());
+      }
+    });
+    return ret;
+  }
+
+  template <typename M>
+  M interpolate(const M& src, size_t w, size_t h, size_t d, resample_filter filter, const pfor_partitioner& partitioner, std::true_type /*is_linear*/) {
+    typedef typename M::value_type T;
+    typedef typename weight_type<T>::type W;
+    const size_t dst_dims[3] = { w, h, d };
+    size_t dims[3] = { src.width(), src.height(), src.depth() };
+    M ret(src.get_allocator());
+    ret.allocate_first_touch(w, h, d, partitioner);
+    if (ret.empty())
+      return ret;
+    // Axes whose size changes, the others are left as is
+    size_t axes[3];
+    size_t num_axes = 0;
+    for (size_t axis = 0; axis < 3; ++axis) {
+      if (dims[axis] != dst_dims[axis])
+        axes[num_axes++] = axis;
+    }
+    if (num_axes == 0) {
+      std::copy(src.data(), src.data() + src.size(), ret.data());
+      return ret;
+    }
+    // Intermediate results are kept in W, the first pass reads src and the last writes ret
+    std::vector<W> buf;
+    std::vector<W> tmp;
+    for (size_t i = 0; i < num_axes; ++i) {
+      const size_t axis = axes[i];
+      const axis_table<W> table = make_table<W>(dims[axis], dst_dims[axis], filter);
+      const bool is_first = i == 0;
+      const bool is_last = i + 1 == num_axes;
+      if (is_first && is_last)
+        resample_axis(src.data(), ret.data(), dims, axis, table, partitioner);
+      else if (is_first) {
+        buf.resize(src.size() / dims[axis] * dst_dims[axis]);
+        resample_axis(src.data(), buf.data(), dims, axis, table, partitioner);
+      }
+      else if (is_last)
+        resample_axis(buf.data(), ret.data(), dims, axis, table, partitioner);
+      else {
+        tmp.resize(buf.size() / dims[axis] * dst_dims[axis]);
+        resample_axis(buf.data(), tmp.data(), dims, axis, table, partitioner);
+        buf.swap(tmp);
+      }
+      dims[axis] = dst_dims[axis];
+    }
+    return ret;
+  }
+  // Non-linear layouts are resampled through linear copies
+  template <typename M>
+  M interpolate(const M& src, size_t w, size_t h, size_t d, resample_filter filter, const pfor_partitioner& partitioner, std::false_type /*is_linear*/) {
+    const auto linear = convert_layout<marray_layout_linear>(src, partitioner);
+    return convert_layout<typename M::layout_type>(interpolate(linear, w, h, d, filter, partitioner, std::true_type()), partitioner);
+  }
+} // namespace _impl_marray_resample
+
+
+// src resampled to w * h * d elements, h and d are 1 in 2D
+template <typename M>
+M resample(const M& src, size_t w, size_t h, size_t d, resample_filter filter = resample_linear, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  RASSERT_MSG((M::dimensions > 1 || h == 1) && (M::dimensions > 2 || d == 1), "resample: size " << w << "x" << h << "x" << d << " exceeds the dimensions");
+  RASSERT_MSG(!src.empty() || w * h * d == 0, "resample: empty source");
+  if (filter == resample_nearest)
+    return _impl_marray_resample::nearest(src, w, h, d, partitioner);
+  return _impl_marray_resample::interpolate(src, w, h, d, filter, partitioner, std::integral_constant<bool, M::layout_type::is_linear>());
+}
+
+
+} // namespace util
@@ -0,0 +1,234 @@
+//
+//  Marray Sample
+//    Trilinear sampling of 3D arrays and bilinear sampling of 2D arrays at floating point positions, one at a
+//    time or in batches. Batches are split on the pfor threads, and float volumes with strided rows (linear
+//    marrays and views with unit x stride) sample 8 positions at a time with AVX2 gathers when available.
+//    Positions are clamped to [0, size - 1] along each axis, ie the border elements are repeated.
+//
+//   USAGE:
+//     float v = util::sample_trilinear(volume, 10.5f, 20.25f, 3.0f);
+//     float p = util::sample_bilinear(image, 10.5f, 20.25f);
+//     std::vector<math::Vec3f> positions = ...;                 // Any type with members x, y and z
+//     std::vector<float> samples(positions.size());
+//     util::sample_trilinear(volume, positions.data(), positions.size(), samples.data());
+//
+//  NOTES:
+//  - Integral elements are interpolated in the floating point type of the positions, rounded and clamped
+//  - Works on any layout and on marray_view, non-linear layouts are sampled element by element
+//  - The AVX2 path requires the storage of the volume to be addressable by 32-bit offsets
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include "parallel_for.h"
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#  define MARRAY_SAMPLE_AVX2_ENABLED
+#endif
+
+#ifndef MARRAY_SAMPLE_MIN_CHUNK // Least amount of samples per pfor chunk, smaller batches use fewer threads
+#  define MARRAY_SAMPLE_MIN_CHUNK 4096
+#endif
+
+namespace util {
+
+
+namespace _impl_marray_sample {
+  // Cell and fraction of a position along an axis of n elements, clamped
+  template <typename F>
+  struct axis_sample {
+    axis_sample(F p, size_t n) {
+      p = std::min(std::max(F(0), p), static_cast<F>(n - 1));
+      i0 = static_cast<size_t>(p);
+      i1 = std::min(i0 + 1, n - 1);
+      t = p - static_cast<F>(i0);
+    }
+    size_t i0;
+    size_t i1;
+    F t;
+  };
+
+  template <typename F>
+  F lerp(F a, F b, F t) { return a * (F(1) - t) + b * t; }
+
+  // Interpolated or filtered value to element, shared by sampling, filters, resampling and pyramids.
+  // Integral elements are rounded to nearest and clamped to the range of T, NaN gives lowest()
+  template <typename T, typename F>
+  typename std::enable_if<!std::is_integral<T>::value, T>::type to_element(F val) { return static_cast<T>(val); }
+  template <typename T, typename F>
+  typename std::enable_if<std::is_integral<T>::value, T>::type to_element(F val) {
+    const F rounded = std::floor(val + F(0.5));
+    // max() + 1 is a power of two, which unlike max() is exact in F
+    const F upper = static_cast<F>(std::numeric_limits<T>::max() / 2 + 1) * F(2);
+    if (!(rounded >= static_cast<F>(std::numeric_limits<T>::lowest())))
+      return std::numeric_limits<T>::lowest();
+    if (!(rounded < upper))
+      return std::numeric_limits<T>::max();
+    return static_cast<T>(rounded);
+  }
+
+  template <typename F, typename M>
+  F trilinear(const M& m, F x, F y, F z) {
+    const axis_sample<F> sx(x, m.width());
+    const axis_sample<F> sy(y, m.height());
+    const axis_sample<F> sz(z, m.depth());
+    const auto& layout = m.layout();
+    const auto* data = m.data();
+    const F c00 = lerp(static_cast<F>(data[layout.offset(sx.i0, sy.i0, sz.i0)]), static_cast<F>(data[layout.offset(sx.i1, sy.i0, sz.i0)]), sx.t);
+    const F c10 = lerp(static_cast<F>(data[layout.offset(sx.i0, sy.i1, sz.i0)]), static_cast<F>(data[layout.offset(sx.i1, sy.i1, sz.i0)]), sx.t);
+    const F c01 = lerp(static_cast<F>(data[layout.offset(sx.i0, sy.i0, sz.i1)]), static_cast<F>(data[layout.offset(sx.i1, sy.i0, sz.i1)]), sx.t);
+    const F c11 = lerp(static_cast<F>(data[layout.offset(sx.i0, sy.i1, sz.i1)]), static_cast<F>(data[layout.offset(sx.i1, sy.i1, sz.i1)]), sx.t);
+    return lerp(lerp(c00, c10, sy.t), lerp(c01, c11, sy.t), sz.t);
+  }
+
+  template <typename F, typename M>
+  F bilinear(const M& m, F x, F y) {
+    const axis_sample<F> sx(x, m.width());
+    const axis_sample<F> sy(y, m.height());
+    const auto& layout = m.layout();
+    const auto* data = m.data();
+    const F c0 = lerp(static_cast<F>(data[layout.offset(sx.i0, sy.i0, 0)]), static_cast<F>(data[layout.offset(sx.i1, sy.i0, 0)]), sx.t);
+    const F c1 = lerp(static_cast<F>(data[layout.offset(sx.i0, sy.i1, 0)]), static_cast<F>(data[layout.offset(sx.i1, sy.i1, 0)]), sx.t);
+    return lerp(c0, c1, sy.t);
+  }
+
+  template <typename M, typename P, typename O>
+  void trilinear_scalar(const M& m, const P* positions, size_t n, O* out) {
+    typedef typename std::decay<decltype(positions->x)>::type F;
+    for (size_t i = 0; i < n; ++i)
+      out[i] = to_element<O>(trilinear<F>(m, positions[i].x, positions[i].y, positions[i].z));
+  }
+
+#ifdef MARRAY_SAMPLE_AVX2_ENABLED
+  // Float elements at 32-bit offsets, rows along x contiguous and rows\slabs stride_y\stride_z apart
+  template <typename P>
+  size_t trilinear_avx2(const float* data, size_t w, size_t h, size_t d, size_t stride_y, size_t stride_z, const P* positions, size_t n, float* out) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 max_x = _mm256_set1_ps(static_cast<float>(w - 1));
+    const __m256 max_y = _mm256_set1_ps(static_cast<float>(h - 1));
+    const __m256 max_z = _mm256_set1_ps(static_cast<float>(d - 1));
+    const __m256i last_x = _mm256_set1_epi32(static_cast<int32_t>(w - 1));
+    const __m256i last_y = _mm256_set1_epi32(static_cast<int32_t>(h - 1));
+    const __m256i last_z = _mm256_set1_epi32(static_cast<int32_t>(d - 1));
+    const __m256i step = _mm256_set1_epi32(1);
+    const __m256i sy = _mm256_set1_epi32(static_cast<int32_t>(stride_y));
+    const __m256i sz = _mm256_set1_epi32(static_cast<int32_t>(stride_z));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      alignas(32) float px[8];
+      alignas(32) float py[8];
+      alignas(32) float pz[8];
+      for (size_t j = 0; j < 8; ++j) {
+        px[j] = positions[i + j].x;
+        py[j] = positions[i + j].y;
+        pz[j] = positions[i + j].z;
+      }
+      // Clamped positions, truncation equals floor as they are non-negative
+      const __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_load_ps(px), zero), max_x);
+      const __m256 y = _mm256_min_ps(_mm256_max_ps(_mm256_load_ps(py), zero), max_y);
+      const __m256 z = _mm256_min_ps(_mm256_max_ps(_mm256_load_ps(pz), zero), max_z);
+      const __m256i x0 = _mm256_cvttps_epi32(x);
+      const __m256i y0 = _mm256_cvttps_epi32(y);
+      const __m256i z0 = _mm256_cvttps_epi32(z);
+      const __m256 tx = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x0));
+      const __m256 ty = _mm256_sub_ps(y, _mm256_cvtepi32_ps(y0));
+      const __m256 tz = _mm256_sub_ps(z, _mm256_cvtepi32_ps(z0));
+      const __m256i dx = _mm256_sub_epi32(_mm256_min_epi32(_mm256_add_epi32(x0, step), last_x), x0);
+      const __m256i dy = _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_min_epi32(_mm256_add_epi32(y0, step), last_y), y0), sy);
+      const __m256i dz = _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_min_epi32(_mm256_add_epi32(z0, step), last_z), z0), sz);
+      const __m256i o000 = _mm256_add_epi32(x0, _mm256_add_epi32(_mm256_mullo_epi32(y0, sy), _mm256_mullo_epi32(z0, sz)));
+      const __m256i o010 = _mm256_add_epi32(o000, dy);
+      const __m256i o001 = _mm256_add_epi32(o000, dz);
+      const __m256i o011 = _mm256_add_epi32(o010, dz);
+      const __m256 one_x = _mm256_sub_ps(one, tx);
+      const __m256 one_y = _mm256_sub_ps(one, ty);
+      const __m256 one_z = _mm256_sub_ps(one, tz);
+      // lerp(a, b, t) = a * (1 - t) + b * t, as the scalar path
+      const __m256 c00 = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(data, o000, 4), one_x), _mm256_mul_ps(_mm256_i32gather_ps(data, _mm256_add_epi32(o000, dx), 4), tx));
+      const __m256 c10 = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(data, o010, 4), one_x), _mm256_mul_ps(_mm256_i32gather_ps(data, _mm256_add_epi32(o010, dx), 4), tx));
+      const __m256 c01 = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(data, o001, 4), one_x), _mm256_mul_ps(_mm256_i32gather_ps(data, _mm256_add_epi32(o001, dx), 4), tx));
+      const __m256 c11 = _mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(data, o011, 4), one_x), _mm256_mul_ps(_mm256_i32gather_ps(data, _mm256_add_epi32(o011, dx), 4), tx));
+      const __m256 c0 = _mm256_add_ps(_mm256_mul_ps(c00, one_y), _mm256_mul_ps(c10, ty));
+      const __m256 c1 = _mm256_add_ps(_mm256_mul_ps(c01, one_y), _mm256_mul_ps(c11, ty));
+      _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(c0, one_z), _mm256_mul_ps(c1, tz)));
+    }
+    return i;
+  }
+#endif
+
+  // Samples [0, n) of a batch, 8 at a time when the AVX2 path applies
+  template <typename M, typename P, typename O>
+  void trilinear_batch(const M& m, const P* positions, size_t n, O* out) {
+    size_t done = 0;
+#ifdef MARRAY_SAMPLE_AVX2_ENABLED
+    typedef typename std::decay<decltype(positions->x)>::type F;
+    const bool is_float = std::is_same<typename M::value_type, float>::value && std::is_same<F, float>::value && std::is_same<O, float>::value;
+    if (is_float && m.layout().has_strided_rows() && !m.empty()) {
+      const auto& layout = m.layout();
+      const size_t stride_y = layout.offset(0, 1, 0);
+      const size_t stride_z = layout.offset(0, 0, 1);
+      const size_t last = layout.offset(m.width() - 1, m.height() - 1, m.depth() - 1);
+      if (last <= static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+        done = trilinear_avx2(reinterpret_cast<const float*>(m.data()), m.width(), m.height(), m.depth(), stride_y, stride_z,
+          positions, n, reinterpret_cast<float*>(out));
+      }
+    }
+#endif
+    trilinear_scalar(m, positions + done, n - done, out + done);
+  }
+
+  // Calls f(start, stop) for chunks of [0, n) of at least MARRAY_SAMPLE_MIN_CHUNK samples
+  template <typename F>
+  void for_each_batch(size_t n, const pfor_partitioner& partitioner, F f) {
+    const size_t num_chunks = std::min(partitioner.num_chunks(), n / MARRAY_SAMPLE_MIN_CHUNK);
+    if (num_chunks <= 1)
+      f(size_t(0), n);
+    else
+      pfor_partitioner(num_chunks).for_each_chunk(size_t(0), n, f);
+  }
+} // namespace _impl_marray_sample
+
+
+// Single samples, the result is interpolated in F
+template <typename M, typename F>
+F sample_trilinear(const M& volume, F x, F y, F z) {
+  static_assert(M::dimensions == 3 && std::is_floating_point<F>::value, "");
+  DASSERT(!volume.empty());
+  return _impl_marray_sample::trilinear<F>(volume, x, y, z);
+}
+template <typename M, typename F>
+F sample_bilinear(const M& image, F x, F y) {
+  static_assert(M::dimensions == 2 && std::is_floating_point<F>::value, "");
+  DASSERT(!image.empty());
+  return _impl_marray_sample::bilinear<F>(image, x, y);
+}
+
+// Batches, out[i] is the sample at positions[i], P has members x, y (and z) of a floating point type
+template <typename M, typename P, typename O>
+void sample_trilinear(const M& volume, const P* positions, size_t n, O* out, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  static_assert(M::dimensions == 3, "");
+  DASSERT(n == 0 || !volume.empty());
+  _impl_marray_sample::for_each_batch(n, partitioner, [&](size_t start, size_t stop) {
+    _impl_marray_sample::trilinear_batch(volume, positions + start, stop - start, out + start);
+  });
+}
+template <typename M, typename P, typename O>
+void sample_bilinear(const M& image, const P* positions, size_t n, O* out, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  static_assert(M::dimensions == 2, "");
+  typedef typename std::decay<decltype(positions->x)>::type F;
+  DASSERT(n == 0 || !image.empty());
+  _impl_marray_sample::for_each_batch(n, partitioner, [&](size_t start, size_t stop) {
+    for (size_t i = start; i < stop; ++i)
+      out[i] = _impl_marray_sample::to_element<O>(_impl_marray_sample::bilinear<F>(image, positions[i].x, positions[i].y));
+  });
+}
+
+
+} // namespace util
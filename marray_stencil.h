@@ -0,0 +1,228 @@
+//
+//  Marray Stencil
+//    Engine for stencils of radius R on 2D and 3D marrays, ie outputs which depend on the neighbourhood
+//    [-R, R] of the input element along each axis.
+//    Interior: Visited in memory order, tile by tile of MARRAY_STENCIL_TILE_X * MARRAY_STENCIL_TILE_Y
+//              elements sweeping along z, so the planes of the neighbourhood stay in cache. Rows are processed
+//              in blocks of 16 unit stride elements, which the compiler vectorizes for simple kernels
+//    Border:   The elements within R of a face are computed by a separate border functor
+//    Arrays without strided rows, ie non-linear layouts (see marray_layout.h) and views with a stride along x:
+//              Tiles of MARRAY_STENCIL_BRICK_TILE^3 elements and their halo are gathered into a linear buffer,
+//              the kernel sees the strides of the buffer
+//    The outermost axis (z in 3D, y in 2D) is split between the pfor threads.
+//
+//   USAGE:
+//     Kernel, p points to the input element, dy\dz are the strides of y and z (dz is 0 in 2D)
+//     auto laplace = [](const float* p, ptrdiff_t dy, ptrdiff_t dz) {
+//       return p[-1] + p[1] + p[-dy] + p[dy] + p[-dz] + p[dz] - 6 * p[0];
+//     };
+//     marray<float, 3> dst(src.width(), src.height(), src.depth());
+//     util::apply_stencil<1>(src, dst, laplace);                            // Border elements are copied
+//     util::apply_stencil<1>(src, dst, laplace, util::stencil_border_value<float>(0)); // Border elements are 0
+//
+//     Border functor, computes the output of element (x, y, z) with any neighbourhood access
+//     auto clamped = [](const marray<float, 3>& src, size_t x, size_t y, size_t z) { ... };
+//
+//     Regions of interest in place, see marray_view.h
+//     util::apply_stencil<1>(src.view().crop(8, 8, 8, 64, 64, 64), dst_roi, laplace);
+//
+//  NOTES:
+//  - src and dst must have the same size and must not overlap
+//  - Arrays with a side smaller than 2R + 1 consists of border elements only
+//
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+#include "parallel_for.h"
+#include "marray_layout.h"
+
+#ifndef MARRAY_STENCIL_TILE_X // Elements along x per tile
+#  define MARRAY_STENCIL_TILE_X 512
+#endif
+
+#ifndef MARRAY_STENCIL_TILE_Y // Rows per tile
+#  define MARRAY_STENCIL_TILE_Y 16
+#endif
+
+#ifndef MARRAY_STENCIL_BRICK_TILE // Side of the gathered tiles of non-linear layouts
+#  define MARRAY_STENCIL_BRICK_TILE 16
+#endif
+
+// Tells the compiler that iterations of the following loop are independent
+#if defined(__clang__)
+#  define MARRAY_STENCIL_IVDEP _Pragma("clang loop vectorize(enable)")
+#elif defined(__GNUC__)
+#  define MARRAY_STENCIL_IVDEP _Pragma("GCC ivdep")
+#elif defined(_MSC_VER)
+#  define MARRAY_STENCIL_IVDEP __pragma(loop(ivdep))
+#else
+#  define MARRAY_STENCIL_IVDEP
+#endif
+
+namespace util {
+
+
+// Border functors
+struct stencil_border_copy {
+  template <typename M>
+  typename M::value_type operator()(const M& src, size_t x, size_t y, size_t z) const {
+    return src.data()[src.layout().offset(x, y, z)];
+  }
+};
+
+template <typename T>
+struct stencil_border_value {
+  explicit stencil_border_value(const T& val) : val_(val) {}
+  template <typename M>
+  T operator()(const M&, size_t, size_t, size_t) const { return val_; }
+  T val_;
+};
+
+
+namespace _impl_marray_stencil {
+  // Blocks with a constant trip count are vectorized without a runtime cost model or alias check
+  static const size_t block_size = 16;
+
+  template <typename T, typename Kernel>
+  void interior_row(const T* src, T* dst, size_t x_start, size_t x_stop, ptrdiff_t dy, ptrdiff_t dz, const Kernel& kernel) {
+    size_t x = x_start;
+    for (; x + block_size <= x_stop; x += block_size) {
+      const T* block_src = src + x;
+      T* block_dst = dst + x;
+      MARRAY_STENCIL_IVDEP
+      for (size_t i = 0; i < block_size; ++i)
+        block_dst[i] = kernel(block_src + i, dy, dz);
+    }
+    for (; x < x_stop; ++x)
+      dst[x] = kernel(src + x, dy, dz);
+  }
+
+  template <typename S, typename D, typename Border>
+  void border_row(const S& src, D& dst, size_t x_start, size_t x_stop, size_t y, size_t z, const Border& border) {
+    for (size_t x = x_start; x < x_stop; ++x)
+      dst.data()[dst.layout().offset(x, y, z)] = border(src, x, y, z);
+  }
+
+  // Interior of slabs [z_start, z_stop), gathered tile by tile, for arrays without strided rows
+  template <size_t R, typename S, typename D, typename Kernel>
+  void interior_tiles(const S& src, D& dst, size_t z_start, size_t z_stop, const Kernel& kernel) {
+    typedef typename S::value_type value_type;
+    const bool is_3d = S::dimensions == 3;
+    const size_t tile = MARRAY_STENCIL_BRICK_TILE;
+    const size_t w = src.width();
+    const size_t h = is_3d ? src.height() : 1;
+    const size_t ry = is_3d ? R : 0;
+    const size_t side = tile + 2 * R;
+    const size_t side_y = is_3d ? side : 1;
+    const ptrdiff_t dy = static_cast<ptrdiff_t>(side);
+    const ptrdiff_t dz = static_cast<ptrdiff_t>(side * side_y);
+    std::vector<value_type> in(side * side_y * side);
+    std::vector<value_type> out(tile);
+    for (size_t z0 = z_start; z0 < z_stop; z0 += tile) {
+      const size_t z1 = std::min(z_stop, z0 + tile);
+      for (size_t y0 = ry; y0 < h - ry; y0 += tile) {
+        const size_t y1 = std::min(h - ry, y0 + tile);
+        for (size_t x0 = R; x0 < w - R; x0 += tile) {
+          const size_t x1 = std::min(w - R, x0 + tile);
+          // Tile and halo, the halo of interior elements is within the array
+          for (size_t z = z0 - R; z < z1 + R; ++z) {
+            for (size_t y = y0 - ry; y < y1 + ry; ++y)
+              layout_read_row(src.layout(), src.data(), x0 - R, is_3d ? y : z, is_3d ? z : 0, x1 - x0 + 2 * R, &in[((z - z0 + R) * side_y + (y - y0 + ry)) * side]);
+          }
+          for (size_t z = z0; z < z1; ++z) {
+            for (size_t y = y0; y < y1; ++y) {
+              const value_type* row = &in[((z - z0 + R) * side_y + (y - y0 + ry)) * side + R];
+              interior_row(row, out.data(), 0, x1 - x0, is_3d ? dy : dz, is_3d ? dz : 0, kernel);
+              layout_write_row(dst.layout(), dst.data(), x0, is_3d ? y : z, is_3d ? z : 0, x1 - x0, out.data());
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Offset between the rows along y and z of an array with strided rows
+  template <typename M>
+  ptrdiff_t row_stride(const M& m, size_t axis) {
+    return static_cast<ptrdiff_t>(axis == 1 ? m.layout().offset(0, 1, 0) : m.layout().offset(0, 0, 1));
+  }
+
+  // Slabs [z_start, z_stop) of a 3D array, or rows [z_start, z_stop) of a 2D array viewed as height 1 slabs
+  template <size_t R, typename S, typename D, typename Kernel, typename Border>
+  void apply_slabs(const S& src, D& dst, size_t z_start, size_t z_stop, const Kernel& kernel, const Border& border) {
+    typedef typename S::value_type value_type;
+    const bool is_3d = S::dimensions == 3;
+    const size_t w = src.width();
+    const size_t h = is_3d ? src.height() : 1;
+    const size_t d = is_3d ? src.depth() : src.height();
+    const size_t ry = is_3d ? R : 0;
+    const bool has_interior = w > 2 * R && h > 2 * ry && d > 2 * R;
+    // Border slabs and rows
+    for (size_t z = z_start; z < z_stop; ++z) {
+      const bool is_border_slab = !has_interior || z < R || z >= d - R;
+      for (size_t y = 0; y < h; ++y) {
+        const size_t ay = is_3d ? y : z;
+        const size_t az = is_3d ? z : 0;
+        if (is_border_slab || y < ry || y >= h - ry)
+          border_row(src, dst, 0, w, ay, az, border);
+        else {
+          border_row(src, dst, 0, R, ay, az, border);
+          border_row(src, dst, w - R, w, ay, az, border);
+        }
+      }
+    }
+    if (!has_interior)
+      return;
+    // Interior, tile by tile sweeping along z
+    const size_t z_interior_start = std::max(z_start, R);
+    const size_t z_interior_stop = std::min(z_stop, d - R);
+    if (!src.layout().has_strided_rows() || !dst.layout().has_strided_rows()) {
+      if (z_interior_start < z_interior_stop)
+        interior_tiles<R>(src, dst, z_interior_start, z_interior_stop, kernel);
+      return;
+    }
+    // Strides of the kernel, in 2D the rows are the slabs
+    const ptrdiff_t dy = is_3d ? row_stride(src, 1) : 0;
+    const ptrdiff_t dz = is_3d ? row_stride(src, 2) : row_stride(src, 1);
+    const value_type* in = src.data();
+    typename D::value_type* out = dst.data();
+    // In 2D the tile rows are the rows of the chunk itself, hence tiles span a single row
+    for (size_t y_tile = ry; y_tile < h - ry; y_tile += MARRAY_STENCIL_TILE_Y) {
+      const size_t y_tile_stop = std::min(h - ry, y_tile + MARRAY_STENCIL_TILE_Y);
+      for (size_t x_tile = R; x_tile < w - R; x_tile += MARRAY_STENCIL_TILE_X) {
+        const size_t x_tile_stop = std::min(w - R, x_tile + MARRAY_STENCIL_TILE_X);
+        for (size_t z = z_interior_start; z < z_interior_stop; ++z) {
+          for (size_t y = y_tile; y < y_tile_stop; ++y) {
+            const size_t ay = is_3d ? y : z;
+            const size_t az = is_3d ? z : 0;
+            interior_row(in + src.layout().offset(0, ay, az), out + dst.layout().offset(0, ay, az), x_tile, x_tile_stop, is_3d ? dy : dz, is_3d ? dz : 0, kernel);
+          }
+        }
+      }
+    }
+  }
+} // namespace _impl_marray_stencil
+
+
+// Computes dst from the neighbourhoods of radius R of src, border elements by border(src, x, y, z).
+// src and dst are marrays or marray_views of the same dimensions.
+template <size_t R, typename S, typename D, typename Kernel, typename Border>
+void apply_stencil(const S& src, D& dst, Kernel kernel, Border border, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  static_assert(S::dimensions == 2 || S::dimensions == 3, "apply_stencil requires a 2D or 3D array");
+  static_assert(S::dimensions == D::dimensions, "");
+  RASSERT(src.width() == dst.width() && src.height() == dst.height() && src.depth() == dst.depth());
+  DASSERT(src.empty() || src.data() != dst.data());
+  const size_t num_outer = S::dimensions == 3 ? src.depth() : src.height();
+  partitioner.for_each_chunk(size_t(0), num_outer, [&](size_t start, size_t stop) {
+    _impl_marray_stencil::apply_slabs<R>(src, dst, start, stop, kernel, border);
+  });
+}
+template <size_t R, typename S, typename D, typename Kernel>
+void apply_stencil(const S& src, D& dst, Kernel kernel, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  apply_stencil<R>(src, dst, kernel, stencil_border_copy(), partitioner);
+}
+
+
+} // namespace util
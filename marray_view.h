@@ -0,0 +1,253 @@
+//
+//  Marray View
+//    Non-owning N dimensional view of elements a constant stride apart along each axis, ie element (x, y, z) is
+//    data[x * stride(0) + y * stride(1) + z * stride(2)]. Cropping, slicing, permuting axes and downsampling by
+//    stride return new views of the same elements without copying.
+//    marray_view<T, N>:        Mutable elements
+//    const_marray_view<T, N>:  marray_view<const T, N>, a marray_view<T, N> converts to it
+//
+//   USAGE:
+//     marray<float, 3> volume(256, 256, 256);
+//     util::marray_view<float, 3> roi = volume.view().crop(64, 64, 64, 32, 32, 32);
+//     roi.at(0, 0, 0) = 1.0f;                                     // Writes volume.at(64, 64, 64)
+//     util::const_marray_view<float, 2> plane = volume.view().slice(2, 100); // The xy plane z = 100
+//     auto half = volume.view().downsample(2, 2, 2);              // Every second element along each axis
+//     auto yxz = volume.view().permute(1, 0, 2);                  // yxz.at(y, x, z) == volume.at(x, y, z)
+//     marray<float, 3> copy = roi.to_marray();
+//
+//     Stencils on views, ie on a region of interest in place
+//     util::marray_view<float, 3> dst_roi = dst.view().crop(64, 64, 64, 32, 32, 32);
+//     util::apply_stencil<1>(roi, dst_roi, kernel);
+//
+//  NOTES:
+//  - The viewed elements must outlive the view, views of a marray are invalidated when it is resized
+//  - Views are passed to apply_stencil as any array, views with unit x stride take the same path as marray
+//
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <algorithm>
+#include "marray_layout.h"
+
+template <typename T, size_t N, typename A, typename L> class marray;
+
+namespace util {
+
+
+// Layout of a view, in the interface of marray_layout.h
+class marray_view_layout {
+public:
+  static const bool is_linear = false;
+  marray_view_layout() {
+    std::fill(dims_, dims_ + 3, size_t(0));
+    std::fill(strides_, strides_ + 3, size_t(0));
+  }
+  marray_view_layout(size_t w, size_t h, size_t d, size_t stride_x, size_t stride_y, size_t stride_z) {
+    dims_[0] = w;
+    dims_[1] = h;
+    dims_[2] = d;
+    strides_[0] = stride_x;
+    strides_[1] = stride_y;
+    strides_[2] = stride_z;
+  }
+  size_t width() const { return dims_[0]; }
+  size_t height() const { return dims_[1]; }
+  size_t depth() const { return dims_[2]; }
+  size_t dim(size_t axis) const { return dims_[axis]; }
+  size_t stride(size_t axis) const { return strides_[axis]; }
+  size_t offset(size_t x, size_t y, size_t z) const { return x * strides_[0] + y * strides_[1] + z * strides_[2]; }
+  size_t run_length(size_t x) const { return strides_[0] == 1 ? dims_[0] - x : 1; }
+  bool has_strided_rows() const { return strides_[0] == 1; }
+private:
+  size_t dims_[3];
+  size_t strides_[3];
+};
+
+
+// Visits the elements of a view in the order of the linear layout, ie x fastest
+template <typename T>
+class marray_view_iterator {
+public:
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef typename std::remove_const<T>::type value_type;
+  typedef ptrdiff_t difference_type;
+  typedef T* pointer;
+  typedef T& reference;
+  marray_view_iterator() : data_(nullptr), x_(0), y_(0), z_(0) {}
+  marray_view_iterator(T* data, const marray_view_layout& layout, size_t x, size_t y, size_t z) : data_(data), layout_(layout), x_(x), y_(y), z_(z) {}
+
+  reference operator*() const { return data_[layout_.offset(x_, y_, z_)]; }
+  pointer operator->() const { return &**this; }
+  marray_view_iterator& operator++() {
+    if (++x_ == layout_.width()) {
+      x_ = 0;
+      if (++y_ == layout_.height()) {
+        y_ = 0;
+        ++z_;
+      }
+    }
+    return *this;
+  }
+  marray_view_iterator& operator--() {
+    if (x_ == 0) {
+      x_ = layout_.width() - 1;
+      if (y_ == 0) {
+        y_ = layout_.height() - 1;
+        --z_;
+      }
+      else
+        --y_;
+    }
+    else
+      --x_;
+    return *this;
+  }
+  marray_view_iterator operator++(int) { marray_view_iterator ret = *this; ++*this; return ret; }
+  marray_view_iterator operator--(int) { marray_view_iterator ret = *this; --*this; return ret; }
+  bool operator==(const marray_view_iterator& other) const { return x_ == other.x_ && y_ == other.y_ && z_ == other.z_; }
+  bool operator!=(const marray_view_iterator& other) const { return !(*this == other); }
+private:
+  T* data_;
+  marray_view_layout layout_;
+  size_t x_;
+  size_t y_;
+  size_t z_;
+};
+
+
+template <typename T, size_t N>
+class marray_view {
+public:
+  static_assert(N >= 1 && N <= 3, "marray_view is 1D, 2D or 3D");
+  static const size_t dimensions = N;
+  typedef marray_view<T, N> my_type;
+  typedef typename std::remove_const<T>::type value_type;
+  typedef T& reference;
+  typedef T* pointer;
+  typedef marray_view_layout layout_type;
+  typedef marray_view_iterator<T> iterator;
+  typedef marray_view_iterator<T> const_iterator;
+
+  marray_view() : data_(nullptr) {}
+  // Dense elements, ie strides 1, w and w * h
+  marray_view(T* data, size_t w, size_t h = 1, size_t d = 1) : data_(data), layout_(w, h, d, 1, N > 1 ? w : 0, N > 2 ? w * h : 0) {
+    DASSERT((N > 1 || h == 1) && (N > 2 || d == 1));
+  }
+  marray_view(T* data, const marray_view_layout& layout) : data_(data), layout_(layout) {}
+  // Mutable to const view
+  template <typename U, typename = typename std::enable_if<std::is_same<const U, T>::value>::type>
+  marray_view(const marray_view<U, N>& other) : data_(other.data()), layout_(other.layout()) {}
+
+  // Size
+  size_t width() const { return layout_.width(); }
+  size_t height() const { return layout_.height(); }
+  size_t depth() const { return layout_.depth(); }
+  size_t size() const { return width() * height() * depth(); }
+  bool empty() const { return size() == 0; }
+  size_t stride(size_t axis) const { return layout_.stride(axis); }
+  bool is_contiguous() const {
+    return stride(0) == 1 && (N < 2 || height() == 1 || stride(1) == width()) && (N < 3 || depth() == 1 || stride(2) == width() * height());
+  }
+
+  // Element access
+  T& at(size_t x) const {
+    static_assert(N == 1, "");
+    DASSERT(x < width());
+    return data_[x * stride(0)];
+  }
+  T& at(size_t x, size_t y) const {
+    static_assert(N == 2, "");
+    DASSERT(x < width() && y < height());
+    return data_[layout_.offset(x, y, 0)];
+  }
+  T& at(size_t x, size_t y, size_t z) const {
+    static_assert(N == 3, "");
+    DASSERT(x < width() && y < height() && z < depth());
+    return data_[layout_.offset(x, y, z)];
+  }
+
+  iterator begin() const { return iterator(data_, layout_, 0, 0, empty() ? depth() : 0); }
+  iterator end() const { return iterator(data_, layout_, 0, 0, depth()); }
+
+  // Element (0, 0, 0), elements are reached through layout().offset(x, y, z)
+  T* data() const { return data_; }
+  const layout_type& layout() const { return layout_; }
+
+  // Sub views
+  my_type crop(size_t x, size_t w) const {
+    static_assert(N == 1, "");
+    return crop_(x, 0, 0, w, 1, 1);
+  }
+  my_type crop(size_t x, size_t y, size_t w, size_t h) const {
+    static_assert(N == 2, "");
+    return crop_(x, y, 0, w, h, 1);
+  }
+  my_type crop(size_t x, size_t y, size_t z, size_t w, size_t h, size_t d) const {
+    static_assert(N == 3, "");
+    return crop_(x, y, z, w, h, d);
+  }
+  // Every step_x:th element along x etc, starting at element 0
+  my_type downsample(size_t step_x, size_t step_y = 1, size_t step_z = 1) const {
+    DASSERT(step_x > 0 && step_y > 0 && step_z > 0);
+    const marray_view_layout layout(
+      (width() + step_x - 1) / step_x, (height() + step_y - 1) / step_y, (depth() + step_z - 1) / step_z,
+      stride(0) * step_x, stride(1) * step_y, stride(2) * step_z);
+    return my_type(data_, layout);
+  }
+  // Axis i of the result is axis axes[i] of this view
+  my_type permute(size_t axis_x, size_t axis_y, size_t axis_z = 2) const {
+    const size_t axes[3] = { axis_x, axis_y, axis_z };
+    DASSERT(axis_x < N && axis_y < N && axis_z < 3 && axis_x != axis_y && axis_x != axis_z && axis_y != axis_z);
+    const marray_view_layout layout(
+      layout_.dim(axes[0]), layout_.dim(axes[1]), layout_.dim(axes[2]),
+      stride(axes[0]), stride(axes[1]), stride(axes[2]));
+    return my_type(data_, layout);
+  }
+  // The elements at index along axis, the remaining axes keep their order
+  marray_view<T, N - 1> slice(size_t axis, size_t index) const {
+    static_assert(N > 1, "");
+    DASSERT(axis < N && index < layout_.dim(axis));
+    size_t dims[3] = { 1, 1, 1 };
+    size_t strides[3] = { 0, 0, 0 };
+    for (size_t i = 0, j = 0; i < N; ++i) {
+      if (i == axis)
+        continue;
+      dims[j] = layout_.dim(i);
+      strides[j] = stride(i);
+      ++j;
+    }
+    const marray_view_layout layout(dims[0], dims[1], dims[2], strides[0], strides[1], strides[2]);
+    return marray_view<T, N - 1>(data_ + index * stride(axis), layout);
+  }
+
+  // Dense copy
+  template <typename A = std::allocator<value_type> >
+  marray<value_type, N, A, marray_layout_linear> to_marray(const A& allocator = A()) const {
+    marray<value_type, N, A, marray_layout_linear> ret(allocator);
+    ret.set_size(width(), height(), depth());
+    value_type* dst = ret.data();
+    for (size_t z = 0; z < depth(); ++z) {
+      for (size_t y = 0; y < height(); ++y, dst += width())
+        layout_read_row(layout_, static_cast<const value_type*>(data_), 0, y, z, width(), dst);
+    }
+    return ret;
+  }
+
+private:
+  my_type crop_(size_t x, size_t y, size_t z, size_t w, size_t h, size_t d) const {
+    DASSERT(x + w <= width() && y + h <= height() && z + d <= depth());
+    const marray_view_layout layout(w, h, d, stride(0), stride(1), stride(2));
+    return my_type(data_ + layout_.offset(x, y, z), layout);
+  }
+  T* data_;
+  marray_view_layout layout_;
+};
+
+template <typename T, size_t N>
+using const_marray_view = marray_view<const T, N>;
+
+
+} // namespace util
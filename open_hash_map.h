@@ -0,0 +1,130 @@
+//
+//  Open Hash Map
+//    Open addressing hash map (Swiss table layout), see open_hash_set.h for details.
+//
+//   USAGE:
+//     util::open_hash_map<uint32_t, float> weights;
+//     weights.reserve(num_ids);
+//     weights[42] += 1.0f;
+//     auto it = weights.find(42);
+//     if (it != weights.end()) { ... }
+//
+//  NOTES:
+//  - Elements are stored as std::pair<K, V>, ie the key is mutable through iterators, don't modify it
+//  - insert(...) never overwrites the value of an existing key, as std::unordered_map
+//  - References returned by operator[] are invalidated by the next insertion which rehashes
+//
+#pragma once
+
+#include "open_hash_set.h"
+#include <stdexcept>
+#include <tuple>
+
+namespace util {
+
+
+template <typename K, typename V, typename H = open_hash<K>, typename E = std::equal_to<K>, typename A = std::allocator<std::pair<K, V> > >
+class open_hash_map : public _impl_open_hash::raw_table<std::pair<K, V>, K, _impl_open_hash::select_first, H, E, A> {
+  typedef _impl_open_hash::raw_table<std::pair<K, V>, K, _impl_open_hash::select_first, H, E, A> base_type;
+  template <typename Key>
+  using key_arg = typename base_type::template key_arg<Key>;
+public:
+  typedef open_hash_map<K, V, H, E, A> my_type;
+  typedef K key_type;
+  typedef V mapped_type;
+  typedef std::pair<K, V> value_type;
+  typedef value_type& reference;
+  typedef const value_type& const_reference;
+  typedef _impl_open_hash::table_iterator<value_type, value_type> iterator;
+  typedef _impl_open_hash::table_iterator<const value_type, value_type> const_iterator;
+
+  explicit open_hash_map(size_t bucket_count = 0, const H& hash = H(), const E& eq = E(), const A& allocator = A()) : base_type(bucket_count, hash, eq, allocator) {}
+  template <typename IT>
+  open_hash_map(IT start, IT stop, size_t bucket_count = 0, const H& hash = H(), const E& eq = E(), const A& allocator = A()) : base_type(bucket_count, hash, eq, allocator) {
+    insert(start, stop);
+  }
+  open_hash_map(std::initializer_list<value_type> values, size_t bucket_count = 0, const H& hash = H(), const E& eq = E(), const A& allocator = A()) : base_type(bucket_count, hash, eq, allocator) {
+    insert(values.begin(), values.end());
+  }
+
+  // Comparison
+  bool operator==(const open_hash_map& other) const {
+    if (this->size() != other.size())
+      return false;
+    for (const auto& kvp : *this) {
+      const auto it = other.find(kvp.first);
+      if (it == other.end() || !(it->second == kvp.second))
+        return false;
+    }
+    return true;
+  }
+  bool operator!=(const open_hash_map& other) const { return !(*this == other); }
+
+  // Modify collection
+  std::pair<iterator, bool> insert(const value_type& val) { return to_iterator_pair_(this->try_emplace_(val.first, val)); }
+  std::pair<iterator, bool> insert(value_type&& val) { return to_iterator_pair_(this->try_emplace_(val.first, std::move(val))); }
+  template <typename IT>
+  void insert(IT start, IT stop) {
+    for (; start != stop; ++start)
+      insert(*start);
+  }
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+    return to_iterator_pair_(this->try_emplace_(key, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...)));
+  }
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(const K& key, M&& val) {
+    const auto result = try_emplace(key, std::forward<M>(val));
+    if (!result.second)
+      result.first->second = std::forward<M>(val);
+    return result;
+  }
+  template <typename Key = K>
+  size_t erase(const key_arg<Key>& key) { return this->erase_key_(key); }
+  iterator erase(const_iterator it) {
+    const size_t idx = this->index_of_(it.slot());
+    this->erase_index_(idx);
+    return make_iterator_(idx); // Skips to the next element
+  }
+
+  // Element access
+  mapped_type& operator[](const K& key) { return try_emplace(key).first->second; }
+  template <typename Key = K>
+  mapped_type& at(const key_arg<Key>& key) {
+    const size_t idx = this->find_index_(key);
+    if (idx == base_type::npos_)
+      throw std::out_of_range("open_hash_map::at");
+    return this->slots_[idx].second;
+  }
+  template <typename Key = K>
+  const mapped_type& at(const key_arg<Key>& key) const {
+    const size_t idx = this->find_index_(key);
+    if (idx == base_type::npos_)
+      throw std::out_of_range("open_hash_map::at");
+    return this->slots_[idx].second;
+  }
+
+  // Lookup
+  template <typename Key = K>
+  iterator find(const key_arg<Key>& key) { return make_iterator_(this->find_index_(key)); }
+  template <typename Key = K>
+  const_iterator find(const key_arg<Key>& key) const { return make_iterator_(this->find_index_(key)); }
+
+  // Iteration, unspecified order
+  iterator begin() { return iterator(this->ctrl_, this->ctrl_ + this->capacity_, this->slots_); }
+  const_iterator begin() const { return const_iterator(this->ctrl_, this->ctrl_ + this->capacity_, this->slots_); }
+  iterator end() { return make_iterator_(base_type::npos_); }
+  const_iterator end() const { return make_iterator_(base_type::npos_); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+private:
+  iterator make_iterator_(size_t idx) const {
+    const size_t pos = idx == base_type::npos_ ? this->capacity_ : idx;
+    return iterator(this->ctrl_ + pos, this->ctrl_ + this->capacity_, this->slots_ + pos);
+  }
+  std::pair<iterator, bool> to_iterator_pair_(std::pair<size_t, bool> result) const { return std::make_pair(make_iterator_(result.first), result.second); }
+};
+
+
+} // namespace util
@@ -0,0 +1,497 @@
+//
+//  Open Hash Set
+//    Open addressing hash set for membership-heavy workloads (Swiss table layout).
+//    One control byte per slot stores 7 bits of the hash, or marks the slot as empty\deleted.
+//    Lookups compare the control bytes of 16 slots at a time (SSE2, or a scalar loop otherwise) and only
+//    compare keys whose hash bits match, hence a miss rarely touches the elements at all.
+//
+//   USAGE:
+//     util::open_hash_set<uint32_t> ids;
+//     ids.reserve(ids_from_somewhere.size());
+//     ids.insert(ids_from_somewhere.begin(), ids_from_somewhere.end());
+//     if (ids.contains(42)) { ... }
+//
+//     Heterogeneous lookup, enabled when both the hasher and the key comparison define is_transparent
+//     util::open_hash_set<std::string, util::open_hash_string, std::equal_to<> > names;
+//     if (names.contains("name")) { ... } // No std::string constructed
+//
+//  NOTES:
+//  - Integral and enum keys are hashed by util::open_hash without std::hash, all hashes are mixed by the
+//    table, hence identity hashes are fine
+//  - The maximum load factor is 7/8, rehashing drops the tombstones left by erase
+//  - Iterators and references are invalidated by any rehash, ie by insertion unless reserve(...) is used
+//  - Iteration order is unspecified
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <functional>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+#include <initializer_list>
+#include <string>
+#include "bit_count.h"
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#  include <string_view>
+#  define OPEN_HASH_STRING_VIEW_ENABLED
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define OPEN_HASH_SSE2_ENABLED
+#endif
+
+namespace util {
+
+
+// Default hasher, integral keys are passed through and mixed by the table
+template <typename T, bool IS_INTEGRAL = std::is_integral<T>::value || std::is_enum<T>::value>
+struct open_hash : std::hash<T> {};
+template <typename T>
+struct open_hash<T, true> {
+  size_t operator()(T val) const { return static_cast<size_t>(val); }
+};
+
+// Transparent string hasher, use together with std::equal_to<>
+struct open_hash_string {
+  typedef void is_transparent;
+#ifdef OPEN_HASH_STRING_VIEW_ENABLED
+  size_t operator()(std::string_view str) const { return std::hash<std::string_view>()(str); }
+#else
+  size_t operator()(const std::string& str) const { return std::hash<std::string>()(str); }
+#endif
+};
+
+
+namespace _impl_open_hash {
+  typedef int8_t ctrl_t;
+  static const ctrl_t ctrl_empty = -128;
+  static const ctrl_t ctrl_deleted = -2;
+  static const size_t group_width = 16;
+  static const size_t min_capacity = group_width;
+
+  // Multiply-xorshift, spreads the entropy of the hash to both the probe position and the 7 control bits
+  inline uint64_t mix(size_t hash) {
+    const uint64_t product = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+    return product ^ (product >> 32);
+  }
+  inline size_t h1(uint64_t hash) { return static_cast<size_t>(hash >> 7); }
+  inline ctrl_t h2(uint64_t hash) { return static_cast<ctrl_t>(hash & 0x7F); }
+
+  // Control bytes of group_width consecutive slots, bit i of the masks refers to slot i
+  class group {
+  public:
+#ifdef OPEN_HASH_SSE2_ENABLED
+    explicit group(const ctrl_t* pos) : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+    uint32_t match(ctrl_t h) const { return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h), ctrl_))); }
+    uint32_t match_empty() const { return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(ctrl_empty), ctrl_))); }
+    uint32_t match_empty_or_deleted() const { return static_cast<uint32_t>(_mm_movemask_epi8(ctrl_)); } // Sign bit set
+  private:
+    __m128i ctrl_;
+#else
+    explicit group(const ctrl_t* pos) : ctrl_(pos) {}
+    uint32_t match(ctrl_t h) const {
+      uint32_t mask = 0;
+      for (size_t i = 0; i < group_width; ++i)
+        mask |= static_cast<uint32_t>(ctrl_[i] == h) << i;
+      return mask;
+    }
+    uint32_t match_empty() const { return match(ctrl_empty); }
+    uint32_t match_empty_or_deleted() const {
+      uint32_t mask = 0;
+      for (size_t i = 0; i < group_width; ++i)
+        mask |= static_cast<uint32_t>(ctrl_[i] < 0) << i;
+      return mask;
+    }
+  private:
+    const ctrl_t* ctrl_;
+#endif
+  };
+
+  struct identity {
+    template <typename T>
+    const T& operator()(const T& val) const { return val; }
+  };
+  struct select_first {
+    template <typename P>
+    const typename P::first_type& operator()(const P& val) const { return val.first; }
+  };
+
+  template <typename T>
+  struct is_transparent {
+    template <typename U> static std::true_type test(typename U::is_transparent*);
+    template <typename U> static std::false_type test(...);
+    static const bool value = decltype(test<T>(nullptr))::value;
+  };
+  // key_arg<...>::type<K, Key> is K for transparent tables and Key otherwise, as the latter is a non-deduced
+  // context the heterogeneous overloads are hence only selectable when both the hasher and comparison allows it
+  template <bool IS_TRANSPARENT>
+  struct key_arg {
+    template <typename K, typename Key> using type = K;
+  };
+  template <>
+  struct key_arg<false> {
+    template <typename K, typename Key> using type = Key;
+  };
+
+  template <typename Value, typename TableValue>
+  class table_iterator {
+    template <typename, typename> friend class table_iterator;
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename std::remove_const<Value>::type value_type;
+    typedef ptrdiff_t difference_type;
+    typedef Value* pointer;
+    typedef Value& reference;
+
+    table_iterator() : ctrl_(nullptr), ctrl_end_(nullptr), slot_(nullptr) {}
+    table_iterator(const ctrl_t* ctrl, const ctrl_t* ctrl_end, TableValue* slot) : ctrl_(ctrl), ctrl_end_(ctrl_end), slot_(slot) { skip_empty_(); }
+    template <typename OtherValue>
+    table_iterator(const table_iterator<OtherValue, TableValue>& other) : ctrl_(other.ctrl_), ctrl_end_(other.ctrl_end_), slot_(other.slot_) {}
+
+    reference operator*() const { return *slot_; }
+    pointer operator->() const { return slot_; }
+    table_iterator& operator++() { ++ctrl_; ++slot_; skip_empty_(); return *this; }
+    table_iterator operator++(int) { table_iterator ret = *this; ++(*this); return ret; }
+    template <typename OtherValue>
+    bool operator==(const table_iterator<OtherValue, TableValue>& other) const { return ctrl_ == other.ctrl_; }
+    template <typename OtherValue>
+    bool operator!=(const table_iterator<OtherValue, TableValue>& other) const { return ctrl_ != other.ctrl_; }
+    TableValue* slot() const { return slot_; }
+
+  private:
+    void skip_empty_() {
+      while (ctrl_ != ctrl_end_ && *ctrl_ < 0) {
+        ++ctrl_;
+        ++slot_;
+      }
+    }
+    const ctrl_t* ctrl_;
+    const ctrl_t* ctrl_end_;
+    TableValue* slot_;
+  };
+
+  // Shared implementation of open_hash_set and open_hash_map
+  template <typename Value, typename Key, typename KeyOfValue, typename Hash, typename Eq, typename A>
+  class raw_table {
+  protected:
+    typedef std::allocator_traits<A> slot_traits;
+    typedef typename slot_traits::template rebind_alloc<ctrl_t> ctrl_allocator;
+    typedef std::allocator_traits<ctrl_allocator> ctrl_traits;
+    static const bool is_transparent_ = is_transparent<Hash>::value && is_transparent<Eq>::value;
+    template <typename K>
+    using key_arg = typename _impl_open_hash::key_arg<is_transparent_>::template type<K, Key>;
+  public:
+    typedef raw_table<Value, Key, KeyOfValue, Hash, Eq, A> my_type;
+    typedef Value value_type;
+    typedef Key key_type;
+    typedef Hash hasher;
+    typedef Eq key_equal;
+    typedef A allocator_type;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    raw_table(size_t bucket_count, const Hash& hash, const Eq& eq, const A& allocator)
+    : ctrl_(nullptr), slots_(nullptr), capacity_(0), size_(0), growth_left_(0), hash_(hash), eq_(eq), allocator_(allocator) {
+      if (bucket_count > 0)
+        rehash_(capacity_for_(bucket_count));
+    }
+    raw_table(const raw_table& other)
+    : ctrl_(nullptr), slots_(nullptr), capacity_(0), size_(0), growth_left_(0), hash_(other.hash_), eq_(other.eq_),
+      allocator_(slot_traits::select_on_container_copy_construction(other.allocator_)) {
+      copy_elements_(other);
+    }
+    raw_table(raw_table&& other)
+    : ctrl_(other.ctrl_), slots_(other.slots_), capacity_(other.capacity_), size_(other.size_), growth_left_(other.growth_left_),
+      hash_(std::move(other.hash_)), eq_(std::move(other.eq_)), allocator_(std::move(other.allocator_)) {
+      other.ctrl_ = nullptr;
+      other.slots_ = nullptr;
+      other.capacity_ = other.size_ = other.growth_left_ = 0;
+    }
+    raw_table& operator=(const raw_table& other) {
+      if (this == &other)
+        return *this;
+      clear();
+      hash_ = other.hash_;
+      eq_ = other.eq_;
+      copy_elements_(other);
+      return *this;
+    }
+    raw_table& operator=(raw_table&& other) {
+      swap(other);
+      return *this;
+    }
+    ~raw_table() {
+      destroy_elements_();
+      deallocate_(ctrl_, slots_, capacity_);
+    }
+    void swap(raw_table& other) {
+      std::swap(ctrl_, other.ctrl_);
+      std::swap(slots_, other.slots_);
+      std::swap(capacity_, other.capacity_);
+      std::swap(size_, other.size_);
+      std::swap(growth_left_, other.growth_left_);
+      std::swap(hash_, other.hash_);
+      std::swap(eq_, other.eq_);
+      std::swap(allocator_, other.allocator_);
+    }
+
+    // Size
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    size_t bucket_count() const { return capacity_; }
+    float load_factor() const { return capacity_ == 0 ? 0.0f : static_cast<float>(size_) / static_cast<float>(capacity_); }
+    float max_load_factor() const { return 7.0f / 8.0f; }
+    // Makes room for n elements without rehashing
+    void reserve(size_t n) {
+      if (n > size_ + growth_left_)
+        rehash_(capacity_for_(n));
+    }
+    // Rehashes to the smallest capacity holding max(n, size()) elements, drops tombstones
+    void rehash(size_t n) {
+      const size_t new_capacity = capacity_for_(std::max(n, size_));
+      if (new_capacity != capacity_ || growth_left_ != max_growth_(capacity_) - size_)
+        rehash_(new_capacity);
+    }
+    void clear() {
+      destroy_elements_();
+      if (capacity_ > 0) {
+        std::fill(ctrl_, ctrl_ + capacity_ + group_width, ctrl_empty);
+        growth_left_ = max_growth_(capacity_);
+      }
+      size_ = 0;
+    }
+
+    // Lookup
+    template <typename K = key_type>
+    size_t count(const key_arg<K>& key) const { return find_index_(key) == npos_ ? 0 : 1; }
+    template <typename K = key_type>
+    bool contains(const key_arg<K>& key) const { return find_index_(key) != npos_; }
+
+    hasher hash_function() const { return hash_; }
+    key_equal key_eq() const { return eq_; }
+    allocator_type get_allocator() const { return allocator_; }
+
+  protected:
+    static const size_t npos_ = size_t(-1);
+    const Key& key_(const Value& val) const { return KeyOfValue()(val); }
+    template <typename K>
+    uint64_t hash_of_(const K& key) const { return mix(hash_(key)); }
+
+    template <typename K>
+    size_t find_index_(const K& key) const {
+      return capacity_ == 0 ? npos_ : find_index_(key, hash_of_(key));
+    }
+    template <typename K>
+    size_t find_index_(const K& key, uint64_t hash) const {
+      const ctrl_t h = h2(hash);
+      size_t pos = h1(hash) & (capacity_ - 1);
+      for (size_t step = group_width;; step += group_width) {
+        const group g(ctrl_ + pos);
+        for (uint32_t match = g.match(h); match != 0; match &= match - 1) {
+          const size_t idx = (pos + count_trailing_zeros(match)) & (capacity_ - 1);
+          if (eq_(key_(slots_[idx]), key))
+            return idx;
+        }
+        if (g.match_empty() != 0)
+          return npos_;
+        pos = (pos + step) & (capacity_ - 1); // Triangular probing visits every group as capacity_ / group_width is a power of two
+      }
+    }
+    // Inserts value_type(args...) unless key exists, returns the slot index and whether it was inserted
+    template <typename K, typename... Args>
+    std::pair<size_t, bool> try_emplace_(const K& key, Args&&... args) {
+      const uint64_t hash = hash_of_(key);
+      if (capacity_ > 0) {
+        const size_t idx = find_index_(key, hash);
+        if (idx != npos_)
+          return std::make_pair(idx, false);
+      }
+      if (growth_left_ == 0)
+        grow_();
+      const size_t idx = find_insert_slot_(hash);
+      slot_traits::construct(allocator_, slots_ + idx, std::forward<Args>(args)...);
+      growth_left_ -= ctrl_[idx] == ctrl_empty ? 1 : 0; // Reusing a tombstone does not consume growth
+      set_ctrl_(idx, h2(hash));
+      ++size_;
+      return std::make_pair(idx, true);
+    }
+    void erase_index_(size_t idx) {
+      slot_traits::destroy(allocator_, slots_ + idx);
+      set_ctrl_(idx, ctrl_deleted);
+      --size_;
+    }
+    template <typename K>
+    size_t erase_key_(const K& key) {
+      const size_t idx = find_index_(key);
+      if (idx == npos_)
+        return 0;
+      erase_index_(idx);
+      return 1;
+    }
+    size_t index_of_(const Value* slot) const { return static_cast<size_t>(slot - slots_); }
+
+    ctrl_t* ctrl_;
+    Value* slots_;
+    size_t capacity_;
+
+  private:
+    static size_t max_growth_(size_t capacity) { return capacity - capacity / 8; }
+    static size_t capacity_for_(size_t n) {
+      size_t capacity = min_capacity;
+      while (max_growth_(capacity) < n)
+        capacity *= 2;
+      return capacity;
+    }
+    // Writes the control byte, the first group is mirrored after the last slot so that any group can be loaded unaligned
+    void set_ctrl_(size_t idx, ctrl_t h) {
+      ctrl_[idx] = h;
+      if (idx < group_width)
+        ctrl_[capacity_ + idx] = h;
+    }
+    size_t find_insert_slot_(uint64_t hash) const {
+      size_t pos = h1(hash) & (capacity_ - 1);
+      for (size_t step = group_width;; step += group_width) {
+        const uint32_t mask = group(ctrl_ + pos).match_empty_or_deleted();
+        if (mask != 0)
+          return (pos + count_trailing_zeros(mask)) & (capacity_ - 1);
+        pos = (pos + step) & (capacity_ - 1);
+      }
+    }
+    // Out of growth: tombstones are dropped at the same capacity if there are plenty of them, otherwise the capacity is doubled
+    void grow_() {
+      if (capacity_ == 0)
+        rehash_(min_capacity);
+      else if (size_ * 32 <= capacity_ * 25)
+        rehash_(capacity_);
+      else
+        rehash_(capacity_ * 2);
+    }
+    void rehash_(size_t new_capacity) {
+      ctrl_t* old_ctrl = ctrl_;
+      Value* old_slots = slots_;
+      const size_t old_capacity = capacity_;
+      ctrl_allocator ctrl_alloc(allocator_);
+      ctrl_ = ctrl_traits::allocate(ctrl_alloc, new_capacity + group_width);
+      slots_ = slot_traits::allocate(allocator_, new_capacity);
+      capacity_ = new_capacity;
+      std::fill(ctrl_, ctrl_ + capacity_ + group_width, ctrl_empty);
+      for (size_t i = 0; i < old_capacity; ++i) {
+        if (old_ctrl[i] < 0)
+          continue;
+        const uint64_t hash = hash_of_(key_(old_slots[i]));
+        const size_t idx = find_insert_slot_(hash);
+        slot_traits::construct(allocator_, slots_ + idx, std::move(old_slots[i]));
+        slot_traits::destroy(allocator_, old_slots + i);
+        set_ctrl_(idx, h2(hash));
+      }
+      growth_left_ = max_growth_(capacity_) - size_;
+      deallocate_(old_ctrl, old_slots, old_capacity);
+    }
+    void copy_elements_(const raw_table& other) {
+      reserve(other.size_);
+      for (size_t i = 0; i < other.capacity_; ++i) {
+        if (other.ctrl_[i] >= 0)
+          try_emplace_(key_(other.slots_[i]), other.slots_[i]);
+      }
+    }
+    void destroy_elements_() {
+      if (std::is_trivially_destructible<Value>::value)
+        return;
+      for (size_t i = 0; i < capacity_; ++i) {
+        if (ctrl_[i] >= 0)
+          slot_traits::destroy(allocator_, slots_ + i);
+      }
+    }
+    void deallocate_(ctrl_t* ctrl, Value* slots, size_t capacity) {
+      if (capacity == 0)
+        return;
+      ctrl_allocator ctrl_alloc(allocator_);
+      ctrl_traits::deallocate(ctrl_alloc, ctrl, capacity + group_width);
+      slot_traits::deallocate(allocator_, slots, capacity);
+    }
+
+    size_t size_;
+    size_t growth_left_;
+    Hash hash_;
+    Eq eq_;
+    A allocator_;
+  };
+} // namespace _impl_open_hash
+
+
+template <typename T, typename H = open_hash<T>, typename E = std::equal_to<T>, typename A = std::allocator<T> >
+class open_hash_set : public _impl_open_hash::raw_table<T, T, _impl_open_hash::identity, H, E, A> {
+  typedef _impl_open_hash::raw_table<T, T, _impl_open_hash::identity, H, E, A> base_type;
+  template <typename K>
+  using key_arg = typename base_type::template key_arg<K>;
+public:
+  typedef open_hash_set<T, H, E, A> my_type;
+  typedef const T& reference;
+  typedef const T& const_reference;
+  typedef _impl_open_hash::table_iterator<const T, T> iterator;
+  typedef _impl_open_hash::table_iterator<const T, T> const_iterator;
+
+  explicit open_hash_set(size_t bucket_count = 0, const H& hash = H(), const E& eq = E(), const A& allocator = A()) : base_type(bucket_count, hash, eq, allocator) {}
+  template <typename IT>
+  open_hash_set(IT start, IT stop, size_t bucket_count = 0, const H& hash = H(), const E& eq = E(), const A& allocator = A()) : base_type(bucket_count, hash, eq, allocator) {
+    insert(start, stop);
+  }
+  open_hash_set(std::initializer_list<T> values, size_t bucket_count = 0, const H& hash = H(), const E& eq = E(), const A& allocator = A()) : base_type(bucket_count, hash, eq, allocator) {
+    insert(values.begin(), values.end());
+  }
+
+  // Comparison
+  bool operator==(const open_hash_set& other) const {
+    if (this->size() != other.size())
+      return false;
+    for (const auto& val : *this) {
+      if (!other.contains(val))
+        return false;
+    }
+    return true;
+  }
+  bool operator!=(const open_hash_set& other) const { return !(*this == other); }
+
+  // Modify collection
+  std::pair<iterator, bool> insert(const T& val) { return to_iterator_pair_(this->try_emplace_(val, val)); }
+  std::pair<iterator, bool> insert(T&& val) { return to_iterator_pair_(this->try_emplace_(val, std::move(val))); }
+  template <typename IT>
+  void insert(IT start, IT stop) {
+    for (; start != stop; ++start)
+      insert(*start);
+  }
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) { return insert(T(std::forward<Args>(args)...)); }
+  template <typename K = T>
+  size_t erase(const key_arg<K>& key) { return this->erase_key_(key); }
+  iterator erase(const_iterator it) {
+    this->erase_index_(this->index_of_(it.slot()));
+    return ++iterator(it);
+  }
+
+  // Lookup
+  template <typename K = T>
+  const_iterator find(const key_arg<K>& key) const { return make_iterator_(this->find_index_(key)); }
+
+  // Iteration, unspecified order
+  const_iterator begin() const { return const_iterator(this->ctrl_, this->ctrl_ + this->capacity_, this->slots_); }
+  const_iterator end() const { return make_iterator_(base_type::npos_); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+private:
+  const_iterator make_iterator_(size_t idx) const {
+    const size_t pos = idx == base_type::npos_ ? this->capacity_ : idx;
+    return const_iterator(this->ctrl_ + pos, this->ctrl_ + this->capacity_, this->slots_ + pos);
+  }
+  std::pair<iterator, bool> to_iterator_pair_(std::pair<size_t, bool> result) const { return std::make_pair(make_iterator_(result.first), result.second); }
+};
+
+
+} // namespace util
@@ -16,6 +16,7 @@
 //  - The continue keyword is replaced by pcontinue
 //  - pfor will always increment by one
 //  - sfor(...) and sforeach(...) has the same syntax as pfor\pforeach but executes at the current thread
+//  - pfor_partitioner is always defined, without std or boost threads it processes the chunks at the current thread
 //
 //  USAGE:
 //    Range based loop (read only)
@@ -41,6 +42,11 @@
 //      // do something
 //    };
 //
+//    Chunk based loop, using the same chunks as pfor over the same range
+//    pfor_partitioner().for_each_chunk(size_t(0), container.size(), [&](size_t start, size_t stop) {
+//      std::fill(&container[start], &container[stop], 0);
+//    });
+//
 //
 #pragma once
 
@@ -62,6 +68,14 @@
 #  define PARALLEL_FOR_ABSOLUTE_MAX_THREADS 16
 #endif
 
+#ifndef PARALLEL_FOR_DEFAULT_THREAD_TYPE // Thread type used by pfor_partitioner
+#  if defined(PARALLEL_FOR_STD_THREAD_ENABLED)
+#    define PARALLEL_FOR_DEFAULT_THREAD_TYPE ::std::thread
+#  elif defined(PARALLEL_FOR_BOOST_THREAD_ENABLED)
+#    define PARALLEL_FOR_DEFAULT_THREAD_TYPE ::boost::thread
+#  endif
+#endif
+
 
 // Loop macros
 #define PARALLEL_FOREACH_STANDARD(VALUE, CONTAINER) \
@@ -100,6 +114,8 @@
 // Details
 #include <iterator>
 #include <array>
+#include <utility>
+#include <algorithm>
 #include <type_traits>
 
 
@@ -150,6 +166,32 @@ ParallelForeach(ContainerType& container, FunctorType& functor) {
     threads[i].join();
 }
 
+// ChunkRange - Subrange of [start, stop) processed by chunk number chunk_index
+template <typename IndexType>
+::std::pair<IndexType, IndexType>
+ChunkRange(IndexType start, IndexType stop, size_t chunk_index, size_t num_chunks) {
+  const IndexType total_length = stop - start;
+  const IndexType chunk_length = total_length / static_cast<IndexType>(num_chunks); // Avoid unsigned\signed warning
+  const bool is_last_chunk = chunk_index + 1 == num_chunks;
+  const IndexType chunk_start = start + static_cast<IndexType>(chunk_index) * chunk_length;
+  const IndexType chunk_stop = is_last_chunk ? stop : chunk_start + chunk_length;
+  return ::std::make_pair(chunk_start, chunk_stop);
+}
+
+// ParallelForChunks - Calls chunk_functor(chunk_start, chunk_stop) for each chunk in parallel
+template <typename IndexType, typename ChunkFunctorType, typename ThreadType>
+void 
+ParallelForChunks(IndexType start, IndexType stop, size_t num_chunks, ChunkFunctorType& chunk_functor) {
+  ::std::array<ThreadType, ThreadContainerSize> threads;
+  num_chunks = ::std::min(num_chunks, ThreadContainerSize);
+  for(size_t i = 0; i < num_chunks; ++i) {
+    const auto chunk = ChunkRange(start, stop, i, num_chunks);
+    threads[i] = ThreadType(chunk_functor, chunk.first, chunk.second);
+  }
+  for(size_t i = 0; i < num_chunks; ++i)
+    threads[i].join();
+}
+
 // ParallelFor - Iterates from start to stop using functor in parallel
 template <typename IndexType, typename FunctorType, typename ThreadType>
 void 
@@ -158,18 +200,7 @@ ParallelFor(IndexType start, IndexType stop, FunctorType& functor) {
     for(; subrange_start != subrange_stop; ++subrange_start)
       functor(subrange_start);
   };
-  ::std::array<ThreadType, ThreadContainerSize> threads;
-  const IndexType num_threads = static_cast<IndexType>(::_impl_parallel_for::num_utilized_threads<ThreadType>()); // Avoid unsigned\signed warning
-  const IndexType total_length = stop - start;
-  const IndexType chunk_length = total_length/num_threads;
-  for(IndexType i = 0; i < num_threads; ++i) {
-    const bool is_last_chunk = i + 1 == num_threads;
-    const IndexType chunk_start = start + (i * chunk_length);
-    const IndexType chunk_stop = is_last_chunk ? stop : chunk_start + chunk_length;
-    threads[i] = ThreadType(ProcessChunk, chunk_start, chunk_stop);
-  }
-  for(size_t i = 0, i_end = (size_t) num_threads; i < i_end; ++i)
-    threads[i].join();
+  ParallelForChunks<IndexType, decltype(ProcessChunk), ThreadType>(start, stop, ::_impl_parallel_for::num_utilized_threads<ThreadType>(), ProcessChunk);
 }
 
 
@@ -244,4 +275,47 @@ struct SingleForeachHelper {
 };
 
 
-} // namespace _impl_parallel_for
\ No newline at end of file
+} // namespace _impl_parallel_for
+
+
+#ifdef PARALLEL_FOR_DEFAULT_THREAD_TYPE
+// pfor_partitioner - Splits an index range into the same chunks as pfor does, 
+// ie chunk i of for_each_chunk(start, stop, ...) covers the indices visited by thread i of pfor(..., start, stop)
+struct pfor_partitioner {
+  typedef PARALLEL_FOR_DEFAULT_THREAD_TYPE thread_type;
+  pfor_partitioner() : num_chunks_(::_impl_parallel_for::num_utilized_threads<thread_type>()) {}
+  explicit pfor_partitioner(size_t num_chunks) : num_chunks_(::std::max<size_t>(1, ::std::min(num_chunks, ::_impl_parallel_for::ThreadContainerSize))) {}
+  size_t num_chunks() const { return num_chunks_; }
+  template <typename IndexType>
+  ::std::pair<IndexType, IndexType> chunk(IndexType start, IndexType stop, size_t chunk_index) const {
+    return ::_impl_parallel_for::ChunkRange(start, stop, chunk_index, num_chunks_);
+  }
+  template <typename IndexType, typename ChunkFunctorType>
+  void for_each_chunk(IndexType start, IndexType stop, ChunkFunctorType chunk_functor) const {
+    ::_impl_parallel_for::ParallelForChunks<IndexType, ChunkFunctorType, thread_type>(start, stop, num_chunks_, chunk_functor);
+  }
+private:
+  size_t num_chunks_;
+};
+#else
+// pfor_partitioner - Without a thread type the chunks are processed one after another at the current thread,
+// by default as a single chunk
+struct pfor_partitioner {
+  pfor_partitioner() : num_chunks_(1) {}
+  explicit pfor_partitioner(size_t num_chunks) : num_chunks_(::std::max<size_t>(1, ::std::min(num_chunks, ::_impl_parallel_for::ThreadContainerSize))) {}
+  size_t num_chunks() const { return num_chunks_; }
+  template <typename IndexType>
+  ::std::pair<IndexType, IndexType> chunk(IndexType start, IndexType stop, size_t chunk_index) const {
+    return ::_impl_parallel_for::ChunkRange(start, stop, chunk_index, num_chunks_);
+  }
+  template <typename IndexType, typename ChunkFunctorType>
+  void for_each_chunk(IndexType start, IndexType stop, ChunkFunctorType chunk_functor) const {
+    for (size_t i = 0; i < num_chunks_; ++i) {
+      const auto range = chunk(start, stop, i);
+      chunk_functor(range.first, range.second);
+    }
+  }
+private:
+  size_t num_chunks_;
+};
+#endif
\ No newline at end of file
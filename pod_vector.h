@@ -1,38 +1,43 @@
 #pragma once
+#include <memory>
+#include <cstring>
 
 namespace util {
 
 
-template <typename T>
+template <typename T, typename A = std::allocator<T> >
 class pod_vector {
-  typedef pod_vector<T> my_type;
-  
+  typedef pod_vector<T, A> my_type;
+  typedef std::allocator_traits<A> allocator_traits;
+
 public:
   typedef T value_type;
+  typedef A allocator_type;
   static const size_t value_size = sizeof(value_type);
   typedef T* iterator;
   typedef const T* const_iterator;
-  pod_vector(size_t sz = 0) : size_(sz), data_(nullptr) {
+  pod_vector(size_t sz = 0, const allocator_type& allocator = allocator_type()) : data_(nullptr), size_(0), allocator_(allocator) {
     reallocate_(sz);
   }
-  pod_vector(const pod_vector& other) : size_(0), data_(nullptr) {
+  pod_vector(const pod_vector& other) : data_(nullptr), size_(0), allocator_(allocator_traits::select_on_container_copy_construction(other.allocator_)) {
     const auto sz = other.size();
     reallocate_(sz);
     if (sz > 0)
       memcpy((void*) begin(), (void*) other.begin(), value_size*sz);
   }
-  pod_vector(pod_vector&& other) : size_(0), data_(nullptr) {
+  pod_vector(pod_vector&& other) : data_(nullptr), size_(0), allocator_(other.allocator_) {
     std::swap(data_, other.data_);
     std::swap(size_, other.size_);
   }
   pod_vector& operator=(pod_vector&& other) {
     std::swap(data_, other.data_);
     std::swap(size_, other.size_);
+    std::swap(allocator_, other.allocator_);
     return *this;
   }
-  ~pod_vector() { 
-    auto ptr = reintrerpret_cast<uint8_t*>(data_);
-    delete [] ptr;
+  ~pod_vector() {
+    if (data_ != nullptr)
+      allocator_traits::deallocate(allocator_, data_, size_);
   }
   template <typename IT>
   void assign(IT start, IT stop) {
@@ -40,33 +45,28 @@ public:
     reallocate_(new_size);
     std::copy(start, stop, begin());
   }
-  T* data() { return &data_[0]; }
-  const T* data() const { return &data_[0]; }
-  iterator begin() { return &data_[0]; }
-  const_iterator begin() const { return &data_[0]; }
-  iterator end() { return &data_[size_]; }
-  const_iterator end() const { return &data_[size_]; }
+  T* data() { return data_; }
+  const T* data() const { return data_; }
+  iterator begin() { return data_; }
+  const_iterator begin() const { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator end() const { return data_ + size_; }
   size_t size() const { return size_; }
   bool empty() const { return size_ == 0; }
+  allocator_type get_allocator() const { return allocator_; }
 
 private:
   void reallocate_(const size_t new_size) {
     if (new_size == size_)
       return;
-    if (data_ != nullptr) {
-      auto ptr = reintrerpret_cast<uint8_t*>(data_);
-      delete [] ptr;
-    }
-    if (new_size > 0) {
-      auto ptr = new uint8_t[new_size*value_size];
-      data_ = reintrerpret_cast<value_type*>(ptr);
-    } else {
-      data_ = nullptr;
-    }
+    if (data_ != nullptr)
+      allocator_traits::deallocate(allocator_, data_, size_);
+    data_ = new_size > 0 ? allocator_traits::allocate(allocator_, new_size) : nullptr;
     size_ = new_size;
   }
   T* data_;
   size_t size_;
+  allocator_type allocator_;
 };
 
 
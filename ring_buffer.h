@@ -0,0 +1,250 @@
+//
+//  Ring Buffer
+//    Bounded lock-free queues with compile-time capacity, for handing work items between threads.
+//    spsc_ring: Single producer\single consumer, wait-free
+//    mpmc_ring: Multiple producers\multiple consumers, lock-free (bounded queue by D. Vyukov)
+//
+//   USAGE:
+//     Hand-off between two pipeline stages
+//     util::spsc_ring<work_item, 1024> queue;
+//     producer thread: while (!queue.try_push(item)) {}
+//     consumer thread: work_item item; if (queue.try_pop(item)) process(item);
+//
+//     Work queue shared by a thread pool
+//     util::mpmc_ring<task, 4096> tasks;
+//     std::array<task, 64> batch;
+//     const auto num_popped = tasks.pop_n(batch.data(), batch.size());
+//
+//  NOTES:
+//  - N must be a power of two
+//  - Elements are constructed on push and destroyed on pop, unused slots are raw storage
+//  - Producer and consumer indices are placed on separate cache lines in order to avoid false sharing
+//  - push_n\pop_n transfer as many elements as possible (up to n) and returns the number transferred,
+//    the mpmc versions claim all slots with a single atomic operation
+//
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+#ifndef RING_BUFFER_CACHE_LINE_SIZE
+#  define RING_BUFFER_CACHE_LINE_SIZE 64
+#endif
+
+namespace util {
+
+
+template <typename T, size_t N>
+class spsc_ring {
+public:
+  typedef spsc_ring<T, N> my_type;
+  typedef T value_type;
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "spsc_ring capacity must be a power of two");
+
+  spsc_ring() : head_(0), cached_tail_(0), tail_(0), cached_head_(0) {}
+  ~spsc_ring() {
+    for (size_t pos = head_.load(), pos_end = tail_.load(); pos != pos_end; ++pos)
+      slot_(pos)->~value_type();
+  }
+
+  static constexpr size_t capacity() { return N; }
+  size_t size_approx() const { return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire); }
+  bool empty() const { return size_approx() == 0; }
+
+  // Producer
+  bool try_push(const value_type& val) { return try_emplace(val); }
+  bool try_push(value_type&& val) { return try_emplace(std::move(val)); }
+  template <typename... Args>
+  bool try_emplace(Args&&... args) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == N) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ == N)
+        return false;
+    }
+    ::new (static_cast<void*>(slot_(tail))) value_type(std::forward<Args>(args)...);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+  size_t push_n(const value_type* src, size_t n) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (N - (tail - cached_head_) < n)
+      cached_head_ = head_.load(std::memory_order_acquire);
+    const size_t num_pushed = std::min(n, N - (tail - cached_head_));
+    for (size_t i = 0; i < num_pushed; ++i)
+      ::new (static_cast<void*>(slot_(tail + i))) value_type(src[i]);
+    tail_.store(tail + num_pushed, std::memory_order_release);
+    return num_pushed;
+  }
+
+  // Consumer
+  bool try_pop(value_type& dst) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_)
+        return false;
+    }
+    value_type* src = slot_(head);
+    dst = std::move(*src);
+    src->~value_type();
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+  size_t pop_n(value_type* dst, size_t n) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (cached_tail_ - head < n)
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+    const size_t num_popped = std::min(n, cached_tail_ - head);
+    for (size_t i = 0; i < num_popped; ++i) {
+      value_type* src = slot_(head + i);
+      dst[i] = std::move(*src);
+      src->~value_type();
+    }
+    head_.store(head + num_popped, std::memory_order_release);
+    return num_popped;
+  }
+
+private:
+  spsc_ring(const spsc_ring& other);
+  spsc_ring& operator=(const spsc_ring& other);
+  value_type* slot_(size_t position) { return reinterpret_cast<value_type*>(&storage_[(position & (N - 1)) * sizeof(value_type)]); }
+
+  // Consumer side
+  alignas(RING_BUFFER_CACHE_LINE_SIZE) std::atomic<size_t> head_;
+  size_t cached_tail_;
+  // Producer side
+  alignas(RING_BUFFER_CACHE_LINE_SIZE) std::atomic<size_t> tail_;
+  size_t cached_head_;
+  alignas(RING_BUFFER_CACHE_LINE_SIZE) alignas(T) unsigned char storage_[N * sizeof(T)];
+};
+
+
+template <typename T, size_t N>
+class mpmc_ring {
+public:
+  typedef mpmc_ring<T, N> my_type;
+  typedef T value_type;
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "mpmc_ring capacity must be a power of two");
+
+  mpmc_ring() : enqueue_pos_(0), dequeue_pos_(0) {
+    for (size_t i = 0; i < N; ++i)
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  ~mpmc_ring() {
+    for (size_t pos = dequeue_pos_.load(), pos_end = enqueue_pos_.load(); pos != pos_end; ++pos)
+      cells_[pos & (N - 1)].ptr()->~value_type();
+  }
+
+  static constexpr size_t capacity() { return N; }
+  size_t size_approx() const {
+    const size_t enqueued = enqueue_pos_.load(std::memory_order_acquire);
+    const size_t dequeued = dequeue_pos_.load(std::memory_order_acquire);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+  }
+  bool empty() const { return size_approx() == 0; }
+
+  // Producers
+  bool try_push(const value_type& val) { return try_emplace(val); }
+  bool try_push(value_type&& val) { return try_emplace(std::move(val)); }
+  template <typename... Args>
+  bool try_emplace(Args&&... args) {
+    size_t num_claimed = 1;
+    const size_t pos = claim_(enqueue_pos_, num_claimed, 0);
+    if (pos == invalid_position_)
+      return false;
+    cell& c = cells_[pos & (N - 1)];
+    ::new (static_cast<void*>(c.ptr())) value_type(std::forward<Args>(args)...);
+    c.sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+  size_t push_n(const value_type* src, size_t n) {
+    if (n == 0)
+      return 0;
+    size_t num_claimed = n;
+    const size_t pos = claim_(enqueue_pos_, num_claimed, 0);
+    if (pos == invalid_position_)
+      return 0;
+    for (size_t i = 0; i < num_claimed; ++i) {
+      cell& c = cells_[(pos + i) & (N - 1)];
+      ::new (static_cast<void*>(c.ptr())) value_type(src[i]);
+      c.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+    return num_claimed;
+  }
+
+  // Consumers
+  bool try_pop(value_type& dst) {
+    size_t num_claimed = 1;
+    const size_t pos = claim_(dequeue_pos_, num_claimed, 1);
+    if (pos == invalid_position_)
+      return false;
+    pop_cell_(pos, dst);
+    return true;
+  }
+  size_t pop_n(value_type* dst, size_t n) {
+    if (n == 0)
+      return 0;
+    size_t num_claimed = n;
+    const size_t pos = claim_(dequeue_pos_, num_claimed, 1);
+    if (pos == invalid_position_)
+      return 0;
+    for (size_t i = 0; i < num_claimed; ++i)
+      pop_cell_(pos + i, dst[i]);
+    return num_claimed;
+  }
+
+private:
+  mpmc_ring(const mpmc_ring& other);
+  mpmc_ring& operator=(const mpmc_ring& other);
+  static const size_t invalid_position_ = size_t(-1);
+  struct cell {
+    value_type* ptr() { return reinterpret_cast<value_type*>(&storage[0]); }
+    std::atomic<size_t> sequence;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  // Claims up to num_claimed consecutive cells whose sequence equals position + sequence_offset,
+  // returns the first claimed position and updates num_claimed, or returns invalid_position_ if none is available
+  size_t claim_(std::atomic<size_t>& position, size_t& num_claimed, size_t sequence_offset) {
+    const size_t max_claimed = num_claimed;
+    size_t pos = position.load(std::memory_order_relaxed);
+    for (;;) {
+      size_t num_ready = 0;
+      for (; num_ready < max_claimed; ++num_ready) {
+        const size_t seq = cells_[(pos + num_ready) & (N - 1)].sequence.load(std::memory_order_acquire);
+        if (seq != pos + num_ready + sequence_offset)
+          break;
+      }
+      if (num_ready == 0) {
+        const size_t seq = cells_[pos & (N - 1)].sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + sequence_offset);
+        if (diff < 0)
+          return invalid_position_; // Full (producers) or empty (consumers)
+        pos = position.load(std::memory_order_relaxed); // Another thread claimed pos, retry
+        continue;
+      }
+      if (position.compare_exchange_weak(pos, pos + num_ready, std::memory_order_relaxed)) {
+        num_claimed = num_ready;
+        return pos;
+      }
+    }
+  }
+  void pop_cell_(size_t pos, value_type& dst) {
+    cell& c = cells_[pos & (N - 1)];
+    dst = std::move(*c.ptr());
+    c.ptr()->~value_type();
+    c.sequence.store(pos + N, std::memory_order_release);
+  }
+
+  alignas(RING_BUFFER_CACHE_LINE_SIZE) std::atomic<size_t> enqueue_pos_;
+  alignas(RING_BUFFER_CACHE_LINE_SIZE) std::atomic<size_t> dequeue_pos_;
+  alignas(RING_BUFFER_CACHE_LINE_SIZE) cell cells_[N];
+};
+
+
+} // namespace util
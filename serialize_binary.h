@@ -0,0 +1,395 @@
+//
+//  Serialize Binary
+//    Binary archives for persisting and shipping containers, a faster alternative to the text output of
+//    serialize_container.h. Ranges of trivially copyable elements are written and read with a single bulk
+//    stream write\read, other elements are (de)serialized one by one.
+//
+//   USAGE:
+//     std::ofstream ofs("volume.bin", std::ios::binary);
+//     util::output_archive out(ofs);       // Writes the header
+//     util::write(out, volume);            // marray<float, 3>
+//     util::write(out, names);             // std::vector<std::string>
+//
+//     std::ifstream ifs("volume.bin", std::ios::binary);
+//     util::input_archive in(ifs);         // Reads and validates the header
+//     util::read(in, volume);
+//     util::read(in, names);
+//
+//     Custom types are supported by overloading write\read in the namespace of the type or in util
+//     void write(util::output_archive& ar, const point& p) { util::write(ar, p.x); util::write(ar, p.y); }
+//     void read(util::input_archive& ar, point& p) { util::read(ar, p.x); util::read(ar, p.y); }
+//
+//  NOTES:
+//  - Supported: arithmetic types, enums, std::string, std::pair, std::array, std::vector, std::deque, std::map,
+//    std::set, std::unordered_map, std::unordered_set, marray, util::pod_vector, util::cow_vector and any
+//    other trivially copyable type (written as raw bytes)
+//  - Values are written in the byte order of the writer which is stored in the header, the reader swaps
+//    arithmetic values if it differs. Raw bytes of trivially copyable structs can't be swapped and hence
+//    only be read on machines with the same byte order
+//  - Sizes are stored as uint64_t, read errors and corrupt data triggers RASSERT
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <array>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <type_traits>
+
+// Forward declarations, the overloads are instantiated only when used
+template <typename T, size_t N, typename A, typename L> class marray;
+namespace util {
+  template <typename T, typename A> class pod_vector;
+  template <typename T, typename A> class cow_vector;
+}
+
+namespace util {
+
+
+namespace _impl_serialize_binary {
+  static const uint32_t magic = 0x4E435042; // "NCPB"
+  static const uint16_t current_version = 1;
+  static const uint8_t flag_big_endian = 1;
+
+  inline bool is_big_endian() {
+    const uint16_t probe = 1;
+    uint8_t first_byte = 0;
+    memcpy(&first_byte, &probe, 1);
+    return first_byte == 0;
+  }
+
+  template <typename T>
+  void byte_swap(T& val) {
+    unsigned char* bytes = reinterpret_cast<unsigned char*>(&val);
+    std::reverse(bytes, bytes + sizeof(T));
+  }
+
+  // Arithmetic values are byte swapped when the archive was written with another byte order
+  template <typename T>
+  struct is_swappable : std::integral_constant<bool, std::is_arithmetic<T>::value || std::is_enum<T>::value> {};
+  // Elements written as raw bytes
+  template <typename T>
+  struct is_bulk : std::integral_constant<bool, std::is_trivially_copyable<T>::value && !std::is_pointer<T>::value> {};
+} // namespace _impl_serialize_binary
+
+
+class output_archive {
+public:
+  explicit output_archive(std::ostream& os) : os_(os) {
+    const uint32_t magic = _impl_serialize_binary::magic;
+    const uint16_t version = _impl_serialize_binary::current_version;
+    const uint8_t flags = _impl_serialize_binary::is_big_endian() ? _impl_serialize_binary::flag_big_endian : 0;
+    const uint8_t reserved = 0;
+    write_bytes(&magic, sizeof(magic));
+    write_bytes(&version, sizeof(version));
+    write_bytes(&flags, sizeof(flags));
+    write_bytes(&reserved, sizeof(reserved));
+  }
+  void write_bytes(const void* src, size_t num_bytes) {
+    os_.write(static_cast<const char*>(src), static_cast<std::streamsize>(num_bytes));
+    RASSERT_MSG(os_.good(), "output_archive: failed to write " << num_bytes << " bytes");
+  }
+  std::ostream& stream() { return os_; }
+
+private:
+  output_archive(const output_archive& other);
+  output_archive& operator=(const output_archive& other);
+  std::ostream& os_;
+};
+
+
+class input_archive {
+public:
+  explicit input_archive(std::istream& is) : is_(is), version_(0), swap_bytes_(false) {
+    uint32_t magic = 0;
+    uint8_t flags = 0;
+    uint8_t reserved = 0;
+    read_bytes(&magic, sizeof(magic));
+    read_bytes(&version_, sizeof(version_));
+    read_bytes(&flags, sizeof(flags));
+    read_bytes(&reserved, sizeof(reserved));
+    swap_bytes_ = ((flags & _impl_serialize_binary::flag_big_endian) != 0) != _impl_serialize_binary::is_big_endian();
+    if (swap_bytes_) {
+      _impl_serialize_binary::byte_swap(magic);
+      _impl_serialize_binary::byte_swap(version_);
+    }
+    RASSERT_MSG(magic == _impl_serialize_binary::magic, "input_archive: not a binary archive");
+    RASSERT_MSG(version_ <= _impl_serialize_binary::current_version, "input_archive: unsupported archive version " << version_);
+  }
+  void read_bytes(void* dst, size_t num_bytes) {
+    is_.read(static_cast<char*>(dst), static_cast<std::streamsize>(num_bytes));
+    RASSERT_MSG(is_.good(), "input_archive: failed to read " << num_bytes << " bytes");
+  }
+  // Version of the archive being read
+  uint16_t version() const { return version_; }
+  // True if the archive was written with another byte order
+  bool swap_bytes() const { return swap_bytes_; }
+  std::istream& stream() { return is_; }
+
+private:
+  input_archive(const input_archive& other);
+  input_archive& operator=(const input_archive& other);
+  std::istream& is_;
+  uint16_t version_;
+  bool swap_bytes_;
+};
+
+
+// Single values, written as raw bytes
+template <typename T>
+typename std::enable_if<_impl_serialize_binary::is_bulk<T>::value>::type write(output_archive& ar, const T& val) {
+  ar.write_bytes(&val, sizeof(T));
+}
+template <typename T>
+typename std::enable_if<_impl_serialize_binary::is_bulk<T>::value>::type read(input_archive& ar, T& val) {
+  ar.read_bytes(&val, sizeof(T));
+  if (ar.swap_bytes()) {
+    RASSERT_MSG(_impl_serialize_binary::is_swappable<T>::value, "input_archive: raw structs cannot be read with another byte order");
+    _impl_serialize_binary::byte_swap(val);
+  }
+}
+
+// Ranges, one bulk write\read for trivially copyable elements
+template <typename T>
+void write_range(output_archive& ar, const T* src, size_t n) {
+  if (_impl_serialize_binary::is_bulk<T>::value) {
+    if (n > 0)
+      ar.write_bytes(src, n * sizeof(T));
+    return;
+  }
+  for (size_t i = 0; i < n; ++i)
+    write(ar, src[i]);
+}
+template <typename T>
+void read_range(input_archive& ar, T* dst, size_t n) {
+  if (!_impl_serialize_binary::is_bulk<T>::value) {
+    for (size_t i = 0; i < n; ++i)
+      read(ar, dst[i]);
+    return;
+  }
+  if (n == 0)
+    return;
+  ar.read_bytes(dst, n * sizeof(T));
+  if (ar.swap_bytes()) {
+    RASSERT_MSG(_impl_serialize_binary::is_swappable<T>::value, "input_archive: raw structs cannot be read with another byte order");
+    for (size_t i = 0; i < n; ++i)
+      _impl_serialize_binary::byte_swap(dst[i]);
+  }
+}
+
+// Sizes
+inline void write_size(output_archive& ar, size_t n) {
+  write(ar, static_cast<uint64_t>(n));
+}
+inline size_t read_size(input_archive& ar) {
+  uint64_t n = 0;
+  read(ar, n);
+  RASSERT_MSG(n <= uint64_t(std::numeric_limits<size_t>::max()), "input_archive: size " << n << " out of range");
+  return static_cast<size_t>(n);
+}
+
+
+namespace _impl_serialize_binary {
+  template <typename C>
+  void write_elements(output_archive& ar, const C& container) {
+    write_size(ar, container.size());
+    for (const auto& val : container)
+      write(ar, val);
+  }
+  // Elements are read into a temporary and inserted with a hint at the end, which is constant time for sorted containers
+  template <typename C, typename V>
+  void read_elements(input_archive& ar, C& container) {
+    container.clear();
+    const size_t n = read_size(ar);
+    for (size_t i = 0; i < n; ++i) {
+      V val;
+      read(ar, val);
+      container.insert(container.end(), std::move(val));
+    }
+  }
+  // Element count of a marray of n dimensions read from a file. The product must not overflow and the axes
+  // beyond n must be 1, or 0 in an empty marray
+  inline size_t marray_size(size_t n, uint64_t w, uint64_t h, uint64_t d) {
+    const uint64_t max_size = std::numeric_limits<size_t>::max();
+    RASSERT_MSG((h == 0 || w <= max_size / h) && (d == 0 || w * h <= max_size / d), "marray dimensions " << w << "x" << h << "x" << d << " overflow");
+    const uint64_t size = w * h * d;
+    RASSERT_MSG((n >= 2 || h == 1 || size == 0) && (n >= 3 || d == 1 || size == 0), "marray dimensions " << w << "x" << h << "x" << d << " exceed " << n << " dimensions");
+    return static_cast<size_t>(size);
+  }
+} // namespace _impl_serialize_binary
+
+
+// std::string
+template <typename C, typename TR, typename A>
+void write(output_archive& ar, const std::basic_string<C, TR, A>& str) {
+  write_size(ar, str.size());
+  write_range(ar, str.data(), str.size());
+}
+template <typename C, typename TR, typename A>
+void read(input_archive& ar, std::basic_string<C, TR, A>& str) {
+  str.resize(read_size(ar));
+  if (!str.empty())
+    read_range(ar, &str[0], str.size());
+}
+
+// std::pair
+template <typename T, typename Y>
+void write(output_archive& ar, const std::pair<T, Y>& pair) {
+  write(ar, pair.first);
+  write(ar, pair.second);
+}
+template <typename T, typename Y>
+void read(input_archive& ar, std::pair<T, Y>& pair) {
+  read(ar, const_cast<typename std::remove_const<T>::type&>(pair.first)); // Key of map::value_type
+  read(ar, pair.second);
+}
+
+// std::array
+template <typename T, size_t N>
+void write(output_archive& ar, const std::array<T, N>& container) {
+  write_size(ar, N);
+  write_range(ar, container.data(), N);
+}
+template <typename T, size_t N>
+void read(input_archive& ar, std::array<T, N>& container) {
+  const size_t n = read_size(ar);
+  RASSERT_MSG(n == N, "input_archive: std::array size mismatch, expected " << N << " got " << n);
+  read_range(ar, container.data(), N);
+}
+
+// std::vector
+template <typename T, typename A>
+void write(output_archive& ar, const std::vector<T, A>& container) {
+  write_size(ar, container.size());
+  write_range(ar, container.data(), container.size());
+}
+template <typename T, typename A>
+void read(input_archive& ar, std::vector<T, A>& container) {
+  container.resize(read_size(ar));
+  read_range(ar, container.data(), container.size());
+}
+
+// std::deque
+template <typename T, typename A>
+void write(output_archive& ar, const std::deque<T, A>& container) {
+  _impl_serialize_binary::write_elements(ar, container);
+}
+template <typename T, typename A>
+void read(input_archive& ar, std::deque<T, A>& container) {
+  container.resize(read_size(ar));
+  for (auto& val : container)
+    read(ar, val);
+}
+
+// std::map\std::set
+template <typename K, typename V, typename C, typename A>
+void write(output_archive& ar, const std::map<K, V, C, A>& container) {
+  _impl_serialize_binary::write_elements(ar, container);
+}
+template <typename K, typename V, typename C, typename A>
+void read(input_archive& ar, std::map<K, V, C, A>& container) {
+  _impl_serialize_binary::read_elements<std::map<K, V, C, A>, std::pair<K, V> >(ar, container);
+}
+template <typename T, typename C, typename A>
+void write(output_archive& ar, const std::set<T, C, A>& container) {
+  _impl_serialize_binary::write_elements(ar, container);
+}
+template <typename T, typename C, typename A>
+void read(input_archive& ar, std::set<T, C, A>& container) {
+  _impl_serialize_binary::read_elements<std::set<T, C, A>, T>(ar, container);
+}
+
+// std::unordered_map\std::unordered_set
+template <typename K, typename V, typename H, typename E, typename A>
+void write(output_archive& ar, const std::unordered_map<K, V, H, E, A>& container) {
+  _impl_serialize_binary::write_elements(ar, container);
+}
+template <typename K, typename V, typename H, typename E, typename A>
+void read(input_archive& ar, std::unordered_map<K, V, H, E, A>& container) {
+  const size_t n = read_size(ar);
+  container.clear();
+  container.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    std::pair<K, V> val;
+    read(ar, val);
+    container.insert(std::move(val));
+  }
+}
+template <typename T, typename H, typename E, typename A>
+void write(output_archive& ar, const std::unordered_set<T, H, E, A>& container) {
+  _impl_serialize_binary::write_elements(ar, container);
+}
+template <typename T, typename H, typename E, typename A>
+void read(input_archive& ar, std::unordered_set<T, H, E, A>& container) {
+  const size_t n = read_size(ar);
+  container.clear();
+  container.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    T val;
+    read(ar, val);
+    container.insert(std::move(val));
+  }
+}
+
+// util::pod_vector
+template <typename T, typename A>
+void write(output_archive& ar, const pod_vector<T, A>& container) {
+  write_size(ar, container.size());
+  write_range(ar, container.data(), container.size());
+}
+template <typename T, typename A>
+void read(input_archive& ar, pod_vector<T, A>& container) {
+  const size_t n = read_size(ar);
+  if (n != container.size())
+    container = pod_vector<T, A>(n, container.get_allocator());
+  read_range(ar, container.data(), n);
+}
+
+// util::cow_vector, reading detaches the vector from its copies
+template <typename T, typename A>
+void write(output_archive& ar, const cow_vector<T, A>& container) {
+  write(ar, container.read());
+}
+template <typename T, typename A>
+void read(input_archive& ar, cow_vector<T, A>& container) {
+  typename cow_vector<T, A>::vector_type values;
+  read(ar, values);
+  container = std::move(values);
+}
+
+// marray, dimensions followed by the elements, which are read without being value-initialized first
+template <typename T, size_t N, typename A, typename L>
+void write(output_archive& ar, const marray<T, N, A, L>& container) {
+  static_assert(L::is_linear, "serialization of marray requires the linear layout, see util::convert_layout");
+  write_size(ar, container.width());
+  write_size(ar, container.height());
+  write_size(ar, container.depth());
+  write_range(ar, container.data(), container.size());
+}
+template <typename T, size_t N, typename A, typename L>
+void read(input_archive& ar, marray<T, N, A, L>& container) {
+  static_assert(L::is_linear, "serialization of marray requires the linear layout, see util::convert_layout");
+  const size_t w = read_size(ar);
+  const size_t h = read_size(ar);
+  const size_t d = read_size(ar);
+  const size_t size = _impl_serialize_binary::marray_size(N, w, h, d);
+  typename marray<T, N, A, L>::container_type values(container.get_allocator());
+  values.resize_uninitialized(size);
+  read_range(ar, values.data(), values.size());
+  container.set_data(w, h, d, std::move(values));
+}
+
+
+} // namespace util
@@ -1,13 +1,61 @@
 #pragma once
-#include <sstream>
+#include <ostream>
 #include <vector>
 #include <deque>
 #include <map>
 #include <set>
-#include <hash_map>
-#include <hash_set>
+#include <unordered_map>
+#include <unordered_set>
 #include <array>
 
+// The elements are written through the stream, hence manipulators such as std::setprecision and std::hex apply.
+// Same format as the bracket_style of util::format_buffer, which is faster but ignores the stream state
+
+// Declared ahead of the helpers, which write nested containers through unqualified operator<<
+template <typename T, typename Y>
+std::ostream& operator <<(std::ostream& os, const std::pair<T, Y>& container);
+template <typename T, typename A>
+std::ostream& operator <<(std::ostream& os, const std::vector<T, A>& container);
+template <typename T, typename A>
+std::ostream& operator <<(std::ostream& os, const std::deque<T, A>& container);
+template <typename T, size_t N>
+std::ostream& operator <<(std::ostream& os, const std::array<T, N>& container);
+template <typename K, typename V, typename C, typename A>
+std::ostream& operator <<(std::ostream& os, const std::map<K, V, C, A>& container);
+template <typename T, typename C, typename A>
+std::ostream& operator <<(std::ostream& os, const std::set<T, C, A>& container);
+template <typename K, typename V, typename H, typename E, typename A>
+std::ostream& operator <<(std::ostream& os, const std::unordered_map<K, V, H, E, A>& container);
+template <typename T, typename H, typename E, typename A>
+std::ostream& operator <<(std::ostream& os, const std::unordered_set<T, H, E, A>& container);
+
+namespace _impl_serialize_container {
+  // Delimited sequence, "[a, b, c]"
+  template <typename IT>
+  std::ostream& write_sequence(std::ostream& os, IT first, IT last) {
+    os << "[";
+    for (IT it = first; it != last; ++it) {
+      if (it != first)
+        os << ", ";
+      os << *it;
+    }
+    os << "]";
+    return os;
+  }
+  // Map, "[{key, value}, ...]"
+  template <typename IT>
+  std::ostream& write_map(std::ostream& os, IT first, IT last) {
+    os << "[";
+    for (IT it = first; it != last; ++it) {
+      if (it != first)
+        os << ", ";
+      os << "{" << it->first << ", " << it->second << "}";
+    }
+    os << "]";
+    return os;
+  }
+} // namespace _impl_serialize_container
+
 
 template <typename T, typename Y>
 std::ostream& operator <<(std::ostream& os, const std::pair<T, Y>& container) {
@@ -15,87 +63,37 @@ std::ostream& operator <<(std::ostream& os, const std::pair<T, Y>& container) {
   return os;
 }
 
-template <typename T>
-std::ostream& operator <<(std::ostream& os, const std::vector<T>& container) {
-  os << "[";
-  if (!container.empty()) {
-    for (auto it = container.begin(); std::next(it) != container.end(); ++it)
-      os << *it << ", ";
-    os << container.back();
-  }
-  os << "]";
-  return os;
+template <typename T, typename A>
+std::ostream& operator <<(std::ostream& os, const std::vector<T, A>& container) {
+  return _impl_serialize_container::write_sequence(os, container.begin(), container.end());
 }
 
-template <typename T>
-std::ostream& operator <<(std::ostream& os, const std::deque<T>& container) {
-  os << "[";
-  if (!container.empty()) {
-    for (auto it = container.begin(); std::next(it) != container.end(); ++it)
-      os << *it << ", ";
-    os << container.back();
-  }
-  os << "]";
-  return os;
+template <typename T, typename A>
+std::ostream& operator <<(std::ostream& os, const std::deque<T, A>& container) {
+  return _impl_serialize_container::write_sequence(os, container.begin(), container.end());
 }
 
 template <typename T, size_t N>
 std::ostream& operator <<(std::ostream& os, const std::array<T, N>& container) {
-  os << "[";
-  if (!container.empty()) {
-    for (auto it = container.begin(); std::next(it) != container.end(); ++it)
-      os << *it << ", ";
-    os << container.back();
-  }
-  os << "]";
-  return os;
+  return _impl_serialize_container::write_sequence(os, container.begin(), container.end());
 }
 
-template <typename K, typename V>
-std::ostream& operator <<(std::ostream& os, const std::map<K, V>& container) {
-  os << "[";
-  if (!container.empty()) {
-    for (auto it = container.begin(); std::next(it) != container.end(); ++it)
-      os << "{" << it->first << ", " << it->second << "}, ";
-    auto last = std::prev(container.end());
-    os << "{" << last->first << ", " << last->second << "}, ";
-  }
-  os << "]";
-  return os;
+template <typename K, typename V, typename C, typename A>
+std::ostream& operator <<(std::ostream& os, const std::map<K, V, C, A>& container) {
+  return _impl_serialize_container::write_map(os, container.begin(), container.end());
 }
 
-template <typename T>
-std::ostream& operator <<(std::ostream& os, const std::set<T>& container) {
-  os << "[";
-  if (!container.empty()) {
-    for (auto it = container.begin(); std::next(it) != container.end(); ++it)
-      os << *it << ", ";
-    os << container.back();
-  }
-  os << "]";
-  return os;
+template <typename T, typename C, typename A>
+std::ostream& operator <<(std::ostream& os, const std::set<T, C, A>& container) {
+  return _impl_serialize_container::write_sequence(os, container.begin(), container.end());
 }
 
-template <typename K, typename V>
-std::ostream& operator <<(std::ostream& os, const std::hash_map<K, V>& container) {
-  os << "[";
-  if (!container.empty()) {
-    for (auto it = container.begin(); std::next(it) != container.end(); ++it)
-      os << "{" << it->first << ", " << it->second << "}, ";
-    os << container.back();
-  }
-  os << "]";
-  return os;
+template <typename K, typename V, typename H, typename E, typename A>
+std::ostream& operator <<(std::ostream& os, const std::unordered_map<K, V, H, E, A>& container) {
+  return _impl_serialize_container::write_map(os, container.begin(), container.end());
 }
 
-template <typename T>
-std::ostream& operator <<(std::ostream& os, const std::hash_set<T>& container) {
-  os << "[";
-  if (!container.empty()) {
-    for (auto it = container.begin(); std::next(it) != container.end(); ++it)
-      os << *it << ", ";
-    os << container.back();
-  }
-  os << "]";
-  return os;
-}
\ No newline at end of file
+template <typename T, typename H, typename E, typename A>
+std::ostream& operator <<(std::ostream& os, const std::unordered_set<T, H, E, A>& container) {
+  return _impl_serialize_container::write_sequence(os, container.begin(), container.end());
+}
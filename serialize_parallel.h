@@ -0,0 +1,284 @@
+//
+//  Serialize Parallel
+//    Parallel serialization of large vectors and marrays on the pfor threads. The container is split into
+//    independent chunks which are encoded in parallel and written in order.
+//    Binary: The chunked stream format of serialize_stream.h with a chunk index, optionally compressed by a
+//            codec of stream_codec.h. Reload decodes the chunks in parallel
+//    Text:   Same text as the operator<< of format_buffer.h, ie "[1, 2, 3]", with the chunks formatted in
+//            parallel. Reload of numbers splits the text at separators and parses the parts in parallel
+//
+//   USAGE:
+//     std::ofstream ofs("volume.bin", std::ios::binary);
+//     util::write_parallel<util::lz_codec>(ofs, volume);     // marray<float, 3>
+//     marray<float, 3> loaded;
+//     util::read_parallel<util::lz_codec>("volume.bin", loaded);
+//
+//     std::ofstream txt("samples.txt");
+//     util::format_parallel(txt, samples);                  // std::vector<double>
+//     std::vector<double> parsed;
+//     util::parse_parallel(text.data(), text.size(), parsed);
+//
+//  NOTES:
+//  - Binary vectors are plain streams and can also be read by stream_reader, marray files start with their
+//    dimensions followed by the stream
+//  - Reading into std::vector value-initializes it serially first, util::default_init_vector is left uninitialized
+//    and filled by the decoding threads only
+//  - parse_parallel reads numbers written in bracket_style or json_style, JSON null is read as NaN
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <type_traits>
+#include "uninitialized_vector.h"
+#include "serialize_stream.h"
+#include "format_buffer.h"
+
+#ifndef SERIALIZE_PARALLEL_TEXT_CHUNK // Number of elements per chunk when formatting text
+#  define SERIALIZE_PARALLEL_TEXT_CHUNK 65536
+#endif
+
+namespace util {
+
+
+namespace _impl_serialize_parallel {
+  static const uint32_t marray_magic = 0x5941524D; // "MRAY"
+
+  struct marray_header {
+    uint32_t magic;
+    uint32_t dimensions;
+    uint64_t dims[3];
+  };
+
+  inline bool is_space(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+  inline const char* skip_space(const char* pos, const char* end) {
+    while (pos != end && is_space(*pos))
+      ++pos;
+    return pos;
+  }
+
+  // Numbers are followed by a separator, hence the C fallbacks never read past the text
+  template <typename T>
+  const char* parse_number(const char* pos, const char* end, T& val, std::false_type) {
+#ifdef FORMAT_BUFFER_TO_CHARS_ENABLED
+    const auto result = std::from_chars(pos, end, val);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+#else
+    char* parse_end = nullptr;
+    if (std::is_signed<T>::value) {
+      const long long parsed = strtoll(pos, &parse_end, 10);
+      if (parsed < static_cast<long long>(std::numeric_limits<T>::min()) || parsed > static_cast<long long>(std::numeric_limits<T>::max()))
+        return nullptr;
+      val = static_cast<T>(parsed);
+    }
+    else {
+      if (*pos == '-')
+        return nullptr;
+      const unsigned long long parsed = strtoull(pos, &parse_end, 10);
+      if (parsed > static_cast<unsigned long long>(std::numeric_limits<T>::max()))
+        return nullptr;
+      val = static_cast<T>(parsed);
+    }
+    return parse_end != pos && parse_end <= end ? parse_end : nullptr;
+#endif
+  }
+  template <typename T>
+  const char* parse_number(const char* pos, const char* end, T& val, std::true_type) {
+    if (end - pos >= 4 && memcmp(pos, "null", 4) == 0) {
+      val = std::numeric_limits<T>::quiet_NaN();
+      return pos + 4;
+    }
+#if defined(FORMAT_BUFFER_TO_CHARS_ENABLED) && defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    const auto result = std::from_chars(pos, end, val);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+#else
+    char* parse_end = nullptr;
+    val = static_cast<T>(strtod(pos, &parse_end));
+    return parse_end != pos && parse_end <= end ? parse_end : nullptr;
+#endif
+  }
+  template <typename T>
+  const char* parse_value(const char* pos, const char* end, T& val) {
+    return parse_number(pos, end, val, std::integral_constant<bool, std::is_floating_point<T>::value>());
+  }
+
+  // Parses the n values of [pos, end), separated by commas, the last one with trailing_comma = false
+  template <typename T>
+  void parse_values(const char* pos, const char* end, T* dst, size_t n, bool trailing_comma) {
+    for (size_t i = 0; i < n; ++i) {
+      pos = skip_space(pos, end);
+      pos = pos != end ? parse_value(pos, end, dst[i]) : nullptr;
+      RASSERT_MSG(pos != nullptr, "parse_parallel: invalid value");
+      pos = skip_space(pos, end);
+      if (i + 1 < n || trailing_comma) {
+        RASSERT_MSG(pos != end && *pos == ',', "parse_parallel: expected ','");
+        ++pos;
+      }
+    }
+    RASSERT_MSG(skip_space(pos, end) == end, "parse_parallel: unexpected text");
+  }
+} // namespace _impl_serialize_parallel
+
+
+// Binary
+template <typename Codec, typename T>
+void write_parallel(std::ostream& os, const T* data, size_t n, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  stream_writer<T, Codec> writer(os);
+  writer.append_parallel(data, n, partitioner);
+  writer.finish();
+}
+template <typename Codec, typename T, typename A>
+void write_parallel(std::ostream& os, const std::vector<T, A>& container, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  write_parallel<Codec>(os, container.data(), container.size(), partitioner);
+}
+template <typename Codec, typename T, size_t N, typename A, typename L>
+void write_parallel(std::ostream& os, const marray<T, N, A, L>& container, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  static_assert(L::is_linear, "write_parallel requires the linear layout, see util::convert_layout");
+  _impl_serialize_parallel::marray_header h;
+  memset(&h, 0, sizeof(h));
+  h.magic = _impl_serialize_parallel::marray_magic;
+  h.dimensions = static_cast<uint32_t>(N);
+  h.dims[0] = container.width();
+  h.dims[1] = container.height();
+  h.dims[2] = container.depth();
+  os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  RASSERT_MSG(os.good(), "write_parallel: failed to write header");
+  write_parallel<Codec>(os, container.data(), container.size(), partitioner);
+}
+
+// std::vector value-initializes the elements on the calling thread before they are decoded
+template <typename Codec, typename T, typename A>
+void read_parallel(const void* data, size_t size, std::vector<T, A>& container, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  container.clear();
+  container.resize(stream_size(data, size));
+  read_stream_parallel<T, Codec>(data, size, container.data(), container.size(), partitioner);
+}
+// The decoding threads touch the pages first
+template <typename Codec, typename T, typename A>
+void read_parallel(const void* data, size_t size, default_init_vector<T, A>& container, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  container.clear();
+  container.resize_uninitialized(stream_size(data, size));
+  read_stream_parallel<T, Codec>(data, size, container.data(), container.size(), partitioner);
+}
+template <typename Codec, typename T, size_t N, typename A, typename L>
+void read_parallel(const void* data, size_t size, marray<T, N, A, L>& container, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  static_assert(L::is_linear, "read_parallel requires the linear layout, see util::convert_layout");
+  _impl_serialize_parallel::marray_header h;
+  RASSERT_MSG(size >= sizeof(h), "read_parallel: file too small");
+  memcpy(&h, data, sizeof(h));
+  RASSERT_MSG(h.magic == _impl_serialize_parallel::marray_magic && h.dimensions == N, "read_parallel: not a marray of " << N << " dimensions");
+  const char* stream = static_cast<const char*>(data) + sizeof(h);
+  const size_t stream_bytes = size - sizeof(h);
+  const size_t num_elements = _impl_serialize_binary::marray_size(N, h.dims[0], h.dims[1], h.dims[2]);
+  const size_t stream_elements = stream_size(stream, stream_bytes);
+  RASSERT_MSG(stream_elements == num_elements, "read_parallel: " << stream_elements << " elements, expected " << num_elements);
+  // The decoding threads touch the pages first
+  typename marray<T, N, A, L>::container_type values(container.get_allocator());
+  values.resize_uninitialized(num_elements);
+  read_stream_parallel<T, Codec>(stream, stream_bytes, values.data(), values.size(), partitioner);
+  container.set_data(static_cast<size_t>(h.dims[0]), static_cast<size_t>(h.dims[1]), static_cast<size_t>(h.dims[2]), std::move(values));
+}
+// Reads a file, which is memory mapped
+template <typename Codec, typename C>
+void read_parallel(const std::string& path, C& container, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  const mapped_file file(path);
+  RASSERT_MSG(file.is_open(), "read_parallel: cannot map " << path);
+  read_parallel<Codec>(file.data(), file.size(), container, partitioner);
+}
+
+
+// Text
+template <typename T>
+void format_parallel(std::ostream& os, const T* data, size_t n, format_buffer::style s = format_buffer::bracket_style, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  const size_t chunk_size = SERIALIZE_PARALLEL_TEXT_CHUNK;
+  const size_t num_chunks = (n + chunk_size - 1) / chunk_size;
+  const size_t batch_size = partitioner.num_chunks() * 4;
+  std::vector<format_buffer> buffers(std::min(num_chunks, batch_size), format_buffer(s, 0));
+  os.put('[');
+  for (size_t batch_start = 0; batch_start < num_chunks; batch_start += batch_size) {
+    const size_t batch_stop = std::min(num_chunks, batch_start + batch_size);
+    partitioner.for_each_chunk(batch_start, batch_stop, [&buffers, data, n, chunk_size, batch_start](size_t start, size_t stop) {
+      for (size_t i = start; i < stop; ++i) {
+        format_buffer& buf = buffers[i - batch_start];
+        buf.clear();
+        const size_t element_stop = std::min(n, (i + 1) * chunk_size);
+        for (size_t j = i * chunk_size; j < element_stop; ++j) {
+          if (j != 0)
+            buf.append(", ", 2);
+          buf << data[j];
+        }
+      }
+    });
+    for (size_t i = batch_start; i < batch_stop; ++i)
+      os.write(buffers[i - batch_start].data(), static_cast<std::streamsize>(buffers[i - batch_start].size()));
+  }
+  os.put(']');
+  RASSERT_MSG(os.good(), "format_parallel: failed to write");
+}
+template <typename T, typename A>
+void format_parallel(std::ostream& os, const std::vector<T, A>& container, format_buffer::style s = format_buffer::bracket_style, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  format_parallel(os, container.data(), container.size(), s, partitioner);
+}
+// The elements of a marray as a flat sequence
+template <typename T, size_t N, typename A, typename L>
+void format_parallel(std::ostream& os, const marray<T, N, A, L>& container, format_buffer::style s = format_buffer::bracket_style, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  static_assert(L::is_linear, "format_parallel requires the linear layout, see util::convert_layout");
+  format_parallel(os, container.data(), container.size(), s, partitioner);
+}
+
+// Parses a sequence of numbers, ie "[1, 2, 3]"
+template <typename T, typename A>
+void parse_parallel(const char* text, size_t size, std::vector<T, A>& values, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  using namespace _impl_serialize_parallel;
+  static_assert(std::is_arithmetic<T>::value && !std::is_same<T, char>::value && !std::is_same<T, bool>::value, "parse_parallel reads numbers");
+  const char* first = skip_space(text, text + size);
+  const char* last = text + size;
+  while (last != first && is_space(last[-1]))
+    --last;
+  RASSERT_MSG(last - first >= 2 && *first == '[' && last[-1] == ']', "parse_parallel: expected [...]");
+  ++first;
+  --last;
+  values.clear();
+  if (skip_space(first, last) == last)
+    return;
+  // Parts start after a comma, except the first. An element belongs to the part holding its first character
+  const size_t num_parts = partitioner.num_chunks();
+  const size_t text_size = static_cast<size_t>(last - first);
+  std::vector<const char*> bounds(num_parts + 1, last);
+  bounds[0] = first;
+  for (size_t i = 1; i < num_parts; ++i) {
+    const char* pos = std::max(bounds[i - 1], first + text_size * i / num_parts);
+    pos = std::find(pos, last, ',');
+    bounds[i] = pos != last ? pos + 1 : last;
+  }
+  std::vector<size_t> num_commas(num_parts, 0);
+  partitioner.for_each_chunk(size_t(0), num_parts, [&](size_t start, size_t stop) {
+    for (size_t i = start; i < stop; ++i)
+      num_commas[i] = static_cast<size_t>(std::count(bounds[i], bounds[i + 1], ','));
+  });
+  // The part holding the last element has one element more than commas
+  size_t last_part = 0;
+  for (size_t i = 0; i < num_parts; ++i) {
+    if (skip_space(bounds[i], bounds[i + 1]) != bounds[i + 1])
+      last_part = i;
+  }
+  std::vector<size_t> offsets(num_parts + 1, 0);
+  for (size_t i = 0; i < num_parts; ++i)
+    offsets[i + 1] = offsets[i] + num_commas[i] + (i == last_part ? 1 : 0);
+  values.resize(offsets[num_parts]);
+  T* dst = values.data();
+  partitioner.for_each_chunk(size_t(0), num_parts, [&](size_t start, size_t stop) {
+    for (size_t i = start; i < stop; ++i)
+      parse_values(bounds[i], bounds[i + 1], dst + offsets[i], offsets[i + 1] - offsets[i], i != last_part);
+  });
+}
+
+
+} // namespace util
@@ -0,0 +1,511 @@
+//
+//  Serialize Stream
+//    Streaming serialization of containers which are produced or consumed incrementally and may be larger
+//    than memory. Elements are appended to a stream_writer which writes them in framed chunks of about
+//    SERIALIZE_STREAM_CHUNK_SIZE bytes, a stream_reader iterates them back holding one chunk at a time.
+//    Each chunk is encoded with a codec from stream_codec.h and is decodable on its own, the stream ends
+//    with a chunk index, so a stream in memory or in a file can be decoded in parallel.
+//
+//   USAGE:
+//     std::ofstream ofs("samples.bin", std::ios::binary);
+//     util::stream_writer<sample, util::lz_codec> writer(ofs);
+//     for (...)
+//       writer.push_back(make_sample(...));
+//     writer.append_parallel(samples.data(), samples.size());  // Encodes full chunks on the pfor threads
+//     writer.finish();                                        // Writes the chunk index, also done by the destructor
+//
+//     std::ifstream ifs("samples.bin", std::ios::binary);
+//     util::stream_reader<sample, util::lz_codec> reader(ifs);
+//     sample s;
+//     while (reader.next(s)) { ... }
+//
+//     Parallel reload, decodes the chunks on the pfor threads
+//     std::vector<sample> samples = util::read_stream_parallel<sample, util::lz_codec>("samples.bin");
+//
+//  NOTES:
+//  - Trivially copyable elements are stored as raw bytes, other elements are written with the write\read
+//    overloads of serialize_binary.h, each chunk as a separate binary archive
+//  - Every chunk has a checksum of its decoded bytes, corrupt data triggers RASSERT
+//  - Streams are read on machines with the byte order of the writer only
+//  - A stream which was not finished (ie the writer crashed) lacks the index, its chunks are found by
+//    scanning the frames instead. The reader stops at the end of the last complete chunk
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <algorithm>
+#include <type_traits>
+#include "serialize_binary.h"
+#include "stream_codec.h"
+#include "checksum.h"
+#include "parallel_for.h"
+#include "mapped_container.h"
+
+#ifndef SERIALIZE_STREAM_CHUNK_SIZE // Default number of bytes per chunk before encoding, estimated by sizeof(T) for non trivially copyable elements
+#  define SERIALIZE_STREAM_CHUNK_SIZE (size_t(1) << 20)
+#endif
+
+namespace util {
+
+
+namespace _impl_serialize_stream {
+  static const uint32_t magic = 0x534E4350; // "PCNS"
+  static const uint32_t frame_sync = 0x4B4E4843; // "CHNK"
+  static const uint32_t index_sync = 0x58444E49; // "INDX"
+  static const uint16_t current_version = 1;
+  static const uint8_t flag_big_endian = 1;
+  static const uint32_t frame_encoded = 1; // Payload is encoded by the codec, otherwise stored as is
+
+  struct stream_header {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t flags;
+    uint8_t codec;
+    uint32_t element_size; // sizeof(T) of raw elements, 0 for archived elements
+    uint32_t reserved;
+  };
+  struct frame_header {
+    uint32_t sync;
+    uint32_t flags;
+    uint32_t encoded_size;
+    uint32_t raw_size;
+    uint64_t num_elements;
+    uint64_t checksum; // Of the raw bytes
+  };
+  // Index, a frame_header with index_sync and num_elements = number of chunks, the entries and the footer
+  struct index_entry {
+    uint64_t offset;
+    uint64_t first_element;
+  };
+  struct index_footer {
+    uint64_t index_offset;
+    uint64_t num_chunks;
+    uint64_t num_elements;
+    uint32_t sync;
+    uint32_t reserved;
+  };
+  static_assert(sizeof(stream_header) == 16 && sizeof(frame_header) == 32 && sizeof(index_footer) == 32, "Unexpected serialize_stream layout");
+
+  template <typename T>
+  struct is_raw : _impl_serialize_binary::is_bulk<T> {};
+
+  inline bool is_big_endian() { return _impl_serialize_binary::is_big_endian(); }
+
+  template <typename Codec>
+  stream_header make_header(uint32_t element_size) {
+    stream_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = magic;
+    h.version = current_version;
+    h.flags = is_big_endian() ? flag_big_endian : 0;
+    h.codec = Codec::id;
+    h.element_size = element_size;
+    return h;
+  }
+  template <typename Codec>
+  void check_header(const stream_header& h, uint32_t element_size) {
+    RASSERT_MSG(h.magic == magic, "serialize_stream: not a stream");
+    RASSERT_MSG(h.version <= current_version, "serialize_stream: unsupported version " << h.version);
+    RASSERT_MSG(((h.flags & flag_big_endian) != 0) == is_big_endian(), "serialize_stream: stream was written with another byte order");
+    RASSERT_MSG(h.codec == Codec::id, "serialize_stream: stream uses codec " << int(h.codec) << ", expected " << int(Codec::id));
+    RASSERT_MSG(h.element_size == element_size, "serialize_stream: element size mismatch");
+  }
+
+  // Raw bytes of elements
+  template <typename T>
+  void serialize_elements(const T* src, size_t n, std::vector<char>& raw, std::true_type) {
+    raw.assign(reinterpret_cast<const char*>(src), reinterpret_cast<const char*>(src + n));
+  }
+  template <typename T>
+  void serialize_elements(const T* src, size_t n, std::vector<char>& raw, std::false_type) {
+    std::ostringstream oss(std::ios::binary);
+    output_archive ar(oss);
+    write_range(ar, src, n);
+    const std::string str = oss.str();
+    raw.assign(str.begin(), str.end());
+  }
+  template <typename T>
+  void deserialize_elements(const char* raw, size_t raw_size, T* dst, size_t n, std::true_type) {
+    RASSERT_MSG(raw_size == n * sizeof(T), "serialize_stream: corrupt chunk");
+    if (n > 0)
+      memcpy(static_cast<void*>(dst), raw, raw_size);
+  }
+  template <typename T>
+  void deserialize_elements(const char* raw, size_t raw_size, T* dst, size_t n, std::false_type) {
+    std::istringstream iss(std::string(raw, raw_size), std::ios::binary);
+    input_archive ar(iss);
+    read_range(ar, dst, n);
+  }
+
+  // Appends the frame of elements [src, src + n) to frame
+  template <typename T, typename Codec>
+  void encode_chunk(const T* src, size_t n, std::vector<char>& raw, std::vector<char>& frame) {
+    serialize_elements(src, n, raw, is_raw<T>());
+    RASSERT_MSG(raw.size() < (size_t(1) << 31), "serialize_stream: chunk too large");
+    const size_t frame_start = frame.size();
+    frame.resize(frame_start + sizeof(frame_header) + std::max(Codec::max_encoded_size(raw.size()), raw.size()));
+    char* payload = &frame[frame_start + sizeof(frame_header)];
+    frame_header fh;
+    memset(&fh, 0, sizeof(fh));
+    fh.sync = frame_sync;
+    fh.raw_size = static_cast<uint32_t>(raw.size());
+    fh.num_elements = n;
+    fh.checksum = util::checksum64(raw.data(), raw.size());
+    const size_t encoded_size = Codec::encode(raw.data(), raw.size(), payload);
+    if (encoded_size < raw.size()) {
+      fh.flags = frame_encoded;
+      fh.encoded_size = static_cast<uint32_t>(encoded_size);
+    }
+    else {
+      // Incompressible data is stored as is
+      if (!raw.empty())
+        memcpy(payload, raw.data(), raw.size());
+      fh.encoded_size = fh.raw_size;
+    }
+    memcpy(&frame[frame_start], &fh, sizeof(fh));
+    frame.resize(frame_start + sizeof(frame_header) + fh.encoded_size);
+  }
+
+  // Raw elements are validated against the raw size before fh.num_elements are allocated
+  template <typename T>
+  void check_frame_size(const frame_header& fh) {
+    RASSERT_MSG(!is_raw<T>::value || (fh.num_elements <= fh.raw_size / sizeof(T) && fh.num_elements * sizeof(T) == fh.raw_size), "serialize_stream: corrupt chunk");
+  }
+
+  // Decodes the payload of a frame into the fh.num_elements elements of dst
+  template <typename T, typename Codec>
+  void decode_chunk(const frame_header& fh, const char* payload, std::vector<char>& raw, T* dst) {
+    const char* raw_data = payload;
+    if ((fh.flags & frame_encoded) != 0) {
+      raw.resize(fh.raw_size);
+      RASSERT_MSG(Codec::decode(payload, fh.encoded_size, raw.data(), raw.size()), "serialize_stream: corrupt chunk");
+      raw_data = raw.data();
+    }
+    else
+      RASSERT_MSG(fh.encoded_size == fh.raw_size, "serialize_stream: corrupt chunk");
+    RASSERT_MSG(util::checksum64(raw_data, fh.raw_size) == fh.checksum, "serialize_stream: chunk checksum mismatch");
+    deserialize_elements(raw_data, fh.raw_size, dst, static_cast<size_t>(fh.num_elements), is_raw<T>());
+  }
+} // namespace _impl_serialize_stream
+
+
+// Location of a chunk within a stream
+struct stream_chunk {
+  uint64_t offset;        // Of the frame header
+  uint64_t first_element;
+  uint64_t num_elements;
+};
+
+
+template <typename T, typename Codec = null_codec>
+class stream_writer {
+public:
+  typedef stream_writer<T, Codec> my_type;
+
+  // Writes the stream header
+  explicit stream_writer(std::ostream& os, size_t chunk_size = SERIALIZE_STREAM_CHUNK_SIZE)
+  : os_(os), offset_(0), num_elements_(0), finished_(false) {
+    chunk_capacity_ = std::max<size_t>(1, chunk_size / sizeof(T));
+    pending_.reserve(chunk_capacity_);
+    const _impl_serialize_stream::stream_header h = _impl_serialize_stream::make_header<Codec>(element_size_());
+    write_bytes_(&h, sizeof(h));
+  }
+  ~stream_writer() {
+    if (!finished_)
+      finish();
+  }
+
+  void push_back(const T& val) {
+    DASSERT(!finished_);
+    pending_.push_back(val);
+    if (pending_.size() == chunk_capacity_)
+      flush();
+  }
+  void push_back(T&& val) {
+    DASSERT(!finished_);
+    pending_.push_back(std::move(val));
+    if (pending_.size() == chunk_capacity_)
+      flush();
+  }
+  template <typename IT>
+  void append(IT start, IT stop) {
+    for (; start != stop; ++start)
+      push_back(*start);
+  }
+  // Encodes the chunks of [src, src + n) in parallel and writes them in order, the chunks equal those of
+  // push_back and the elements after the last full chunk stay pending
+  void append_parallel(const T* src, size_t n, const pfor_partitioner& partitioner = pfor_partitioner()) {
+    DASSERT(!finished_);
+    for (; n > 0 && !pending_.empty(); --n)
+      push_back(*src++);
+    const size_t num_full = n / chunk_capacity_;
+    // Batches bound the memory of encoded frames waiting to be written
+    const size_t batch_size = partitioner.num_chunks() * 4;
+    std::vector<std::vector<char> > frames(std::min(num_full, batch_size));
+    for (size_t batch_start = 0; batch_start < num_full; batch_start += batch_size) {
+      const size_t batch_stop = std::min(num_full, batch_start + batch_size);
+      const size_t capacity = chunk_capacity_;
+      partitioner.for_each_chunk(batch_start, batch_stop, [&frames, src, capacity, batch_start](size_t start, size_t stop) {
+        std::vector<char> raw;
+        for (size_t i = start; i < stop; ++i) {
+          frames[i - batch_start].clear();
+          _impl_serialize_stream::encode_chunk<T, Codec>(src + i * capacity, capacity, raw, frames[i - batch_start]);
+        }
+      });
+      for (size_t i = batch_start; i < batch_stop; ++i)
+        write_frame_(frames[i - batch_start], capacity);
+    }
+    append(src + num_full * chunk_capacity_, src + n);
+  }
+  // Writes the pending elements as a chunk
+  void flush() {
+    if (pending_.empty())
+      return;
+    frame_.clear();
+    _impl_serialize_stream::encode_chunk<T, Codec>(pending_.data(), pending_.size(), raw_, frame_);
+    write_frame_(frame_, pending_.size());
+    pending_.clear();
+  }
+  // Flushes and writes the chunk index, no elements may be added afterwards
+  void finish() {
+    DASSERT(!finished_);
+    flush();
+    _impl_serialize_stream::frame_header fh;
+    memset(&fh, 0, sizeof(fh));
+    fh.sync = _impl_serialize_stream::index_sync;
+    fh.num_elements = index_.size();
+    _impl_serialize_stream::index_footer footer;
+    memset(&footer, 0, sizeof(footer));
+    footer.index_offset = offset_;
+    footer.num_chunks = index_.size();
+    footer.num_elements = num_elements_;
+    footer.sync = _impl_serialize_stream::index_sync;
+    write_bytes_(&fh, sizeof(fh));
+    if (!index_.empty())
+      write_bytes_(index_.data(), index_.size() * sizeof(index_.front()));
+    write_bytes_(&footer, sizeof(footer));
+    os_.flush();
+    finished_ = true;
+  }
+
+  // Number of elements written, including pending ones
+  size_t size() const { return static_cast<size_t>(num_elements_) + pending_.size(); }
+  size_t num_chunks() const { return index_.size(); }
+
+private:
+  stream_writer(const stream_writer& other);
+  stream_writer& operator=(const stream_writer& other);
+  static uint32_t element_size_() { return _impl_serialize_stream::is_raw<T>::value ? static_cast<uint32_t>(sizeof(T)) : 0; }
+  void write_frame_(const std::vector<char>& frame, size_t num_elements) {
+    const _impl_serialize_stream::index_entry e = { offset_, num_elements_ };
+    index_.push_back(e);
+    write_bytes_(frame.data(), frame.size());
+    num_elements_ += num_elements;
+  }
+  void write_bytes_(const void* src, size_t num_bytes) {
+    os_.write(static_cast<const char*>(src), static_cast<std::streamsize>(num_bytes));
+    RASSERT_MSG(os_.good(), "stream_writer: failed to write " << num_bytes << " bytes");
+    offset_ += num_bytes;
+  }
+
+  std::ostream& os_;
+  uint64_t offset_;
+  uint64_t num_elements_; // Of written chunks
+  size_t chunk_capacity_;
+  bool finished_;
+  std::vector<T> pending_;
+  std::vector<char> raw_;
+  std::vector<char> frame_;
+  std::vector<_impl_serialize_stream::index_entry> index_;
+};
+
+
+template <typename T, typename Codec = null_codec>
+class stream_reader {
+public:
+  typedef stream_reader<T, Codec> my_type;
+
+  // Reads and validates the stream header
+  explicit stream_reader(std::istream& is) : is_(is), pos_(0), at_end_(false) {
+    _impl_serialize_stream::stream_header h;
+    is_.read(reinterpret_cast<char*>(&h), sizeof(h));
+    RASSERT_MSG(is_.good(), "stream_reader: failed to read header");
+    _impl_serialize_stream::check_header<Codec>(h, _impl_serialize_stream::is_raw<T>::value ? static_cast<uint32_t>(sizeof(T)) : 0);
+  }
+
+  // Reads the next element, returns false at the end of the stream
+  bool next(T& val) {
+    while (pos_ == chunk_.size()) {
+      if (!read_next_chunk_())
+        return false;
+    }
+    val = std::move(chunk_[pos_++]);
+    return true;
+  }
+  // Moves the remaining elements of the current chunk, or the next chunk, to chunk
+  bool read_chunk(std::vector<T>& chunk) {
+    while (pos_ == chunk_.size()) {
+      if (!read_next_chunk_())
+        return false;
+    }
+    if (pos_ == 0)
+      chunk.swap(chunk_);
+    else
+      chunk.assign(std::make_move_iterator(chunk_.begin() + pos_), std::make_move_iterator(chunk_.end()));
+    chunk_.clear();
+    pos_ = 0;
+    return true;
+  }
+  // Calls f(value) for all remaining elements
+  template <typename F>
+  void for_each(F f) {
+    std::vector<T> chunk;
+    while (read_chunk(chunk)) {
+      for (auto& val : chunk)
+        f(val);
+    }
+  }
+
+private:
+  stream_reader(const stream_reader& other);
+  stream_reader& operator=(const stream_reader& other);
+  bool read_next_chunk_() {
+    if (at_end_)
+      return false;
+    _impl_serialize_stream::frame_header fh;
+    is_.read(reinterpret_cast<char*>(&fh), sizeof(fh));
+    if (is_.gcount() != std::streamsize(sizeof(fh))) {
+      // Unfinished stream, ends at the last complete chunk as scan_stream_chunks
+      at_end_ = true;
+      return false;
+    }
+    if (fh.sync == _impl_serialize_stream::index_sync) {
+      at_end_ = true;
+      return false;
+    }
+    RASSERT_MSG(fh.sync == _impl_serialize_stream::frame_sync, "stream_reader: corrupt stream");
+    payload_.resize(fh.encoded_size);
+    is_.read(payload_.data(), static_cast<std::streamsize>(payload_.size()));
+    if (is_.gcount() != std::streamsize(payload_.size())) {
+      at_end_ = true;
+      return false;
+    }
+    _impl_serialize_stream::check_frame_size<T>(fh);
+    chunk_.clear();
+    chunk_.resize(static_cast<size_t>(fh.num_elements));
+    pos_ = 0;
+    _impl_serialize_stream::decode_chunk<T, Codec>(fh, payload_.data(), raw_, chunk_.data());
+    return true;
+  }
+
+  std::istream& is_;
+  std::vector<T> chunk_; // Decoded elements of the current chunk
+  size_t pos_;
+  bool at_end_;
+  std::vector<char> payload_;
+  std::vector<char> raw_;
+};
+
+
+// Chunks of a stream in memory, read from the index or found by scanning the frames if there is none
+inline std::vector<stream_chunk> scan_stream_chunks(const void* data, size_t size) {
+  using namespace _impl_serialize_stream;
+  const char* bytes = static_cast<const char*>(data);
+  std::vector<stream_chunk> chunks;
+  RASSERT_MSG(size >= sizeof(stream_header), "serialize_stream: stream too small");
+  index_footer footer;
+  if (size >= sizeof(stream_header) + sizeof(frame_header) + sizeof(footer)) {
+    memcpy(&footer, bytes + size - sizeof(footer), sizeof(footer));
+    const uint64_t index_bytes = sizeof(frame_header) + footer.num_chunks * sizeof(index_entry) + sizeof(footer);
+    if (footer.sync == index_sync && footer.index_offset + index_bytes == size) {
+      const char* entries = bytes + footer.index_offset + sizeof(frame_header);
+      chunks.resize(static_cast<size_t>(footer.num_chunks));
+      for (size_t i = chunks.size(); i-- > 0;) {
+        index_entry e;
+        memcpy(&e, entries + i * sizeof(e), sizeof(e));
+        const uint64_t stop_element = i + 1 < chunks.size() ? chunks[i + 1].first_element : footer.num_elements;
+        RASSERT_MSG(e.first_element <= stop_element, "serialize_stream: corrupt index");
+        chunks[i].offset = e.offset;
+        chunks[i].first_element = e.first_element;
+        chunks[i].num_elements = stop_element - e.first_element;
+      }
+      return chunks;
+    }
+  }
+  uint64_t offset = sizeof(stream_header);
+  uint64_t first_element = 0;
+  while (offset + sizeof(frame_header) <= size) {
+    frame_header fh;
+    memcpy(&fh, bytes + offset, sizeof(fh));
+    if (fh.sync != frame_sync || offset + sizeof(fh) + fh.encoded_size > size)
+      break;
+    const stream_chunk chunk = { offset, first_element, fh.num_elements };
+    chunks.push_back(chunk);
+    offset += sizeof(fh) + fh.encoded_size;
+    first_element += fh.num_elements;
+  }
+  return chunks;
+}
+
+
+namespace _impl_serialize_stream {
+  template <typename T, typename Codec>
+  void decode_chunks(const char* bytes, size_t size, const std::vector<stream_chunk>& chunks, T* dst, size_t n, const pfor_partitioner& partitioner) {
+    stream_header h;
+    RASSERT_MSG(size >= sizeof(h), "serialize_stream: stream too small");
+    memcpy(&h, bytes, sizeof(h));
+    check_header<Codec>(h, is_raw<T>::value ? static_cast<uint32_t>(sizeof(T)) : 0);
+    partitioner.for_each_chunk(size_t(0), chunks.size(), [&](size_t start, size_t stop) {
+      std::vector<char> raw;
+      for (size_t i = start; i < stop; ++i) {
+        const stream_chunk& chunk = chunks[i];
+        frame_header fh;
+        RASSERT_MSG(chunk.offset + sizeof(fh) <= size, "serialize_stream: corrupt index");
+        memcpy(&fh, bytes + chunk.offset, sizeof(fh));
+        RASSERT_MSG(fh.sync == frame_sync && fh.num_elements == chunk.num_elements && chunk.first_element + chunk.num_elements <= n, "serialize_stream: corrupt index");
+        RASSERT_MSG(chunk.offset + sizeof(fh) + fh.encoded_size <= size, "serialize_stream: truncated chunk");
+        decode_chunk<T, Codec>(fh, bytes + chunk.offset + sizeof(fh), raw, dst + chunk.first_element);
+      }
+    });
+  }
+} // namespace _impl_serialize_stream
+
+// Number of elements of a stream in memory
+inline size_t stream_size(const void* data, size_t size) {
+  const std::vector<stream_chunk> chunks = scan_stream_chunks(data, size);
+  return chunks.empty() ? 0 : static_cast<size_t>(chunks.back().first_element + chunks.back().num_elements);
+}
+
+// Decodes a stream in memory, the chunks are decoded in parallel
+template <typename T, typename Codec = null_codec>
+std::vector<T> read_stream_parallel(const void* data, size_t size, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  const std::vector<stream_chunk> chunks = scan_stream_chunks(data, size);
+  std::vector<T> values(chunks.empty() ? 0 : static_cast<size_t>(chunks.back().first_element + chunks.back().num_elements));
+  _impl_serialize_stream::decode_chunks<T, Codec>(static_cast<const char*>(data), size, chunks, values.data(), values.size(), partitioner);
+  return values;
+}
+// Decodes a stream of stream_size(data, size) elements in memory to dst, which has constructed elements
+template <typename T, typename Codec = null_codec>
+void read_stream_parallel(const void* data, size_t size, T* dst, size_t n, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  const std::vector<stream_chunk> chunks = scan_stream_chunks(data, size);
+  RASSERT_MSG(n == (chunks.empty() ? 0 : chunks.back().first_element + chunks.back().num_elements), "serialize_stream: stream size mismatch");
+  _impl_serialize_stream::decode_chunks<T, Codec>(static_cast<const char*>(data), size, chunks, dst, n, partitioner);
+}
+
+// Decodes a stream file, which is memory mapped
+template <typename T, typename Codec = null_codec>
+std::vector<T> read_stream_parallel(const std::string& path, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  const mapped_file file(path);
+  RASSERT_MSG(file.is_open(), "serialize_stream: cannot map " << path);
+  return read_stream_parallel<T, Codec>(file.data(), file.size(), partitioner);
+}
+
+
+} // namespace util
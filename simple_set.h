@@ -4,6 +4,7 @@
 #include <algorithm>
 #include "util_macro.h"
 #include "util.h"
+#include "sorted_search.h"
 
 namespace util {
 
@@ -12,47 +13,79 @@ class simple_set {
   typedef simple_set<T, A> my_type;
 
 public:
-  simple_set() : sorted_(false) { data_.reserve(64); }
-  simple_set(const simple_set& other) : sorted_(other.sorted_), data_(other.data_) : {}
-  simple_set& operator=(const simple_set& other) { sorted_ = other.sorted_; data_ = other.data_; return *this; }
+  // Memory layout of the sorted elements, eytzinger_layout is faster for large sets but cannot be iterated in order
+  enum layout { sorted_layout, eytzinger_layout };
+
+  explicit simple_set(layout l = sorted_layout) : sorted_(false), layout_(l) { data_.reserve(64); }
+  simple_set(const simple_set& other) : data_(other.data_), erased_(other.erased_), sorted_(other.sorted_), layout_(other.layout_) {}
+  simple_set& operator=(const simple_set& other) { data_ = other.data_; erased_ = other.erased_; sorted_ = other.sorted_; layout_ = other.layout_; return *this; }
   bool operator==(const simple_set& other) const { static_assert(false, "Cannot compare simple_sets, use std::set instead."); }
   bool operator!=(const simple_set& other) const { static_assert(false, "Cannot compare simple_sets, use std::set instead."); }
   bool operator<(const simple_set& other) const { static_assert(false, "Cannot compare simple_sets, use std::set instead."); }
   // Element access
   size_t count(const T& val) const { 
     if (sorted_) {
-      const auto pos = std::lower_bound(data_.begin(), data_.end(), val);
-      const auto idx = pos - data_.begin();
-      if (pos == data_.end() || *pos != val || erased_[idx])
+      const size_t idx = sorted_position_(val);
+      if (idx == data_.size() || data_[idx] != val || erased_[idx])
         return 0;
       return 1;
     }
     else
       return std::find(data_.begin(), data_.end(), val) != data_.end() ? 1 : 0;
   }
+  // Writes count(val) of every value in [first, last) to out, the lookups are interleaved when sorted
+  template <typename IT, typename OUT>
+  void count_many(IT first, IT last, OUT out) const {
+    if (!sorted_ || layout_ != eytzinger_layout) {
+      for (; first != last; ++first, ++out)
+        *out = count(*first);
+      return;
+    }
+    const std::vector<T> queries(first, last);
+    std::vector<size_t> positions(queries.size());
+    util::eytzinger_lower_bound_many(data_.data(), data_.size(), queries.data(), queries.size(), positions.data());
+    for (size_t i = 0; i < queries.size(); ++i, ++out) {
+      const size_t idx = positions[i];
+      *out = idx == data_.size() || data_[idx] != queries[i] || erased_[idx] ? 0 : 1;
+    }
+  }
   bool empty() const { return data_.empty(); }
   size_t size() const { static_assert(false, "Cannot get size of simple_sets, use std::set instead."); return -1; }
+  layout get_layout() const { return layout_; }
   // Modify collection
+  void set_layout(layout l) {
+    layout_ = l;
+    if (sorted_)
+      sort();
+  }
   void sort() {
+    drop_erased_();
     std::sort(data_.begin(), data_.end());
     auto new_end = std::unique(data_.begin(), data_.end());
     data_.erase(new_end, data_.end());
-    std::fill(erased_.begin(), erased_.end(), false);
-    erased_.resize(data_.size(), false);
+    if (layout_ == eytzinger_layout) {
+      const std::vector<T, A> sorted(data_);
+      util::eytzinger_from_sorted(sorted.data(), sorted.size(), data_.data());
+    }
+    erased_.assign(data_.size(), false);
     sorted_ = true;
   }
-  void clear() { data_.clear(); }
+  void clear() { 
+    data_.clear(); 
+    erased_.clear();
+  }
   void insert(const T& val) { 
+    // Erased elements are only flagged while sorted, remove them before they become visible to the unsorted lookup
+    drop_erased_();
     data_.push_back(val); 
     sorted_ = false;
   }
   void erase(const T& val) { 
-    // If sorted, replace with neighbouring values, ie preserve order of elements
+    // If sorted, flag the value as erased, ie preserve order of elements
     if (sorted_) {
-      auto bound = std::equal_range(data_.begin(), data_.end(), val);
-      auto left_idx = bound.first - data_.begin();
-      auto right_idx = bound.second - data_.begin();
-      std::fill(erased_.begin() + left_idx, erased_.begin() + right_idx, true);
+      const size_t idx = sorted_position_(val);
+      if (idx != data_.size() && data_[idx] == val)
+        erased_[idx] = true;
     } 
     // Unsorted
     else {
@@ -61,10 +94,29 @@ public:
   }
 
 private:
+  // Position of the first element not less than val in the sorted data, data_.size() if none
+  size_t sorted_position_(const T& val) const {
+    if (layout_ == eytzinger_layout)
+      return util::eytzinger_lower_bound(data_.data(), data_.size(), val);
+    return static_cast<size_t>(util::branchless_lower_bound(data_.data(), data_.data() + data_.size(), val) - data_.data());
+  }
+  void drop_erased_() {
+    if (!sorted_)
+      return;
+    size_t dst = 0;
+    for (size_t src = 0; src < data_.size(); ++src) {
+      if (!erased_[src])
+        data_[dst++] = data_[src];
+    }
+    data_.resize(dst);
+    erased_.assign(dst, false);
+  }
+
   std::vector <T, A> data_;
   std::vector <bool> erased_;
   bool sorted_;
-  IMPLEMENTS_MOVEABLE( (data_) (sorted_) );
+  layout layout_;
+  IMPLEMENTS_MOVEABLE( (data_) (erased_) (sorted_) (layout_) );
 };
 
 
@@ -0,0 +1,360 @@
+//
+//  Small Vector
+//    Vector which stores up to N elements inline and moves to the heap when growing beyond that.
+//    Elements are constructed and destroyed lazily, unused inline slots are raw storage.
+//
+//   USAGE:
+//     util::small_vector<uint32_t, 26> neighbours; // Never allocates unless more than 26 neighbours are pushed
+//     for (...)
+//       neighbours.push_back(idx);
+//
+//  NOTES:
+//  - Same interface as std::vector for the commonly used subset
+//  - Heap capacity grows geometrically (doubles), it never moves back to the inline storage,
+//    use shrink_to_fit() for that
+//  - Moving a small_vector holding inline elements moves the elements one by one,
+//    iterators are hence invalidated by move and swap
+//
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+#include <initializer_list>
+#include <type_traits>
+#include <stdexcept>
+#include <utility>
+
+namespace util {
+
+
+template <typename T, size_t N, typename A = std::allocator<T> >
+class small_vector {
+  typedef std::allocator_traits<A> allocator_traits;
+public:
+  typedef small_vector<T, N, A> my_type;
+  typedef T value_type;
+  typedef A allocator_type;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T* iterator;
+  typedef const T* const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+  static const size_t inline_capacity = N;
+  static_assert(N > 0, "small_vector needs at least one inline element, use std::vector instead");
+
+  // Construct\Assign
+  small_vector(const allocator_type& allocator = allocator_type()) : data_(inline_data_()), size_(0), capacity_(N), allocator_(allocator) {}
+  explicit small_vector(size_t n, const allocator_type& allocator = allocator_type()) : data_(inline_data_()), size_(0), capacity_(N), allocator_(allocator) {
+    resize(n);
+  }
+  small_vector(size_t n, const value_type& val, const allocator_type& allocator = allocator_type()) : data_(inline_data_()), size_(0), capacity_(N), allocator_(allocator) {
+    resize(n, val);
+  }
+  template <typename IT, typename = typename std::iterator_traits<IT>::iterator_category>
+  small_vector(IT start, IT stop, const allocator_type& allocator = allocator_type()) : data_(inline_data_()), size_(0), capacity_(N), allocator_(allocator) {
+    assign(start, stop);
+  }
+  small_vector(std::initializer_list<value_type> values, const allocator_type& allocator = allocator_type()) : data_(inline_data_()), size_(0), capacity_(N), allocator_(allocator) {
+    assign(values.begin(), values.end());
+  }
+  small_vector(const small_vector& other) : data_(inline_data_()), size_(0), capacity_(N), allocator_(allocator_traits::select_on_container_copy_construction(other.allocator_)) {
+    assign(other.begin(), other.end());
+  }
+  small_vector(small_vector&& other) : data_(inline_data_()), size_(0), capacity_(N), allocator_(std::move(other.allocator_)) {
+    steal_(other);
+  }
+  small_vector& operator=(const small_vector& other) {
+    if (this != &other)
+      assign(other.begin(), other.end());
+    return *this;
+  }
+  small_vector& operator=(small_vector&& other) {
+    if (this != &other) {
+      clear();
+      move_assign_(other, typename allocator_traits::propagate_on_container_move_assignment());
+    }
+    return *this;
+  }
+  small_vector& operator=(std::initializer_list<value_type> values) {
+    assign(values.begin(), values.end());
+    return *this;
+  }
+  ~small_vector() {
+    clear();
+    deallocate_heap_();
+  }
+  template <typename IT>
+  void assign(IT start, IT stop) {
+    clear();
+    reserve(static_cast<size_t>(std::distance(start, stop)));
+    for (; start != stop; ++start)
+      emplace_back_unchecked_(*start);
+  }
+  void assign(size_t n, const value_type& val) {
+    clear();
+    resize(n, val);
+  }
+
+  // Comparison
+  bool operator==(const small_vector& other) const { return size_ == other.size_ && std::equal(begin(), end(), other.begin()); }
+  bool operator!=(const small_vector& other) const { return !(*this == other); }
+  bool operator<(const small_vector& other) const { return std::lexicographical_compare(begin(), end(), other.begin(), other.end()); }
+
+  // Size
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  bool is_inline() const { return data_ == inline_data_(); }
+  allocator_type get_allocator() const { return allocator_; }
+  void reserve(size_t n) {
+    if (n > capacity_)
+      reallocate_(n);
+  }
+  void shrink_to_fit() {
+    if (is_inline() || size_ == capacity_)
+      return;
+    reallocate_(size_);
+  }
+
+  // Push\Pop
+  void push_back(const value_type& val) { emplace_back(val); }
+  void push_back(value_type&& val) { emplace_back(std::move(val)); }
+  template <typename... Args>
+  reference emplace_back(Args&&... args) {
+    if (size_ < capacity_)
+      return emplace_back_unchecked_(std::forward<Args>(args)...);
+    // Construct the new element before relocating, as args may refer to an element of this vector
+    const size_t new_capacity = capacity_ * 2;
+    T* new_data = allocator_traits::allocate(allocator_, new_capacity);
+    allocator_traits::construct(allocator_, new_data + size_, std::forward<Args>(args)...);
+    relocate_to_(new_data, new_capacity);
+    ++size_;
+    return back();
+  }
+  void pop_back() {
+    DASSERT(!empty());
+    --size_;
+    allocator_traits::destroy(allocator_, data_ + size_);
+  }
+  void clear() {
+    destroy_(data_, data_ + size_);
+    size_ = 0;
+  }
+  void resize(size_t n) {
+    reserve(n);
+    while (size_ < n)
+      emplace_back_unchecked_();
+    if (n < size_) {
+      destroy_(data_ + n, data_ + size_);
+      size_ = n;
+    }
+  }
+  void resize(size_t n, const value_type& val) {
+    if (n > capacity_) {
+      const value_type copied_val(val); // val may be an element of this vector
+      reserve(n);
+      while (size_ < n)
+        emplace_back_unchecked_(copied_val);
+    }
+    while (size_ < n)
+      emplace_back_unchecked_(val);
+    if (n < size_) {
+      destroy_(data_ + n, data_ + size_);
+      size_ = n;
+    }
+  }
+
+  // Insert\Erase
+  template <typename... Args>
+  iterator emplace(const_iterator pos, Args&&... args) {
+    DASSERT(pos >= begin() && pos <= end());
+    const auto idx = pos - begin();
+    if (pos == end()) {
+      emplace_back(std::forward<Args>(args)...);
+      return begin() + idx;
+    }
+    value_type val(std::forward<Args>(args)...);
+    grow_(size_ + 1);
+    emplace_back_unchecked_(std::move(back()));
+    const iterator it = begin() + idx;
+    std::move_backward(it, end() - 2, end() - 1);
+    *it = std::move(val);
+    return it;
+  }
+  iterator insert(const_iterator pos, const value_type& val) { return emplace(pos, val); }
+  iterator insert(const_iterator pos, value_type&& val) { return emplace(pos, std::move(val)); }
+  iterator insert(const_iterator pos, size_t n, const value_type& val) {
+    DASSERT(pos >= begin() && pos <= end());
+    const auto idx = pos - cbegin();
+    const value_type copied_val(val); // val may be an element of this vector
+    const size_t old_size = size_;
+    grow_(size_ + n);
+    for (size_t i = 0; i < n; ++i)
+      emplace_back_unchecked_(copied_val);
+    std::rotate(begin() + idx, begin() + old_size, end());
+    return begin() + idx;
+  }
+  // The elements are appended and rotated into place, [start, stop) must not refer to this vector
+  template <typename IT, typename = typename std::iterator_traits<IT>::iterator_category>
+  iterator insert(const_iterator pos, IT start, IT stop) {
+    DASSERT(pos >= begin() && pos <= end());
+    const auto idx = pos - cbegin();
+    const size_t old_size = size_;
+    for (; start != stop; ++start)
+      emplace_back(*start);
+    std::rotate(begin() + idx, begin() + old_size, end());
+    return begin() + idx;
+  }
+  iterator insert(const_iterator pos, std::initializer_list<value_type> values) { return insert(pos, values.begin(), values.end()); }
+  iterator erase(const_iterator pos) {
+    DASSERT(pos >= begin() && pos < end());
+    return erase(pos, pos + 1);
+  }
+  iterator erase(const_iterator start, const_iterator stop) {
+    DASSERT(start >= begin() && start <= stop && stop <= end());
+    const iterator first = begin() + (start - cbegin());
+    const iterator last = begin() + (stop - cbegin());
+    const iterator new_end = std::move(last, end(), first);
+    destroy_(new_end, end());
+    size_ -= static_cast<size_t>(last - first);
+    return first;
+  }
+  void swap(small_vector& other) {
+    my_type tmp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+  // Access by iterator
+  iterator begin() { return data_; }
+  const_iterator begin() const { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator end() const { return data_ + size_; }
+  const_iterator cbegin() const { return data_; }
+  const_iterator cend() const { return data_ + size_; }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+  // Element access
+  value_type& operator[](size_t idx) { DASSERT(idx < size_); return data_[idx]; }
+  const value_type& operator[](size_t idx) const { DASSERT(idx < size_); return data_[idx]; }
+  value_type& at(size_t idx) { if (idx >= size_) throw std::out_of_range("small_vector::at"); return data_[idx]; }
+  const value_type& at(size_t idx) const { if (idx >= size_) throw std::out_of_range("small_vector::at"); return data_[idx]; }
+  value_type& front() { DASSERT(!empty()); return data_[0]; }
+  const value_type& front() const { DASSERT(!empty()); return data_[0]; }
+  value_type& back() { DASSERT(!empty()); return data_[size_ - 1]; }
+  const value_type& back() const { DASSERT(!empty()); return data_[size_ - 1]; }
+  T* data() { return data_; }
+  const T* data() const { return data_; }
+
+private:
+  T* inline_data_() { return reinterpret_cast<T*>(&inline_storage_[0]); }
+  const T* inline_data_() const { return reinterpret_cast<const T*>(&inline_storage_[0]); }
+  template <typename... Args>
+  reference emplace_back_unchecked_(Args&&... args) {
+    DASSERT(size_ < capacity_);
+    allocator_traits::construct(allocator_, data_ + size_, std::forward<Args>(args)...);
+    return data_[size_++];
+  }
+  void destroy_(T* start, T* stop) {
+    if (std::is_trivially_destructible<T>::value)
+      return;
+    for (; start != stop; ++start)
+      allocator_traits::destroy(allocator_, start);
+  }
+  // Moves the elements to new_data and takes ownership of it
+  void relocate_to_(T* new_data, size_t new_capacity) {
+    if (std::is_trivially_copyable<T>::value) {
+      if (size_ > 0)
+        memcpy((void*) new_data, (const void*) data_, size_ * sizeof(T));
+    } else {
+      for (size_t i = 0; i < size_; ++i)
+        allocator_traits::construct(allocator_, new_data + i, std::move_if_noexcept(data_[i]));
+      destroy_(data_, data_ + size_);
+    }
+    deallocate_heap_();
+    data_ = new_data;
+    capacity_ = new_capacity;
+  }
+  void reallocate_(size_t new_capacity) {
+    DASSERT(new_capacity >= size_);
+    if (new_capacity <= N) {
+      if (is_inline())
+        return;
+      // Move back to inline storage
+      T* heap_data = data_;
+      const size_t heap_capacity = capacity_;
+      for (size_t i = 0; i < size_; ++i)
+        allocator_traits::construct(allocator_, inline_data_() + i, std::move_if_noexcept(heap_data[i]));
+      destroy_(heap_data, heap_data + size_);
+      allocator_traits::deallocate(allocator_, heap_data, heap_capacity);
+      data_ = inline_data_();
+      capacity_ = N;
+      return;
+    }
+    relocate_to_(allocator_traits::allocate(allocator_, new_capacity), new_capacity);
+  }
+  // Reserves geometrically, as emplace_back
+  void grow_(size_t n) {
+    if (n > capacity_)
+      reallocate_(std::max(2 * capacity_, n));
+  }
+  // Expects this to be empty, the heap buffer of other is only taken if the allocators are interchangeable
+  void move_assign_(small_vector& other, std::true_type /*propagate*/) {
+    deallocate_heap_();
+    allocator_ = std::move(other.allocator_);
+    steal_(other);
+  }
+  void move_assign_(small_vector& other, std::false_type /*propagate*/) {
+    if (allocator_ == other.allocator_) {
+      deallocate_heap_();
+      steal_(other);
+      return;
+    }
+    reserve(other.size_);
+    for (size_t i = 0; i < other.size_; ++i)
+      emplace_back_unchecked_(std::move(other.data_[i]));
+    other.clear();
+  }
+  void deallocate_heap_() {
+    if (is_inline())
+      return;
+    allocator_traits::deallocate(allocator_, data_, capacity_);
+    data_ = inline_data_();
+    capacity_ = N;
+  }
+  // Expects this to be empty and inline
+  void steal_(small_vector& other) {
+    if (other.is_inline()) {
+      for (size_t i = 0; i < other.size_; ++i)
+        emplace_back_unchecked_(std::move(other.data_[i]));
+      other.clear();
+      return;
+    }
+    data_ = other.data_;
+    size_ = other.size_;
+    capacity_ = other.capacity_;
+    other.data_ = other.inline_data_();
+    other.size_ = 0;
+    other.capacity_ = N;
+  }
+
+  T* data_;
+  size_t size_;
+  size_t capacity_;
+  allocator_type allocator_;
+  alignas(T) unsigned char inline_storage_[N * sizeof(T)];
+};
+
+
+} // namespace util
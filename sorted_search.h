@@ -0,0 +1,191 @@
+//
+//  Sorted Search
+//    Search kernels for sorted data which avoid the branch mispredictions and cache misses of std::lower_bound.
+//    branchless_lower_bound: Binary search compiled to conditional moves, the last few elements are
+//                            compared with SIMD (SSE2 for int32_t\uint32_t\float, scalar otherwise).
+//    eytzinger_*:            Search in Eytzinger (BFS) order, where the nodes of the next few levels shares
+//                            cache lines and are prefetched, which keeps memory latency off the critical path
+//                            for sets larger than the caches.
+//
+//   USAGE:
+//     std::vector<int> sorted = ...;
+//     auto it = util::branchless_lower_bound(sorted.data(), sorted.data() + sorted.size(), 42);
+//
+//     std::vector<int> eytz(sorted.size());
+//     util::eytzinger_from_sorted(sorted.data(), sorted.size(), eytz.data());
+//     size_t idx = util::eytzinger_lower_bound(eytz.data(), eytz.size(), 42); // eytz.size() if all elements < 42
+//
+//     Batched queries, the lookups are interleaved in order to hide memory latency
+//     util::eytzinger_lower_bound_many(eytz.data(), eytz.size(), queries.data(), queries.size(), indices.data());
+//
+//  NOTES:
+//  - Elements are compared using operator<
+//  - Eytzinger indices are positions in the eytzinger ordered array, not in the sorted array
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+#include "bit_count.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define SORTED_SEARCH_SSE2_ENABLED
+#endif
+
+#ifndef SORTED_SEARCH_LINEAR_THRESHOLD // Ranges this small are finished with a linear count instead of halving
+#  define SORTED_SEARCH_LINEAR_THRESHOLD 16
+#endif
+
+#ifndef SORTED_SEARCH_BATCH_SIZE // Number of interleaved queries in eytzinger_lower_bound_many
+#  define SORTED_SEARCH_BATCH_SIZE 8
+#endif
+
+namespace util {
+
+
+namespace _impl_sorted_search {
+  inline void prefetch(const void* ptr) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(ptr);
+#elif defined(SORTED_SEARCH_SSE2_ENABLED)
+    _mm_prefetch(static_cast<const char*>(ptr), _MM_HINT_T0);
+#else
+    (void) ptr;
+#endif
+  }
+
+  inline unsigned count_trailing_ones(uint64_t val) { return util::count_trailing_zeros(~val); }
+
+  // Number of elements in [first, first + n) which are less than val
+  template <typename T>
+  size_t count_less(const T* first, size_t n, const T& val) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i)
+      count += first[i] < val ? 1 : 0;
+    return count;
+  }
+#ifdef SORTED_SEARCH_SSE2_ENABLED
+  inline size_t count_less(const int32_t* first, size_t n, const int32_t& val) {
+    const __m128i needle = _mm_set1_epi32(val);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i));
+      const int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(block, needle)));
+      count += static_cast<size_t>(((mask >> 0) & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1));
+    }
+    for (; i < n; ++i)
+      count += first[i] < val ? 1 : 0;
+    return count;
+  }
+  inline size_t count_less(const uint32_t* first, size_t n, const uint32_t& val) {
+    // Flip the sign bit in order to compare unsigned values with the signed SSE2 comparison
+    const __m128i sign = _mm_set1_epi32(static_cast<int>(0x80000000u));
+    const __m128i needle = _mm_xor_si128(_mm_set1_epi32(static_cast<int>(val)), sign);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i)), sign);
+      const int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(block, needle)));
+      count += static_cast<size_t>(((mask >> 0) & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1));
+    }
+    for (; i < n; ++i)
+      count += first[i] < val ? 1 : 0;
+    return count;
+  }
+  inline size_t count_less(const float* first, size_t n, const float& val) {
+    const __m128 needle = _mm_set1_ps(val);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      const int mask = _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(first + i), needle));
+      count += static_cast<size_t>(((mask >> 0) & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1));
+    }
+    for (; i < n; ++i)
+      count += first[i] < val ? 1 : 0;
+    return count;
+  }
+#endif
+
+  template <typename T>
+  size_t eytzinger_fill(const T* sorted, size_t n, T* eytzinger, size_t sorted_idx, size_t k) {
+    // In-order traversal of the implicit tree, k is 1-based
+    if (k <= n) {
+      sorted_idx = eytzinger_fill(sorted, n, eytzinger, sorted_idx, 2 * k);
+      eytzinger[k - 1] = sorted[sorted_idx++];
+      sorted_idx = eytzinger_fill(sorted, n, eytzinger, sorted_idx, 2 * k + 1);
+    }
+    return sorted_idx;
+  }
+
+  // Maps the 1-based node reached when falling off the tree to the 0-based lower bound position, or n if none
+  inline size_t eytzinger_resolve(uint64_t k, size_t n) {
+    k >>= count_trailing_ones(k) + 1;
+    return k == 0 ? n : static_cast<size_t>(k - 1);
+  }
+} // namespace _impl_sorted_search
+
+
+// branchless_lower_bound
+template <typename T>
+const T* branchless_lower_bound(const T* first, const T* last, const T& val) {
+  size_t length = static_cast<size_t>(last - first);
+  while (length > SORTED_SEARCH_LINEAR_THRESHOLD) {
+    const size_t half = length / 2;
+    first = first[half] < val ? first + half : first; // Compiled to cmov
+    length -= half;
+  }
+  return first + _impl_sorted_search::count_less(first, length, val);
+}
+
+// eytzinger_from_sorted, eytzinger must have room for n elements
+template <typename T>
+void eytzinger_from_sorted(const T* sorted, size_t n, T* eytzinger) {
+  _impl_sorted_search::eytzinger_fill(sorted, n, eytzinger, 0, 1);
+}
+
+// eytzinger_lower_bound, returns the eytzinger position of the first element not less than val, or n if none
+template <typename T>
+size_t eytzinger_lower_bound(const T* eytzinger, size_t n, const T& val) {
+  // The descendants a few levels down shares a cache line, prefetch it while the current level is compared
+  const size_t prefetch_multiplier = std::max<size_t>(1, 64 / sizeof(T));
+  uint64_t k = 1;
+  while (k <= n) {
+    _impl_sorted_search::prefetch(eytzinger + std::min<uint64_t>(k * prefetch_multiplier, n) - 1);
+    k = 2 * k + (eytzinger[k - 1] < val ? 1 : 0);
+  }
+  return _impl_sorted_search::eytzinger_resolve(k, n);
+}
+
+// eytzinger_lower_bound_many, batched version of eytzinger_lower_bound where SORTED_SEARCH_BATCH_SIZE lookups
+// are advanced one level at a time in lockstep, the loads of one batch are hence in flight simultaneously
+template <typename T>
+void eytzinger_lower_bound_many(const T* eytzinger, size_t n, const T* queries, size_t num_queries, size_t* positions) {
+  const size_t prefetch_multiplier = std::max<size_t>(1, 64 / sizeof(T));
+  size_t depth = 0;
+  for (size_t levels = n; levels > 0; levels >>= 1)
+    ++depth;
+  for (size_t batch_start = 0; batch_start < num_queries; batch_start += SORTED_SEARCH_BATCH_SIZE) {
+    const size_t batch_size = std::min<size_t>(SORTED_SEARCH_BATCH_SIZE, num_queries - batch_start);
+    uint64_t k[SORTED_SEARCH_BATCH_SIZE];
+    for (size_t q = 0; q < batch_size; ++q)
+      k[q] = 1;
+    for (size_t level = 0; level < depth; ++level) {
+      for (size_t q = 0; q < batch_size; ++q) {
+        const uint64_t node = k[q];
+        if (node <= n) {
+          _impl_sorted_search::prefetch(eytzinger + std::min<uint64_t>(node * prefetch_multiplier, n) - 1);
+          k[q] = 2 * node + (eytzinger[node - 1] < queries[batch_start + q] ? 1 : 0);
+        }
+      }
+    }
+    for (size_t q = 0; q < batch_size; ++q)
+      positions[batch_start + q] = _impl_sorted_search::eytzinger_resolve(k[q], n);
+  }
+}
+
+
+} // namespace util
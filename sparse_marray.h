@@ -0,0 +1,375 @@
+//
+//  Sparse Marray
+//    3D array for mostly constant volumes, stored as bricks of B * B * B elements which are allocated on demand.
+//    Inactive bricks are backed by a single read-only brick of the background value, active bricks are taken
+//    from a pool of chunks of SPARSE_MARRAY_POOL_CHUNK bricks and returned to it when pruned.
+//    Within a brick the elements are stored linearly, ie x + (y + z * B) * B.
+//
+//   USAGE:
+//     util::sparse_marray<float> volume(1024, 1024, 1024);      // Background 0, nothing allocated
+//     volume.at(10, 20, 30) = 1.0f;                             // Activates the brick of (10, 20, 30)
+//     const auto& const_volume = volume;
+//     float v = const_volume.at(11, 20, 30);                    // Const access never activates
+//     volume.for_each_active([](size_t x, size_t y, size_t z, float& v) { v *= 2; });
+//     auto sparse = util::make_sparse_marray(dense, 0.0f);      // Bricks equal to the background stay inactive
+//     marray<float, 3> dense2 = sparse.to_marray();
+//     auto magnitude = util::gradient_length_volume(sparse);    // Computed on active bricks and their neighbours
+//
+//  NOTES:
+//  - Non-const at() activates the brick, use a const reference to read without allocating
+//  - References and pointers to elements of active bricks stay valid until the brick is pruned or cleared
+//  - Activation is not thread safe, concurrent writes to already active bricks are
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "parallel_for.h"
+#include "marray.h"
+#include "marray_gradient.h"
+
+#ifndef SPARSE_MARRAY_POOL_CHUNK // Bricks allocated at once when the pool runs out of free bricks
+#  define SPARSE_MARRAY_POOL_CHUNK 64
+#endif
+
+namespace util {
+
+
+namespace _impl_sparse_marray {
+  // Calls f(x, y, z, local index) for the elements of brick (bx, by, bz) within an array of w * h * d elements
+  template <size_t B, typename F>
+  void for_each_brick_element(size_t bx, size_t by, size_t bz, size_t w, size_t h, size_t d, const F& f) {
+    for (size_t z = bz * B; z < std::min(d, bz * B + B); ++z) {
+      for (size_t y = by * B; y < std::min(h, by * B + B); ++y) {
+        for (size_t x = bx * B; x < std::min(w, bx * B + B); ++x)
+          f(x, y, z, ((z % B) * B + y % B) * B + x % B);
+      }
+    }
+  }
+} // namespace _impl_sparse_marray
+
+
+template <typename T, size_t B = 8, typename A = std::allocator<T> >
+class sparse_marray {
+public:
+  static_assert(B >= 2 && (B & (B - 1)) == 0, "brick side must be a power of 2");
+  static const size_t dimensions = 3;
+  static const size_t brick_side = B;
+  static const size_t brick_size = B * B * B;
+  typedef sparse_marray<T, B, A> my_type;
+  typedef T value_type;
+  typedef A allocator_type;
+  typedef default_init_vector<T, A> container_type;
+
+  sparse_marray() { reset(0, 0, 0); }
+  sparse_marray(size_t w, size_t h, size_t d, const value_type& background = value_type(), const allocator_type& allocator = allocator_type())
+  : allocator_(allocator) {
+    reset(w, h, d, background);
+  }
+
+  // Resizes and deactivates every brick, the pool is kept
+  void reset(size_t w, size_t h, size_t d, const value_type& background = value_type()) {
+    dims_[0] = w;
+    dims_[1] = h;
+    dims_[2] = d;
+    bricks_x_ = (w + B - 1) / B;
+    bricks_y_ = (h + B - 1) / B;
+    bricks_z_ = (d + B - 1) / B;
+    constant_brick_.assign(brick_size, background);
+    bricks_.assign(bricks_x_ * bricks_y_ * bricks_z_, inactive_);
+    free_.clear();
+    for (uint32_t slot = static_cast<uint32_t>(chunks_.size() * SPARSE_MARRAY_POOL_CHUNK); slot-- > 0; )
+      free_.push_back(slot);
+    num_active_ = 0;
+  }
+  void clear() { reset(width(), height(), depth(), background()); }
+
+  // Size
+  size_t width() const { return dims_[0]; }
+  size_t height() const { return dims_[1]; }
+  size_t depth() const { return dims_[2]; }
+  size_t size() const { return width() * height() * depth(); }
+  bool empty() const { return size() == 0; }
+  const value_type& background() const { return constant_brick_.front(); }
+
+  // Bricks
+  size_t bricks_x() const { return bricks_x_; }
+  size_t bricks_y() const { return bricks_y_; }
+  size_t bricks_z() const { return bricks_z_; }
+  size_t num_bricks() const { return bricks_.size(); }
+  size_t num_active_bricks() const { return num_active_; }
+  size_t num_allocated_bricks() const { return chunks_.size() * SPARSE_MARRAY_POOL_CHUNK; }
+  bool is_active(size_t bx, size_t by, size_t bz) const { return bricks_[brick_index_(bx, by, bz)] != inactive_; }
+  // Elements of a brick, the constant brick if inactive
+  const value_type* brick_data(size_t bx, size_t by, size_t bz) const {
+    const uint32_t slot = bricks_[brick_index_(bx, by, bz)];
+    return slot == inactive_ ? constant_brick_.data() : slot_data_(slot);
+  }
+  // Elements of a brick, activated and filled with the background if inactive
+  value_type* activate_brick(size_t bx, size_t by, size_t bz) {
+    uint32_t& slot = bricks_[brick_index_(bx, by, bz)];
+    if (slot == inactive_) {
+      slot = allocate_slot_();
+      std::copy(constant_brick_.begin(), constant_brick_.end(), slot_data_(slot));
+      ++num_active_;
+    }
+    return slot_data_(slot);
+  }
+  void deactivate_brick(size_t bx, size_t by, size_t bz) {
+    uint32_t& slot = bricks_[brick_index_(bx, by, bz)];
+    if (slot == inactive_)
+      return;
+    free_.push_back(slot);
+    slot = inactive_;
+    --num_active_;
+  }
+  // Deactivates the bricks whose elements all equal the background, returns the number of deactivated bricks
+  size_t prune() {
+    size_t num_pruned = 0;
+    for_each_brick_index_([&](size_t bx, size_t by, size_t bz) {
+      const value_type* data = brick_data(bx, by, bz);
+      if (is_active(bx, by, bz) && std::equal(data, data + brick_size, constant_brick_.begin())) {
+        deactivate_brick(bx, by, bz);
+        ++num_pruned;
+      }
+    });
+    return num_pruned;
+  }
+
+  // Element access
+  value_type& at(size_t x, size_t y, size_t z) {
+    DASSERT(x < width() && y < height() && z < depth());
+    return activate_brick(x / B, y / B, z / B)[local_index_(x, y, z)];
+  }
+  const value_type& at(size_t x, size_t y, size_t z) const {
+    DASSERT(x < width() && y < height() && z < depth());
+    return brick_data(x / B, y / B, z / B)[local_index_(x, y, z)];
+  }
+
+  // Nearest neighbour interpolation
+  value_type& atnn(float x, float y, float z) {
+    return at(clamp_(x, width()), clamp_(y, height()), clamp_(z, depth()));
+  }
+  const value_type& atnn(float x, float y, float z) const {
+    return at(clamp_(x, width()), clamp_(y, height()), clamp_(z, depth()));
+  }
+
+  // Copies the n elements starting at (x, y, z) along x to row, without activating
+  void read_row(size_t x, size_t y, size_t z, size_t n, value_type* row) const {
+    DASSERT(x + n <= width() && y < height() && z < depth());
+    for (size_t i = 0; i < n;) {
+      const size_t bx = (x + i) / B;
+      const size_t run = std::min(n - i, B - (x + i) % B);
+      const value_type* src = brick_data(bx, y / B, z / B) + local_index_(x + i, y, z);
+      std::copy(src, src + run, row + i);
+      i += run;
+    }
+  }
+
+  // Calls f(bx, by, bz, data) for every active brick, data points to the brick_size elements of the brick
+  template <typename F>
+  void for_each_active_brick(F f) {
+    for_each_brick_index_([&](size_t bx, size_t by, size_t bz) {
+      if (is_active(bx, by, bz))
+        f(bx, by, bz, slot_data_(bricks_[brick_index_(bx, by, bz)]));
+    });
+  }
+  template <typename F>
+  void for_each_active_brick(F f) const {
+    for_each_brick_index_([&](size_t bx, size_t by, size_t bz) {
+      if (is_active(bx, by, bz))
+        f(bx, by, bz, slot_data_(bricks_[brick_index_(bx, by, bz)]));
+    });
+  }
+  // Calls f(x, y, z, value) for the elements of the active bricks within the array
+  template <typename F>
+  void for_each_active(F f) {
+    for_each_active_brick([&](size_t bx, size_t by, size_t bz, value_type* data) { for_each_brick_element_(bx, by, bz, data, f); });
+  }
+  template <typename F>
+  void for_each_active(F f) const {
+    for_each_active_brick([&](size_t bx, size_t by, size_t bz, const value_type* data) { for_each_brick_element_(bx, by, bz, data, f); });
+  }
+
+  // Dense copy, the slabs along z are distributed on the pfor threads
+  marray<T, 3, A> to_marray(const pfor_partitioner& partitioner = pfor_partitioner()) const {
+    marray<T, 3, A> ret(allocator_);
+    ret.allocate_first_touch(width(), height(), depth(), partitioner);
+    T* data = ret.data();
+    partitioner.for_each_chunk(size_t(0), depth(), [&](size_t start, size_t stop) {
+      for (size_t z = start; z < stop; ++z) {
+        for (size_t y = 0; y < height(); ++y)
+          read_row(0, y, z, width(), data + (z * height() + y) * width());
+      }
+    });
+    return ret;
+  }
+
+  allocator_type get_allocator() const { return allocator_; }
+
+private:
+  static const uint32_t inactive_ = uint32_t(-1);
+
+  size_t brick_index_(size_t bx, size_t by, size_t bz) const {
+    DASSERT(bx < bricks_x_ && by < bricks_y_ && bz < bricks_z_);
+    return (bz * bricks_y_ + by) * bricks_x_ + bx;
+  }
+  static size_t local_index_(size_t x, size_t y, size_t z) { return ((z % B) * B + y % B) * B + x % B; }
+  static size_t clamp_(float v, size_t n) { return static_cast<size_t>(std::min(std::max(static_cast<int>(v), 0), static_cast<int>(n) - 1)); }
+
+  value_type* slot_data_(uint32_t slot) { return chunks_[slot / SPARSE_MARRAY_POOL_CHUNK].data() + (slot % SPARSE_MARRAY_POOL_CHUNK) * brick_size; }
+  const value_type* slot_data_(uint32_t slot) const { return chunks_[slot / SPARSE_MARRAY_POOL_CHUNK].data() + (slot % SPARSE_MARRAY_POOL_CHUNK) * brick_size; }
+  uint32_t allocate_slot_() {
+    if (free_.empty()) {
+      // Chunks are never reallocated, hence brick addresses are stable
+      const uint32_t first = static_cast<uint32_t>(chunks_.size() * SPARSE_MARRAY_POOL_CHUNK);
+      RASSERT_MSG(first + SPARSE_MARRAY_POOL_CHUNK < inactive_, "sparse_marray: brick pool exhausted");
+      chunks_.emplace_back(allocator_);
+      chunks_.back().resize_uninitialized(SPARSE_MARRAY_POOL_CHUNK * brick_size);
+      for (uint32_t slot = first + SPARSE_MARRAY_POOL_CHUNK; slot-- > first; )
+        free_.push_back(slot);
+    }
+    const uint32_t slot = free_.back();
+    free_.pop_back();
+    return slot;
+  }
+
+  template <typename F>
+  void for_each_brick_index_(F f) const {
+    for (size_t bz = 0; bz < bricks_z_; ++bz) {
+      for (size_t by = 0; by < bricks_y_; ++by) {
+        for (size_t bx = 0; bx < bricks_x_; ++bx)
+          f(bx, by, bz);
+      }
+    }
+  }
+  template <typename V, typename F>
+  void for_each_brick_element_(size_t bx, size_t by, size_t bz, V* data, F& f) const {
+    _impl_sparse_marray::for_each_brick_element<B>(bx, by, bz, width(), height(), depth(), [&](size_t x, size_t y, size_t z, size_t local) {
+      f(x, y, z, data[local]);
+    });
+  }
+
+  allocator_type allocator_;
+  size_t dims_[3];
+  size_t bricks_x_;
+  size_t bricks_y_;
+  size_t bricks_z_;
+  size_t num_active_;
+  std::vector<value_type> constant_brick_;
+  std::vector<uint32_t> bricks_;      // Pool slot of each brick or inactive_
+  std::vector<container_type> chunks_;
+  std::vector<uint32_t> free_;        // Free pool slots, the lowest on top
+};
+template <typename T, size_t B, typename A>
+const uint32_t sparse_marray<T, B, A>::inactive_;
+
+
+// Sparse copy of a dense array, bricks with all elements equal to background stay inactive
+template <size_t B = 8, typename T, typename A, typename L>
+sparse_marray<T, B, A> make_sparse_marray(const marray<T, 3, A, L>& dense, const T& background, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  sparse_marray<T, B, A> ret(dense.width(), dense.height(), dense.depth(), background, dense.get_allocator());
+  const size_t bricks_x = ret.bricks_x();
+  const size_t bricks_y = ret.bricks_y();
+  const size_t w = dense.width();
+  const size_t h = dense.height();
+  const size_t d = dense.depth();
+  // Find the non-constant bricks in parallel, activate them serially and copy in parallel
+  std::vector<uint8_t> is_active(ret.num_bricks(), 0);
+  partitioner.for_each_chunk(size_t(0), ret.num_bricks(), [&](size_t start, size_t stop) {
+    for (size_t brick = start; brick < stop; ++brick) {
+      const size_t bx = brick % bricks_x;
+      const size_t by = brick / bricks_x % bricks_y;
+      const size_t bz = brick / (bricks_x * bricks_y);
+      bool is_constant = true;
+      _impl_sparse_marray::for_each_brick_element<B>(bx, by, bz, w, h, d, [&](size_t x, size_t y, size_t z, size_t) {
+        is_constant = is_constant && dense.at(x, y, z) == background;
+      });
+      is_active[brick] = !is_constant;
+    }
+  });
+  std::vector<T*> brick_data(ret.num_bricks(), nullptr);
+  for (size_t brick = 0; brick < ret.num_bricks(); ++brick) {
+    if (is_active[brick])
+      brick_data[brick] = ret.activate_brick(brick % bricks_x, brick / bricks_x % bricks_y, brick / (bricks_x * bricks_y));
+  }
+  partitioner.for_each_chunk(size_t(0), ret.num_bricks(), [&](size_t start, size_t stop) {
+    for (size_t brick = start; brick < stop; ++brick) {
+      if (!is_active[brick])
+        continue;
+      T* data = brick_data[brick];
+      _impl_sparse_marray::for_each_brick_element<B>(brick % bricks_x, brick / bricks_x % bricks_y, brick / (bricks_x * bricks_y), w, h, d, [&](size_t x, size_t y, size_t z, size_t local) {
+        data[local] = dense.at(x, y, z);
+      });
+    }
+  });
+  return ret;
+}
+
+
+// Gradient magnitude as marray::gradient(x, y, z).length(), zero at the faces like the dense version.
+// A constant region has zero gradient, hence only the active bricks and their face neighbours are computed.
+template <typename T, size_t B, typename A>
+sparse_marray<T, B, A> gradient_length_volume(const sparse_marray<T, B, A>& f, const pfor_partitioner& partitioner = pfor_partitioner()) {
+  static_assert(!std::is_unsigned<T>::value, "");
+  sparse_marray<T, B, A> ret(f.width(), f.height(), f.depth(), T(0), f.get_allocator());
+  const size_t w = f.width();
+  const size_t h = f.height();
+  const size_t d = f.depth();
+  // Active bricks dilated by their 6 face neighbours
+  std::vector<size_t> todo;
+  std::vector<T*> todo_data;
+  for (size_t bz = 0; bz < f.bricks_z(); ++bz) {
+    for (size_t by = 0; by < f.bricks_y(); ++by) {
+      for (size_t bx = 0; bx < f.bricks_x(); ++bx) {
+        const bool is_needed = f.is_active(bx, by, bz) ||
+          (bx > 0 && f.is_active(bx - 1, by, bz)) || (bx + 1 < f.bricks_x() && f.is_active(bx + 1, by, bz)) ||
+          (by > 0 && f.is_active(bx, by - 1, bz)) || (by + 1 < f.bricks_y() && f.is_active(bx, by + 1, bz)) ||
+          (bz > 0 && f.is_active(bx, by, bz - 1)) || (bz + 1 < f.bricks_z() && f.is_active(bx, by, bz + 1));
+        if (!is_needed)
+          continue;
+        todo.push_back((bz * f.bricks_y() + by) * f.bricks_x() + bx);
+        todo_data.push_back(ret.activate_brick(bx, by, bz));
+      }
+    }
+  }
+  partitioner.for_each_chunk(size_t(0), todo.size(), [&](size_t start, size_t stop) {
+    // The brick and a halo of 1 element, gathered linearly
+    const size_t side = B + 2;
+    std::vector<T> in(side * side * side, T(0));
+    const T minus_two = T(-2);
+    for (size_t i = start; i < stop; ++i) {
+      const size_t bx = todo[i] % f.bricks_x();
+      const size_t by = todo[i] / f.bricks_x() % f.bricks_y();
+      const size_t bz = todo[i] / (f.bricks_x() * f.bricks_y());
+      const size_t x0 = bx * B;
+      const size_t y0 = by * B;
+      const size_t z0 = bz * B;
+      const size_t gx_start = std::max<size_t>(x0, 1) - 1;
+      const size_t gx_stop = std::min(w, x0 + B + 1);
+      for (size_t z = std::max<size_t>(z0, 1) - 1; z < std::min(d, z0 + B + 1); ++z) {
+        for (size_t y = std::max<size_t>(y0, 1) - 1; y < std::min(h, y0 + B + 1); ++y)
+          f.read_row(gx_start, y, z, gx_stop - gx_start, &in[((z + 1 - z0) * side + (y + 1 - y0)) * side + (gx_start + 1 - x0)]);
+      }
+      T* out = todo_data[i];
+      for (size_t z = std::max<size_t>(z0, 1); z < std::min(d - 1, z0 + B); ++z) {
+        for (size_t y = std::max<size_t>(y0, 1); y < std::min(h - 1, y0 + B); ++y) {
+          for (size_t x = std::max<size_t>(x0, 1); x < std::min(w - 1, x0 + B); ++x) {
+            const T* p = &in[((z + 1 - z0) * side + (y + 1 - y0)) * side + (x + 1 - x0)];
+            const T gx = (p[1] - p[-1]) / minus_two;
+            const T gy = (p[side] - p[-static_cast<ptrdiff_t>(side)]) / minus_two;
+            const T gz = (p[side * side] - p[-static_cast<ptrdiff_t>(side * side)]) / minus_two;
+            out[((z - z0) * B + (y - y0)) * B + (x - x0)] = _impl_marray_gradient::length(gx, gy, gz);
+          }
+        }
+      }
+    }
+  });
+  return ret;
+}
+
+
+} // namespace util
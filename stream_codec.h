@@ -0,0 +1,201 @@
+//
+//  Stream Codec
+//    Block codecs for the chunks of serialize_stream.h, plugged in as a template parameter.
+//    null_codec: Stores the data as is
+//    lz_codec:   Self-contained LZ77 codec in the style of LZ4, byte aligned sequences of literals and
+//                matches within a 64 KB window. Favors speed over ratio, decoding runs at several GB/s
+//
+//   USAGE:
+//     std::vector<char> encoded(util::lz_codec::max_encoded_size(raw.size()));
+//     encoded.resize(util::lz_codec::encode(raw.data(), raw.size(), encoded.data()));
+//     std::vector<char> decoded(raw.size());
+//     bool ok = util::lz_codec::decode(encoded.data(), encoded.size(), decoded.data(), decoded.size());
+//
+//     A custom codec provides the same static interface
+//     struct my_codec {
+//       static const uint8_t id = 200;                                 // Stored in the stream, unique
+//       static size_t max_encoded_size(size_t raw_size);
+//       static size_t encode(const char* src, size_t raw_size, char* dst); // Returns encoded size
+//       static bool decode(const char* src, size_t encoded_size, char* dst, size_t raw_size);
+//     };
+//
+//  NOTES:
+//  - decode validates all offsets and lengths and returns false for corrupt input, it never reads or
+//    writes outside of the given buffers
+//  - Codecs are stateless, hence chunks can be encoded and decoded in parallel
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace util {
+
+
+struct null_codec {
+  static const uint8_t id = 0;
+  static size_t max_encoded_size(size_t raw_size) { return raw_size; }
+  static size_t encode(const char* src, size_t raw_size, char* dst) {
+    if (raw_size > 0)
+      memcpy(dst, src, raw_size);
+    return raw_size;
+  }
+  static bool decode(const char* src, size_t encoded_size, char* dst, size_t raw_size) {
+    if (encoded_size != raw_size)
+      return false;
+    if (raw_size > 0)
+      memcpy(dst, src, raw_size);
+    return true;
+  }
+};
+
+
+namespace _impl_lz_codec {
+  static const size_t hash_bits = 13;
+  static const size_t min_match = 4;
+  static const size_t max_offset = 65535;
+  static const size_t end_literals = 5;  // The last bytes are always literals
+  static const size_t match_margin = 12; // Matches must start this far from the end
+
+  inline uint32_t read32(const uint8_t* src) {
+    uint32_t val;
+    memcpy(&val, src, 4);
+    return val;
+  }
+  inline uint32_t hash(uint32_t seq) { return (seq * 2654435761u) >> (32 - hash_bits); }
+
+  // Lengths >= 15 continue in bytes of 255 and a final byte < 255
+  inline uint8_t* write_length(uint8_t* dst, size_t len) {
+    for (; len >= 255; len -= 255)
+      *dst++ = 255;
+    *dst++ = static_cast<uint8_t>(len);
+    return dst;
+  }
+  inline bool read_length(const uint8_t*& src, const uint8_t* src_end, size_t& len) {
+    uint8_t byte = 255;
+    while (byte == 255) {
+      if (src == src_end)
+        return false;
+      byte = *src++;
+      len += byte;
+    }
+    return true;
+  }
+
+  // Token (literal length << 4 | match length - 4), extended lengths, literals, 16 bit offset
+  inline uint8_t* write_sequence(uint8_t* dst, const uint8_t* literals, size_t num_literals, size_t offset, size_t match_len) {
+    uint8_t* token = dst++;
+    const size_t match_code = match_len - min_match;
+    *token = static_cast<uint8_t>(((num_literals < 15 ? num_literals : 15) << 4) | (match_code < 15 ? match_code : 15));
+    if (num_literals >= 15)
+      dst = write_length(dst, num_literals - 15);
+    memcpy(dst, literals, num_literals);
+    dst += num_literals;
+    *dst++ = static_cast<uint8_t>(offset & 0xFF);
+    *dst++ = static_cast<uint8_t>(offset >> 8);
+    if (match_code >= 15)
+      dst = write_length(dst, match_code - 15);
+    return dst;
+  }
+  // The last sequence has literals only
+  inline uint8_t* write_last_literals(uint8_t* dst, const uint8_t* literals, size_t num_literals) {
+    *dst++ = static_cast<uint8_t>((num_literals < 15 ? num_literals : 15) << 4);
+    if (num_literals >= 15)
+      dst = write_length(dst, num_literals - 15);
+    if (num_literals > 0)
+      memcpy(dst, literals, num_literals);
+    return dst + num_literals;
+  }
+} // namespace _impl_lz_codec
+
+
+struct lz_codec {
+  static const uint8_t id = 1;
+  static size_t max_encoded_size(size_t raw_size) { return raw_size + raw_size / 255 + 16; }
+
+  static size_t encode(const char* src_chars, size_t raw_size, char* dst_chars) {
+    using namespace _impl_lz_codec;
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(src_chars);
+    uint8_t* const dst = reinterpret_cast<uint8_t*>(dst_chars);
+    uint8_t* out = dst;
+    size_t anchor = 0;
+    if (raw_size > match_margin) {
+      // Positions are only candidates, they are verified before use
+      uint32_t table[size_t(1) << hash_bits];
+      memset(table, 0, sizeof(table));
+      const size_t match_limit = raw_size - match_margin;
+      const size_t end_limit = raw_size - end_literals;
+      size_t pos = 1;
+      while (pos < match_limit) {
+        const uint32_t seq = read32(src + pos);
+        const uint32_t h = hash(seq);
+        size_t candidate = table[h];
+        table[h] = static_cast<uint32_t>(pos);
+        if (pos - candidate > max_offset || read32(src + candidate) != seq) {
+          // Step faster through data without matches
+          pos += 1 + ((pos - anchor) >> 6);
+          continue;
+        }
+        size_t len = min_match;
+        while (pos + len < end_limit && src[candidate + len] == src[pos + len])
+          ++len;
+        while (pos > anchor && candidate > 0 && src[pos - 1] == src[candidate - 1]) {
+          --pos;
+          --candidate;
+          ++len;
+        }
+        out = write_sequence(out, src + anchor, pos - anchor, pos - candidate, len);
+        pos += len;
+        anchor = pos;
+      }
+    }
+    out = write_last_literals(out, src + anchor, raw_size - anchor);
+    return static_cast<size_t>(out - dst);
+  }
+
+  static bool decode(const char* src_chars, size_t encoded_size, char* dst_chars, size_t raw_size) {
+    using namespace _impl_lz_codec;
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(src_chars);
+    const uint8_t* const src_end = src + encoded_size;
+    uint8_t* const dst = reinterpret_cast<uint8_t*>(dst_chars);
+    uint8_t* out = dst;
+    uint8_t* const dst_end = dst + raw_size;
+    while (src < src_end) {
+      const uint8_t token = *src++;
+      size_t num_literals = token >> 4;
+      if (num_literals == 15 && !read_length(src, src_end, num_literals))
+        return false;
+      if (num_literals > static_cast<size_t>(src_end - src) || num_literals > static_cast<size_t>(dst_end - out))
+        return false;
+      if (num_literals > 0)
+        memcpy(out, src, num_literals);
+      out += num_literals;
+      src += num_literals;
+      if (src == src_end)
+        break;
+      if (src_end - src < 2)
+        return false;
+      const size_t offset = size_t(src[0]) | (size_t(src[1]) << 8);
+      src += 2;
+      size_t len = (token & 15) + min_match;
+      if ((token & 15) == 15 && !read_length(src, src_end, len))
+        return false;
+      if (offset == 0 || offset > static_cast<size_t>(out - dst) || len > static_cast<size_t>(dst_end - out))
+        return false;
+      const uint8_t* match = out - offset;
+      if (offset >= len)
+        memcpy(out, match, len);
+      else {
+        // Overlapping match repeats the last offset bytes
+        for (size_t i = 0; i < len; ++i)
+          out[i] = match[i];
+      }
+      out += len;
+    }
+    return out == dst_end;
+  }
+};
+
+
+} // namespace util
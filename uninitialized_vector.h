@@ -4,9 +4,18 @@
 //
 //   USAGE:
 //     auto my_vector = util::uninitialized_vector<double>(100000);
+//     auto my_huge_vector = util::uninitialized_vector<double, util::huge_page_allocator<double>>(100000);
+//
+//     util::default_init_vector<float> samples;
+//     samples.resize_uninitialized(100000); // Same as samples.resize(100000)
+//     samples.resize(200000, 0.0f);         // Explicit values are still written
 //
 //  NOTES:
-//    Does not work with custom allocators.
+//    Built on default_init_allocator, an allocator adaptor which default-initializes instead of
+//    value-initializing. Hence construction, resize(n) and insert(pos, n) leave trivial types untouched
+//    for the entire lifetime of the vector, not only at construction.
+//    Non-trivial types are still default constructed.
+//    Any allocator can be adapted, stateful allocators are passed by argument.
 //
 //  Contact:
 //    viktor.sehr(at)gmail.com
@@ -14,42 +23,61 @@
 
 #pragma once
 #include <vector>
+#include <memory>
+#include <utility>
 
 namespace util {
 
 
-namespace detail {
-template <typename T>
-struct hollow_type_base {
-  typedef T RealType;
-  hollow_type_base() {}
-  hollow_type_base(const hollow_type_base&) {}
-  hollow_type_base(hollow_type_base&&) {}
-  hollow_type_base& operator=(const hollow_type_base&) { return *this; }
-  hollow_type_base& operator=(hollow_type_base&&) { return *this; }
-  ~hollow_type_base() {}
-private:
-  uint8_t block[sizeof(RealType)];
+template <typename T, typename A = std::allocator<T> >
+class default_init_allocator : public A {
+  typedef std::allocator_traits<A> base_traits;
+public:
+  typedef default_init_allocator<T, A> my_type;
+  typedef A base_allocator_type;
+  template <typename U>
+  struct rebind {
+    typedef default_init_allocator<U, typename base_traits::template rebind_alloc<U> > other;
+  };
+
+  default_init_allocator() {}
+  default_init_allocator(const A& allocator) : A(allocator) {}
+  template <typename U, typename B>
+  default_init_allocator(const default_init_allocator<U, B>& other) : A(static_cast<const B&>(other)) {}
+
+  // Default-initialization when no constructor arguments are given
+  template <typename U>
+  void construct(U* ptr) {
+    ::new (static_cast<void*>(ptr)) U;
+  }
+  template <typename U, typename... Args>
+  void construct(U* ptr, Args&&... args) {
+    base_traits::construct(static_cast<A&>(*this), ptr, std::forward<Args>(args)...);
+  }
 };
-template <typename RealVector, typename HollowVector>
-RealVector
-make_uninitialized_vector_by_types(size_t num_elements) {
-  typedef typename RealVector::value_type RealType;
-  typedef typename HollowVector::value_type HollowType;
-  static_assert(sizeof(RealType) == sizeof(HollowType), "Error creating HollowType");
-  HollowVector hollow_vector(num_elements);
-  RealVector* disguised_hollow_vector = reinterpret_cast<RealVector*>(&hollow_vector);
-  RealVector real_vector;
-  ::std::swap(real_vector, *disguised_hollow_vector);
-  return real_vector;
-}
-} // namespace detail
 
-template <typename RealType>
-std::vector<RealType>
-uninitialized_vector(size_t num_elements) {
-  typedef detail::hollow_type_base<RealType> HollowType;
-  return detail::make_uninitialized_vector_by_types<std::vector<RealType>, std::vector<HollowType>>(num_elements);
+
+template <typename T, typename A = std::allocator<T> >
+class default_init_vector : public std::vector<T, default_init_allocator<T, A> > {
+public:
+  typedef default_init_vector<T, A> my_type;
+  typedef std::vector<T, default_init_allocator<T, A> > vector_type;
+  typedef typename vector_type::allocator_type allocator_type;
+  using vector_type::vector_type;
+  default_init_vector() {}
+  default_init_vector(const A& allocator) : vector_type(allocator_type(allocator)) {}
+
+  // Elements past the current size are left uninitialized for trivial types
+  void resize_uninitialized(size_t n) { this->resize(n); }
+};
+
+
+template <typename RealType, typename A = std::allocator<RealType> >
+default_init_vector<RealType, A>
+uninitialized_vector(size_t num_elements, const A& allocator = A()) {
+  default_init_vector<RealType, A> real_vector(allocator);
+  real_vector.resize_uninitialized(num_elements);
+  return real_vector;
 }
 
 
@@ -7,6 +7,9 @@
 #include <algorithm>
 #include <map>
 #include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include "bit_count.h"
 
 #define UTIL_ASSERT DASSERT
 #define UTIL_DEDUCT_VALUE_TYPE(container) std::remove_reference<decltype(*std::begin(container))>::type
@@ -449,10 +452,10 @@ void erase_all_if_unstable(C& container, P& pred) {
 // count_bits
 template <typename T>
 size_t count_bits(T val) {
-  UTIL_ASSERT(sizeof(val) <= 4 && "count_bits can only handle types whose size <= 4bytes");
-  unsigned long dummy = 0;
-  memcpy((void*)&dummy, (void*)&val, sizeof(val));
-  return std::bitset<4>(dummy).count();
+  static_assert(sizeof(val) <= 8, "count_bits can only handle types whose size <= 8bytes");
+  uint64_t bits = 0;
+  memcpy((void*)&bits, (void*)&val, sizeof(val));
+  return util::popcount(bits);
 }
 
 // one_bit_set